@@ -18,6 +18,61 @@
 /* - When probing fails, chaining results.
 /* - Has a search engine and prompts user to find a reserved word 
 /*   in the HASH table.
+/* - With -lex, tokenizes the C source files named on the command line
+/*   instead, skipping comments, literals and preprocessor lines, and
+/*   counts the reserved words (found in the HASH table) and the user
+/*   identifiers.
+/* - With -index, does the same for every .c and .h file under the named
+/*   directories on several threads, and builds a HASH table of the
+/*   distinct user identifiers.
+/* - With -save, writes the HASH table to a snapshot file; with -load,
+/*   maps a snapshot straight into memory and queries it without
+/*   reading the word list again.
+/* - With -batch, reads search items from a file or standard input and
+/*   writes a found/not found line for each, in bulk, for filtering big
+/*   token streams against the table or a mapped snapshot.
+/* - With -cbench, copies the words into a table that many threads can
+/*   search while others add to it, and measures how the search rate
+/*   grows with the number of threads.
+/* - With -stats, writes a report of the HASH table's chain lengths and
+/*   of how many buckets adds and searches looked in, as text or JSON.
+/* - With -size and -hash, builds the HASH table with another number of
+/*   buckets (or enough for the word list) or another hash function;
+/*   with -sweep, tries every size in a range with every hash function
+/*   on several threads and recommends the smallest good enough.
+/* - With -bloom, checks each search item against a Bloom filter before
+/*   the HASH table, so most missing words cost no probes; with
+/*   -filterbench, times searches that mostly miss with and without one.
+/* - With -prefix, also keeps the words sorted, so a search item ending
+/*   in '*' lists words that start with it.
+/* - With -fuzzy, also keeps the words in a BK-tree, so a search item
+/*   not found gets near misses offered.
+/* - With -scan, finds every whole word of the table in text files (or
+/*   standard input) in one pass, however many words the table holds.
+/* - With -top, lists the most frequent words of text files, counting
+/*   them exactly or in a fixed memory budget with a Count-Min sketch
+/*   or the Space-Saving algorithm.
+/* - With -xref, writes an index file of where every identifier of a
+/*   source tree appears, and -lookup answers queries from it, joined
+/*   with & and |.
+/* - With -refresh, brings a cross-reference index up to date by
+/*   tokenizing only the files that changed.
+/* - With -serve, answers lookups from other processes over a Unix
+/*   domain socket; -loadgen drives a server and reports lookups per
+/*   second and latency percentiles.
+/* - With -external, keeps the words in working files on disk, sorted
+/*   into pages by hash, for word lists bigger than memory.
+/* - With -readbench, times the line reader it shares with tailx.
+/* - With -tail, counts the words of the table in the last lines of a
+/*   log, reading and counting on separate threads.
+/* - With -churn, deletes and adds back every word many times over and
+/*   reports whether searches slow down.
+/* - With -microbench, times adds, hits, misses and walks on generated
+/*   keys from small tables to very large ones.
+/* - With -fold, folds words and search items to lower case, and takes
+/*   identifiers in UTF-8 with -lex, -index and -tail.
+/* 
+/*  Build with:  cc -O2 -pthread TokenExtractor.c -o TokenExtractor -lm
 /* 
 /*  Description of the hash algorithm:                                       
 /*  -----------------------------------
@@ -94,16 +149,27 @@
 /*   available by way of a macro.
 */ 
 /* initHashTable();
-/* - Initializes the buckets in the hashtable to NULL.
-/* - Expects the calling function will pass the address array of pointers.
+/* - Initializes the buckets in the hashtable to NULL and gives it an
+/*   empty arena to hold its nodes.
+/* - Expects the calling function will pass the address of the table.
 /* - Nothing is returned.
 */
+/* freeHashTable();
+/* - Releases every node in the table, and the text in each, with one
+/*   call to arenaFree().
+*/
 /* processInputFile()
 /* - Reads the reserved words from the input file (one word per line)
 /* - Makes a node for the linked list.
 /* - Adds nodes to the linked list if not previously entered. 
-/* - Expects address to array of pointers (hash table) and an
-/*   input file name.
+/* - Expects address to array of pointers (hash table), an input file
+/*   name, and the size and hash function to initialize the table with.
+/*   A size of 0 sizes the table to the number of words.
+/* - With fold_case, folds each word and turns away any that isn't UTF-8,
+/*   and marks the table as one that ignores case.
+/* - Maps the file and counts its lines before building anything, so
+/*   the nodes and their text all come out of one arena block.  Words
+/*   may be of any length.
 /* Calls findHashEntry() and addHashEntry()       
 */
 /* addHashEntry()
@@ -136,13 +202,36 @@
 /* Uses quadratic probing to backtrack 
 /* over the buckets to find a key not in the expected (hashed) position.
 */
+/* deleteHashEntry()
+/* Takes an item out of the table.  Rather than leave a marker in the
+/* bucket it emptied, shiftHashHole() moves back any item that was
+/* probed past that bucket, so searches never get longer as words come
+/* and go.
+*/
+/* recordHashFind()
+/* Adds one findHashEntry() call, its result and the number of buckets
+/* it looked in, to the table's statistics.
+*/
+/* printHashStats()
+/* Writes the table's statistics to a file, as text or, if the file
+/* name ends in .json, as JSON:
+/* - load factor and buckets used,
+/* - a histogram of chain lengths,
+/* - how many words went into their expected bucket, into a bucket
+/*   found by rehashKey(), or onto a chain, and how far rehashKey()
+/*   had to step,
+/* - average and maximum buckets looked in per successful and per
+/*   unsuccessful findHashEntry().
+*/
 /* makeNode()
 /* Makes a new node for the linked list and pass the pointer
 /* back to caller.  If an error occurs during space allocation
 /* print an appropriate message and exit from the program.
 /*
-/* Expects the caller pass it a character array that it
-/* can store in the newly allocated node.
+/* Expects the caller pass it the arena of the table the node is for,
+/* and a character array that it can store in the newly allocated node.
+/* The node and its copy of the text are carved out of the arena side
+/* by side, so there is one allocation per word and no per-word free.
 /*
 /* If the char array is real data and there is enough memory for
 /* the node, it initializes the next ptr to NULL and returns
@@ -165,17 +254,416 @@
 /* -Prints the results to the screen.
 /*
 */
+/* lexSourceBuffer()
+/* - Walks a buffer of C source and hands every identifier to a visitor
+/*   function as a (pointer, length) pair.
+/* - Comments, string and character literals, numbers and preprocessor
+/*   lines are skipped.
+/* - Identifier boundaries are found sixteen bytes at a time using
+/*   character-class bitmasks when SSE2 is available.
+*/
+/* lexSourceFiles()
+/* - Reads each named source file, runs the lexer over it and classifies
+/*   the identifiers as reserved words or user identifiers.
+/* - Prints the counts and the lexer throughput.
+*/
+/* indexSourceTree()
+/* - Collects the source files under the named paths and tokenizes them
+/*   on a pool of threads.  Each thread owns a share of the file list
+/*   and steals from the others once its own share runs out.
+/* - Each thread adds the user identifiers it sees to its own hash table
+/*   with makenode() and addHashEntry(), so no lock is taken per word.
+/* - The thread tables are sized from the bytes of source each thread
+/*   can expect, and the merged table from the words they found, so
+/*   chains stay short however big the tree is.
+/* - The thread tables are merged at the end in sorted order, which
+/*   makes the merged table the same whatever the number of threads.
+*/
+/* saveHashSnapshot()
+/* - Writes the table to a snapshot file: a header, the buckets, the
+/*   nodes and the text, with byte offsets in place of pointers and a
+/*   checksum over everything after the header.
+/* - The file is written under a temporary name and renamed into place,
+/*   so processes already using the old snapshot are not disturbed.
+*/
+/* openHashSnapshot()
+/* - Maps a snapshot file read-only and checks its header.  Nothing is
+/*   parsed or allocated, so opening takes the same time at any size,
+/*   and every process mapping the file shares one page-cache copy.
+/* - Checks the checksum as well only when asked to, since that means
+/*   reading every page.
+*/
+/* findSnapshotEntry()
+/* - findHashEntry() for a mapped snapshot.  Follows the same buckets,
+/*   chains and probe sequence, through offsets instead of pointers.
+*/
+/* runBatchQueries()
+/* - Reads search items, one per line, in large blocks and answers them
+/*   BATCH_SIZE at a time.  Each batch is hashed and its buckets and
+/*   chain heads prefetched before any of it is searched, so the cache
+/*   misses of a whole batch overlap instead of queueing one by one.
+/* - Results go to standard output through a large buffer; the query
+/*   rate goes to standard error.
+*/
+/* findConcHashEntry(), addConcHashEntry()
+/* - The same find and add as findHashEntry() and addHashEntry(), on a
+/*   table that threads can share.  Buckets only ever go from empty to
+/*   full or gain a node at the front of their chain, and each change is
+/*   published with one atomic store or compare-and-swap after the node
+/*   is complete.  Searching therefore takes no lock and never waits.
+/* - Adding takes the lock of the key's stripe (its expected bucket
+/*   modulo CONC_STRIPES), so two threads can't add the same word twice,
+/*   and claims buckets with compare-and-swap, since words from other
+/*   stripes may be probing into the same ones.  Nodes come from the
+/*   stripe's own arena.  No node is freed while the table is in use, so
+/*   searches never need to worry about reclamation.
+*/
+/* runSizeSweep()
+/* - Builds a table from the word file for every size in a range and
+/*   every hash function, spread over a pool of threads, and reports the
+/*   collisions, longest chain, memory and search time of each.
+/* - Recommends the smallest size that keeps collisions within a target.
+*/
+/* findHashPrefix()
+/* - Lists the words of a table starting with a prefix.  The table keeps
+/*   a sorted array of its nodes alongside the buckets, and two binary
+/*   searches find the run of words with the prefix, so a search reads
+/*   about 2 log2(words) strings whatever the size of the answer.
+*/
+/* findHashFuzzy()
+/* - Finds the words of a table within an edit distance of a string,
+/*   nearest first, through a BK-tree over the table's words.  Since
+/*   edit distance obeys the triangle inequality, only children whose
+/*   distance from their parent lies within the allowed distance of the
+/*   parent's own distance from the string need visiting, which prunes
+/*   most of the tree.
+*/
+/* bloomMayContain(), buildHashFilter()
+/* - A blocked Bloom filter kept in front of a table.  Each word's bits
+/*   all fall in one 64-byte block, so a search for a missing word is
+/*   usually turned away after reading a single cache line, without
+/*   hashing into the table or probing it.
+/* - Unlike an xor filter it can take more words after it is built,
+/*   which addHashEntry() relies on.
+*/
+/* scanBuffer()
+/* - Finds every whole-word occurrence of every word of a table in a
+/*   text in one pass, through an Aho-Corasick automaton built from the
+/*   table.  The automaton's failure links are folded into a dense
+/*   transition table, so each byte of text costs one table lookup
+/*   however many words there are.
+*/
+/* runTopTokens()
+/* - Lists the most frequent words of a text.  It can count every
+/*   distinct word exactly in a table, or keep to a memory budget with a
+/*   Count-Min sketch and a min-heap of the leaders, or with the
+/*   Space-Saving counters, and say how far off their counts may be.
+*/
+/* buildXref(), runXrefQueries()
+/* - Write and query a cross-reference index: for every identifier in a
+/*   source tree, each file and line it appears on.  Each identifier's
+/*   places are kept as a posting list of small gaps in a variable
+/*   number of bytes, with a skip entry every XREF_SKIP places, and the
+/*   identifiers are found through a table laid out like a snapshot's.
+/*   The file is mapped, not read, so a query touches only the lists it
+/*   needs.  Lists are intersected for "a&b" and merged for "a|b".
+*/
+/* refreshXref()
+/* - Brings a cross-reference index up to date after edits.  The index
+/*   keeps a manifest of the size, time and content hash of every file
+/*   it covers, so only files that were added or changed are tokenized
+/*   again; the places of the rest are carried over from the old lists.
+*/
+/* runServer()
+/* - Keeps the table (or a mapped snapshot) loaded and answers lookups
+/*   over a Unix domain socket from an epoll loop, so clients pay for
+/*   building the table only once.  Requests are framed in binary and
+/*   may be pipelined; runLoadGenerator() measures the lookups per
+/*   second and the latencies clients see.
+*/
+/* loadExternalTable()
+/* - Loads a word list too big for memory into a table kept on disk.
+/*   Words are spilled to partition files by hash within a RAM budget,
+/*   then each partition is sorted and written to the table file in
+/*   pages; findDiskEntry() reads the one page a word could be in.  The
+/*   files are made fresh by createDiskFile() and deleted at once, so
+/*   they last only as long as the program.
+*/
+/* runTailPipeline()
+/* - Counts the words of the table in the last lines of a log, in one
+/*   process: a tail stage finds the lines and streams them to a count
+/*   stage on another thread through a bounded queue.
+*/
+/* runChurnBenchmark()
+/* - Replaces every word of the table, at random, round after round,
+/*   and shows whether the buckets looked in per search and the time
+/*   taken creep up as deletions and additions pile up.
+*/
+/* runMicroBenchmark()
+/* - Times adding, searching for keys there and not there, and walking
+/*   the table, on tables of generated keys from HASHSIZE up to 100
+/*   million, with uniform and Zipfian searches.  Cycles, cache misses
+/*   and branch misses are counted with perf_event_open() where the
+/*   kernel allows, and the results written as JSON or tab-separated
+/*   values so runs can be compared.
+*/
+/* foldCase(), validUtf8()
+/* - What -fold puts words and search items through.  ASCII letters are
+/*   folded to lower case sixteen bytes at a time, so a table holding
+/*   folded words ignores case, and UTF-8 is checked with a fast path
+/*   that steps over sixteen ASCII bytes at a time, so identifiers in
+/*   UTF-8 cost plain ASCII input nothing.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
 
-#define HASHSIZE  67
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "linereader.h"
+
+/* Defines the number of buckets a table has unless -size says
+ * otherwise, and the most it may have.
+ */
+#define HASHSIZE     67
+#define MAXHASHSIZE  (1 << 28)
+
+/* Defines the most buckets rehashKey() steps to before giving up and
+ * chaining.  Probing stops after half the table, as it always has, or
+ * after MAXPROBES on a large table.
+ */
+#define MAXPROBES  64
+#define PROBE_LIMIT(size)  (((size) + 1) / 2 < MAXPROBES ? ((size) + 1) / 2 : MAXPROBES)
+
+/* Defines the hash functions a table can use.  HASH_ORIGINAL is the one
+ * this program was written with.
+ */
+#define HASH_ORIGINAL   0
+#define HASH_DJB2       1
+#define HASH_SDBM       2
+#define HASH_FNV1A      3
+#define HASH_FUNCTIONS  4
+
+/* Names of the hash functions, as -hash and the reports know them.
+ */
+static char *hash_names[HASH_FUNCTIONS] = { "original", "djb2", "sdbm", "fnv1a" };
 
 typedef struct node {
         char   *line_text;		/* For variable length lines from any file */
         struct node *next_ptr;  /* For singly linked list. */
+        unsigned long count;	/* Times the word was seen, for -top */
 } NODE_ENTRY;
 
 typedef NODE_ENTRY *NODE_PTR;
 
-typedef NODE_PTR HASH_TAB[HASHSIZE];
+/* Defines the size of the blocks an arena carves nodes out of, and the
+ * alignment of everything it hands out.
+ */
+#define ARENA_BLOCKSIZE  (64 * 1024)
+#define ARENA_ALIGN      sizeof(void *)
+
+/* A block of arena storage.  The storage itself follows the header.
+ */
+typedef struct arena_block {
+	struct arena_block *next;	/* Older blocks */
+	size_t used;				/* Bytes handed out from this block */
+	size_t size;				/* Bytes of storage in this block */
+} ARENA_BLOCK;
+
+/* A bump allocator.  Nodes and their text are carved out of large
+ * blocks one after another and are only ever released all at once.
+ */
+typedef struct arena {
+	ARENA_BLOCK *head;			/* Block being filled; older ones follow */
+	size_t       bytes;			/* Total bytes handed out */
+} ARENA;
+
+/* Statistics a table collects as words are added and searched for.
+ * A probe is one bucket looked in; the expected bucket counts as one.
+ */
+typedef struct hash_stats {
+	int           enabled;			/* Off while threads share the table */
+	unsigned long home_adds;		/* Added to an empty expected bucket */
+	unsigned long probed_adds;		/* Added to a bucket found by rehashKey() */
+	unsigned long chained_adds;		/* Chained when probing failed */
+	unsigned long add_probes;		/* Buckets rehashKey() stepped to */
+	unsigned long max_add_probes;
+	unsigned long hits;				/* Successful findHashEntry() calls */
+	unsigned long hit_probes;
+	unsigned long max_hit_probes;
+	unsigned long misses;			/* Unsuccessful findHashEntry() calls */
+	unsigned long miss_probes;
+	unsigned long max_miss_probes;
+	unsigned long filtered;			/* Misses the filter turned away */
+	unsigned long deletes;			/* Taken out by deleteHashEntry() */
+	unsigned long moved_back;		/* Moved back into a bucket a delete emptied */
+} HASH_STATS;
+
+/* Defines the longest chain length given its own line in the chain
+ * length histogram; longer chains are counted together.
+ */
+#define STATS_MAXCHAIN  16
+
+/* Defines the size of a filter block, one cache line, in 64-bit words
+ * and in bits, and the most bits a filter sets per word.
+ */
+#define BLOOM_BLOCKWORDS  8
+#define BLOOM_BLOCKBITS   (BLOOM_BLOCKWORDS * 64)
+#define BLOOM_MAXHASHES   16
+
+/* Defines how many bit positions within a block are taken from each
+ * 64-bit number bloomMix() produces.
+ */
+#define BLOOM_BITSPERMIX  7
+
+/* A blocked Bloom filter.  Every word sets its bits in a single block,
+ * so testing for a word reads one cache line.
+ */
+typedef struct bloom_filter {
+	uint64_t *block;				/* BLOOM_BLOCKWORDS words per block */
+	uint64_t  nblocks;
+	int       nhashes;				/* Bits set per word */
+	double    fpr;					/* False-positive rate sized for */
+} BLOOM_FILTER;
+
+/* Defines the most matches a prefix search lists when asked from the
+ * query prompt.
+ */
+#define PREFIX_TOPK  10
+
+/* A prefix index: every word of a table in sorted order, so that the
+ * words starting with any prefix lie next to one another.
+ */
+typedef struct prefix_index {
+	NODE_PTR     *word;
+	unsigned long count;
+	unsigned long capacity;
+} PREFIX_INDEX;
+
+/* Defines the edit distance fuzzy searches allow unless told otherwise,
+ * and the most suggestions the query prompt offers.
+ */
+#define FUZZY_DISTANCE  2
+#define FUZZY_TOPK      5
+
+/* A node of a BK-tree.  Each child's word is at the distance the child
+ * records from this node's word, and no two children share a distance.
+ */
+typedef struct bk_node {
+	NODE_PTR        word;
+	struct bk_node *child;			/* First child */
+	struct bk_node *sibling;		/* Next child of the same parent */
+	int             distance;		/* Edit distance from the parent */
+} BK_NODE;
+
+/* A fuzzy index: a BK-tree over every word of a table.  Its nodes come
+ * out of its own arena; the words are the table's.
+ */
+typedef struct fuzzy_index {
+	BK_NODE      *root;
+	ARENA         arena;
+	unsigned long count;
+	int           max_distance;		/* Allowed when the prompt searches */
+} FUZZY_INDEX;
+
+/* A word found by a fuzzy search and how far it is from the search item.
+ */
+typedef struct fuzzy_match {
+	NODE_PTR word;
+	int      distance;
+} FUZZY_MATCH;
+
+/* Defines the RAM an external table keeps to unless -budget says
+ * otherwise, the size of the pages its words are stored in, and the
+ * most partitions it spreads them over while loading.
+ */
+#define EXTERNAL_BUDGET         (256 * 1024 * 1024)
+#define EXTERNAL_PAGESIZE       4096
+#define EXTERNAL_MAXPARTITIONS  512
+
+/* Defines the bytes in front of each word in an external table's files:
+ * the word's 64-bit hash, then its 32-bit length.  The text follows,
+ * without a null.
+ */
+#define DISK_RECORDSIZE  12
+
+/* A page of an external table, as its directory knows it.
+ */
+typedef struct disk_page {
+	uint64_t first_hash;			/* Least hash of a word in the page */
+	uint64_t offset;				/* Where the page is in the table file */
+	uint32_t length;
+} DISK_PAGE;
+
+/* A partition being filled while an external table loads.  Its words
+ * gather in the buffer and are written to its file whenever it fills.
+ */
+typedef struct disk_partition {
+	int       fd;
+	char     *buf;
+	size_t    used;
+	uint64_t  bytes;				/* Written to the file so far */
+} DISK_PARTITION;
+
+/* A table whose words are kept on disk.  While it loads, words are
+ * spilled to partition files by hash, each partition a range of hashes.
+ * Sealing sorts each partition, drops duplicates and writes it to the
+ * table file in pages, so the file holds every word in hash order and
+ * the directory of pages, kept in memory, leads a search to the one
+ * page that can hold a word.
+ */
+typedef struct disk_table {
+	char           *filename;		/* The table file */
+	int             fd;
+	DISK_PARTITION *partition;		/* While loading; NULL once sealed */
+	int             npartitions;
+	size_t          partition_bufsize;
+	DISK_PAGE      *page;			/* The directory, in hash order */
+	unsigned long   npages;
+	char           *page_buf;		/* Holds the longest page, for searches */
+	size_t          page_bufsize;
+	unsigned long   added;			/* Words added, duplicates too */
+	unsigned long   words;			/* Distinct words stored */
+	uint64_t        spilled;		/* Bytes written to partition files */
+	uint64_t        file_size;
+} DISK_TABLE;
+
+typedef struct hash_tab {
+	NODE_PTR  *bucket;				/* Heads of the chains */
+	int        size;				/* Number of buckets */
+	int        hash_fn;				/* HASH_ORIGINAL and so on */
+	ARENA      arena;				/* Storage for the nodes and their text */
+	BLOOM_FILTER *bloom;			/* Turns away missing words, or NULL */
+	PREFIX_INDEX *prefix;			/* Sorted words for prefix searches, or NULL */
+	FUZZY_INDEX  *fuzzy;			/* BK-tree for fuzzy searches, or NULL */
+	DISK_TABLE   *disk;				/* Keeps the words on disk instead, or NULL */
+	int           fold_case;		/* Words and search items folded, for -fold */
+	HASH_STATS stats;
+} HASH_TAB;
 
 /** Pre-processor definitions
  ****************************/
@@ -186,44 +674,677 @@ typedef NODE_PTR HASH_TAB[HASHSIZE];
  */
 #define MAXARRAY  80
 
+/* Defines the file of reserved words that is hashed when the word
+ * list is not named on the command line.
+ */
+#define DEFAULT_WORDFILE  "data.txt"
+
+/* Macros to use for boolean values.
+ */
+#define TRUE	1
+#define FALSE	0
+
+/* Character classes used by the source lexer.  A byte with no class
+ * bits set is whitespace or punctuation the lexer can step over.
+ */
+#define CC_IDENT	0x01	/* Letter, digit or underscore */
+#define CC_DIGIT	0x02	/* Starts a number, not an identifier */
+#define CC_SPECIAL	0x04	/* May start a comment, literal or directive */
+
+/* Running totals kept while lexing source files.
+ */
+typedef struct lex_counts {
+	unsigned long files;			/* Source files read */
+	unsigned long bytes;			/* Bytes of source lexed */
+	unsigned long reserved_words;	/* Identifiers found in the table */
+	unsigned long user_identifiers;	/* All other identifiers */
+	unsigned long invalid_utf8;		/* Identifiers -fold found not UTF-8 */
+} LEX_COUNTS;
+
+/* Context handed to classifyToken() for every identifier.
+ */
+typedef struct lex_context {
+	HASH_TAB   *reserved;			/* Hash table of reserved words */
+	int         longest_reserved;	/* Longer identifiers can't match */
+	int         check_utf8;			/* File isn't UTF-8, so check each identifier */
+	LEX_COUNTS  counts;
+} LEX_CONTEXT;
+
+/* Function the lexer calls with each identifier it extracts.
+ */
+typedef void (*TOKEN_VISITOR)(const char *, int, void *);
+
+/* Growable list of source file names.
+ */
+typedef struct file_list {
+	char    **names;
+	int       count;
+	int       capacity;
+	uint64_t  bytes;				/* Sizes of the source files collected */
+} FILE_LIST;
+
+/* State of one indexing thread.  The files a worker still owns are the
+ * range [next, limit) of the file list, packed into one word as
+ * (next << 32 | limit) so the owner and thieves can both claim files
+ * with a single compare-and-swap.
+ */
+typedef struct index_worker {
+	pthread_t            thread;
+	int                  id;
+	struct index_pool   *pool;
+	_Atomic unsigned long long range;	/* Files this worker still owns */
+	HASH_TAB             table;		/* User identifiers seen by this worker */
+	LEX_CONTEXT          lex;		/* Reserved words and running counts */
+} INDEX_WORKER;
+
+/* State shared by all indexing threads.  Nothing in it changes once the
+ * threads have started, apart from each worker's range.
+ */
+typedef struct index_pool {
+	FILE_LIST    *files;
+	int           nworkers;
+	INDEX_WORKER *workers;
+} INDEX_POOL;
+
+/* Defines the number of bits a file index is shifted by in a range.
+ */
+#define RANGE_SHIFT  32
+
+/* Defines the bytes of source expected per distinct user identifier
+ * when sizing the tables of -index.  Real trees run to a hundred or
+ * more, so this errs on the side of spare buckets.
+ */
+#define INDEX_BYTESPERWORD  64
+
+/* Defines the identity and layout version of snapshot files.  The
+ * version must change whenever the layout or the hashing does.
+ */
+#define SNAPSHOT_MAGIC      "TXHASHSN"
+#define SNAPSHOT_VERSION    2
+#define SNAPSHOT_BYTEORDER  0x01020304
+
+/* Header at the front of a snapshot file.  Every offset is counted in
+ * bytes from the start of the file, so the file can be mapped at any
+ * address.  An offset of 0 stands for NULL.
+ */
+typedef struct snapshot_header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t byte_order;		/* Tells big- from little-endian writers */
+	uint32_t hash_size;			/* Buckets */
+	uint32_t hash_fn;			/* HASH_ORIGINAL and so on */
+	uint64_t nwords;
+	uint64_t file_size;
+	uint64_t bucket_offset;		/* uint64_t offset of each chain head */
+	uint64_t node_offset;		/* SNAPSHOT_NODE for every word */
+	uint64_t text_offset;		/* Null-terminated words */
+	uint64_t checksum;			/* Of everything after the header */
+} SNAPSHOT_HEADER;
+
+/* A node as stored in a snapshot file.
+ */
+typedef struct snapshot_node {
+	uint64_t text;				/* Offset of the word */
+	uint64_t next;				/* Offset of the next node in the chain */
+} SNAPSHOT_NODE;
+
+/* A snapshot file mapped into memory.
+ */
+typedef struct snapshot {
+	const char            *base;
+	size_t                 size;
+	const SNAPSHOT_HEADER *header;
+	const uint64_t        *bucket;
+} SNAPSHOT;
+
+/* Defines the size of the blocks batch queries are read and written
+ * in, and the number of queries whose memory accesses are overlapped.
+ */
+#define BATCH_BUFSIZE  (1024 * 1024)
+#define BATCH_SIZE     16
+
+/* Running totals kept while answering batch queries.
+ */
+typedef struct batch_counts {
+	unsigned long queries;
+	unsigned long hits;
+} BATCH_COUNTS;
+
+/* Defines the number of lock stripes in a concurrent table and the size
+ * each stripe is padded to, so that stripes don't share cache lines.
+ */
+#define CONC_STRIPES    16
+#define CACHE_LINESIZE  64
+
+/* A lock stripe: it serializes the adding of words whose expected
+ * bucket falls in the stripe, and holds their nodes.
+ */
+typedef struct conc_stripe {
+	pthread_mutex_t lock;
+	ARENA           arena;
+} __attribute__((aligned(CACHE_LINESIZE))) CONC_STRIPE;
+
+/* A hash table that can be searched by any number of threads while
+ * words are being added to it.
+ */
+typedef struct conc_hash_tab {
+	_Atomic(NODE_PTR) *bucket;
+	int                size;
+	int                hash_fn;
+	CONC_STRIPE        stripe[CONC_STRIPES];
+} CONC_HASH_TAB;
+
+/* Defines the share of benchmark operations, in percent, that add a
+ * word rather than search for one, and the number of operations each
+ * benchmark thread performs.
+ */
+#define CBENCH_WRITE_PERCENT  5
+#define CBENCH_OPS            1000000
+#define CBENCH_POOLSIZE       128
+
+/* Words used by the concurrent benchmark, shared by all its threads.
+ */
+typedef struct cbench_words {
+	char **present;				/* Words in the table from the start */
+	int    npresent;
+	char **pool;				/* Words the threads add */
+	char **absent;				/* Words never added */
+	CONC_HASH_TAB *table;
+} CBENCH_WORDS;
+
+/* State of one concurrent benchmark thread.
+ */
+typedef struct cbench_thread {
+	pthread_t     thread;
+	CBENCH_WORDS *words;
+	uint64_t      seed;
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long hits;
+} CBENCH_THREAD;
+
+/* Defines the number of searches timed on each table a sweep builds.
+ */
+#define SWEEP_FINDS  200000
+
+/* One table size and hash function tried by a sweep, and how the
+ * table came out.
+ */
+typedef struct sweep_result {
+	int           size;
+	int           hash_fn;
+	unsigned long collisions;		/* Words not in their expected bucket */
+	unsigned long longest;			/* Longest chain */
+	unsigned long max_probes;		/* Most buckets a find looked in */
+	size_t        bytes;			/* Buckets, nodes and text */
+	double        ns_per_find;
+} SWEEP_RESULT;
+
+/* The work of a sweep, shared by its threads.  Each thread claims the
+ * next result to fill in until none are left.
+ */
+typedef struct sweep_jobs {
+	FILE_LIST    *words;
+	SWEEP_RESULT *results;
+	int           njobs;
+	_Atomic int   next;
+} SWEEP_JOBS;
+
+/* Defines the filter benchmark's query stream: its length, the share
+ * of queries, in percent, for words that are in the table, and the
+ * number of distinct missing words it draws from.
+ */
+#define FBENCH_QUERIES      (4 * 1024 * 1024)
+#define FBENCH_HIT_PERCENT  1
+#define FBENCH_MISSWORDS    65536
+
+/* Defines the flag set on a scanning automaton's transitions into
+ * states where a word ends, so the scanning loop tests once per byte.
+ */
+#define AC_MATCH  0x80000000u
+
+/* Defines the number of stretches of text a scan walks at once, and
+ * their length.  Each byte's lookup depends on the one before, so a
+ * single walk waits on every load; several independent walks keep
+ * several loads in flight.  scanBuffer() spells out the walk of each
+ * lane, so AC_LANES can't be changed on its own.
+ */
+#define AC_LANES     4
+#define AC_LANESIZE  (64 * 1024)
+
+/* An Aho-Corasick automaton over the words of a table.  Bytes found in
+ * no word share class 0 and every other byte gets a class of its own.
+ * The transitions are a dense table of one row per state and one column
+ * per class, with the failure links already followed, and each holds
+ * its target's row offset (state times nclasses) rather than its number.
+ */
+typedef struct ac_automaton {
+	uint32_t     *delta;			/* nstates rows of nclasses transitions */
+	NODE_PTR     *word;				/* Word ending at each state, or NULL */
+	uint32_t     *link;				/* Next state down the failure chain where a word ends */
+	uint32_t      nstates;
+	int           nclasses;
+	size_t        longest;			/* Length of the longest word */
+	unsigned char class_of[256];
+} AC_AUTOMATON;
+
+/* A place in a lane where the automaton entered a flagged state, kept
+ * until the lanes before it have been reported.
+ */
+typedef struct ac_hit {
+	uint32_t state;
+	uint32_t pos;					/* Offset from the lane's start */
+} AC_HIT;
+
+/* Called by scanBuffer() for every match: the word and its offset.
+ */
+typedef void (*MATCH_VISITOR)(NODE_PTR, size_t, void *);
+
+/* Where -scan writes its matches, and how many there were.
+ */
+typedef struct scan_output {
+	char         *filename;		/* Put before each offset, or NULL */
+	char         *buf;
+	size_t        used;
+	unsigned long matches;
+} SCAN_OUTPUT;
+
+/* Defines the ways -top can count words.
+ */
+#define TOP_EXACT        0
+#define TOP_COUNTMIN     1
+#define TOP_SPACESAVING  2
+#define TOP_ESTIMATORS   3
+
+static char *estimator_names[TOP_ESTIMATORS] = { "exact", "cms", "spacesaving" };
+
+/* Defines the memory -top keeps to unless told otherwise, the chance
+ * it allows of a Count-Min count being further off than its bound, the
+ * table size exact counting uses unless told otherwise, and the bytes
+ * of text a heap word is reckoned at when sharing out a budget.
+ */
+#define TOP_BUDGET     (1024 * 1024)
+#define TOP_DELTA      0.01
+#define TOP_TABLESIZE  1048573
+#define TOP_WORDBYTES  16
+
+/* A word in a top-k heap, with its count and how far over its true
+ * count the count may be.
+ */
+typedef struct top_item {
+	char          *word;
+	uint64_t       hash;
+	unsigned long  count;
+	unsigned long  error;
+	int            slot;			/* Where the word's index entry is */
+} TOP_ITEM;
+
+/* A min-heap of words on their counts, so the least of the leaders is
+ * always at the top, with an open-addressed index from each word to
+ * its place in the heap.
+ */
+typedef struct top_heap {
+	TOP_ITEM *item;
+	int       n;
+	int       capacity;
+	int      *slot;					/* Heap positions, or -1 if free */
+	int       nslots;				/* A power of two */
+	size_t    text_bytes;
+} TOP_HEAP;
+
+/* A Count-Min sketch: depth rows of width counters.  A word adds to
+ * one counter in each row, and its count is the least of them.
+ */
+typedef struct count_min {
+	uint32_t *counter;
+	int       depth;
+	int       width;
+} COUNT_MIN;
+
+/* State of a -top run, handed to countToken() for every word.
+ */
+typedef struct top_counter {
+	int           estimator;
+	HASH_TAB      table;			/* Every word, for TOP_EXACT */
+	COUNT_MIN     sketch;			/* For TOP_COUNTMIN */
+	TOP_HEAP      heap;
+	char         *key;				/* The word, null terminated */
+	size_t        key_size;
+	unsigned long tokens;
+} TOP_COUNTER;
+
+/* Defines the identity and layout version of cross-reference index
+ * files, the number of places between skip entries, the table size
+ * terms are gathered in, and the most terms a query may name.
+ */
+#define XREF_MAGIC      "TXXREFIX"
+#define XREF_VERSION    2
+#define XREF_SKIP       64
+#define XREF_TABLESIZE  1048573
+#define XREF_MAXTERMS   16
+
+/* Places are compared and passed around as (file << 32 | line).
+ */
+#define XREF_PLACE(file, line)  (((uint64_t) (file) << 32) | (line))
+
+/* A term being gathered for a cross-reference index: a table node with
+ * its places packed behind it.  A place is the gap in file number since
+ * the last one, then the line, as a gap from the last line if the file
+ * didn't change; both are varints.  The node's count is the number of
+ * places.
+ */
+typedef struct xref_term {
+	NODE_ENTRY     node;			/* Must come first, to pass for a node */
+	unsigned char *postings;
+	size_t         used;
+	size_t         capacity;
+	uint32_t       last_file;
+	uint32_t       last_line;
+} XREF_TERM;
+
+/* State of a cross-reference build, handed to xrefToken() for every
+ * identifier.
+ */
+typedef struct xref_build {
+	HASH_TAB       terms;
+	uint32_t       file;			/* Number of the file being tokenized */
+	uint32_t       line;			/* Line of last_pos */
+	const char    *last_pos;
+	unsigned long  places;
+	unsigned long  bytes;			/* Source bytes tokenized */
+} XREF_BUILD;
+
+/* Header at the front of a cross-reference index file.  As in a
+ * snapshot, offsets are in bytes from the start of the file.
+ */
+typedef struct xref_header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t hash_size;
+	uint32_t hash_fn;
+	uint64_t nterms;
+	uint64_t nfiles;
+	uint64_t file_size;
+	uint64_t bucket_offset;		/* uint64_t offset of each chain head */
+	uint64_t term_offset;		/* XREF_RECORD for every term */
+	uint64_t file_offset;		/* XREF_FILE_ENTRY for every file */
+	uint64_t skip_offset;		/* XREF_SKIP_ENTRY lists */
+	uint64_t posting_offset;	/* Posting lists */
+	uint64_t text_offset;		/* Terms, then file names */
+	uint64_t checksum;			/* Of everything after the header */
+} XREF_HEADER;
+
+/* A term as stored in a cross-reference index.  It starts like a
+ * SNAPSHOT_NODE, so a chain is walked the same way.
+ */
+typedef struct xref_record {
+	uint64_t text;
+	uint64_t next;
+	uint64_t postings;			/* Offset of the posting list */
+	uint64_t skips;				/* Offset of the skip entries */
+	uint32_t count;				/* Places in the list */
+	uint32_t nskips;
+} XREF_RECORD;
+
+/* A skip entry: the place that ends a run of XREF_SKIP places, and the
+ * offset from the start of the list of the place after it.
+ */
+typedef struct xref_skip_entry {
+	uint32_t file;
+	uint32_t line;
+	uint32_t offset;
+} XREF_SKIP_ENTRY;
+
+/* An entry of an index's manifest: a file that was indexed, with its
+ * size, time and content hash at the time, so a refresh can tell which
+ * files changed without reading the rest.
+ */
+typedef struct xref_file_entry {
+	uint64_t name;				/* Offset of the file name */
+	uint64_t size;
+	int64_t  mtime;				/* Nanoseconds since the epoch, or -1 */
+	uint64_t hash;				/* snapshotChecksum() of the contents */
+} XREF_FILE_ENTRY;
+
+/* A cross-reference index file mapped into memory.
+ */
+typedef struct xref {
+	const char        *base;
+	size_t             size;
+	const XREF_HEADER *header;
+	const uint64_t    *bucket;
+	const XREF_FILE_ENTRY *file;
+} XREF;
+
+/* A position in a posting list.  file and line are the place last
+ * decoded; left is the number of places after it.
+ */
+typedef struct xref_cursor {
+	const XREF_RECORD     *term;
+	const unsigned char   *postings;
+	const unsigned char   *p;
+	const XREF_SKIP_ENTRY *skip;
+	uint32_t               left;
+	uint32_t               file;
+	uint32_t               line;
+} XREF_CURSOR;
+
+/* Defines the size of a server connection's buffers, which must hold
+ * the longest request (two bytes of length and up to 65535 of key),
+ * and the most events the server takes from epoll_wait() at once.
+ */
+#define SERVE_BUFSIZE  (128 * 1024)
+#define SERVE_EVENTS   64
+
+/* A client connection to the lookup server, with the requests read but
+ * not yet answered and the responses not yet written.
+ */
+typedef struct serve_conn {
+	int           fd;
+	int           writing;			/* Watched for room to write, not input */
+	size_t        in_used;
+	size_t        out_used;
+	unsigned long requests;
+	char          in[SERVE_BUFSIZE];
+	char          out[SERVE_BUFSIZE];
+} SERVE_CONN;
+
+/* Defines the load generator's connections, requests in flight on each
+ * and seconds to run unless told otherwise, the batches of requests each
+ * connection makes up in advance, and the longest latency, in
+ * microseconds, given its own count; longer ones are counted together.
+ */
+#define LOADGEN_CONNECTIONS  4
+#define LOADGEN_DEPTH        32
+#define LOADGEN_SECONDS      5
+#define LOADGEN_BATCHES      64
+#define LOADGEN_MAXLATENCY   100000
+
+/* State of one load generator connection.
+ */
+typedef struct loadgen_thread {
+	pthread_t      thread;
+	char          *socket_filename;
+	FILE_LIST     *words;
+	int            depth;			/* Requests in flight */
+	double         stop;			/* elapsedSeconds() to stop at */
+	uint64_t       seed;
+	unsigned long  requests;
+	unsigned long  hits;
+	unsigned long *latency;			/* Requests answered in each microsecond */
+	int            failed;
+} LOADGEN_THREAD;
+
+/* Defines the number of chunks of lines the tail pipeline's queue
+ * holds, the size of each chunk, and the number of lines the tail
+ * stage's ring starts with.
+ */
+#define TAIL_QUEUESIZE  8
+#define TAIL_CHUNKSIZE  (64 * 1024)
+#define TAIL_RINGSIZE   1024
+
+/* Defines the number of rounds the churn benchmark replaces every word
+ * of the table in.
+ */
+#define CHURN_ROUNDS    10
+
+/* Defines the number of searches of each kind the microbenchmark times
+ * on each table, the room a search key takes in its buffer, the most
+ * keys it puts in a table unless told otherwise, the skew of its
+ * Zipfian keys (YCSB's), and the rows of results each table gets.
+ */
+#define MICRO_OPS       (1 << 20)
+#define MICRO_KEYSIZE   24
+#define MICRO_MAXKEYS   100000000UL
+#define MICRO_THETA     0.99
+#define MICRO_ROWS      6
+
+/* Defines the hardware events the microbenchmark counts, where the
+ * kernel lets it.
+ */
+#define PERF_CYCLES         0
+#define PERF_CACHE_MISSES   1
+#define PERF_BRANCH_MISSES  2
+#define PERF_EVENTS         3
+
+/* A counter for each hardware event, or -1 for one that can't be
+ * counted, and what each counted when last read.
+ */
+typedef struct perf_counters {
+	int      fd[PERF_EVENTS];
+	uint64_t value[PERF_EVENTS];
+} PERF_COUNTERS;
+
+/* Draws ranks from 0 to n-1, rank i with a chance going as 1/(i+1) to
+ * the power theta, in a constant amount of work a draw once zeta(n) is
+ * known (the method of Gray et al., as YCSB uses it).
+ */
+typedef struct zipf_gen {
+	unsigned long n;
+	double        theta;
+	double        alpha;
+	double        zetan;
+	double        eta;
+} ZIPF_GEN;
+
+/* One row of the microbenchmark's results.
+ */
+typedef struct micro_result {
+	unsigned long keys;
+	int           size;
+	const char   *dist;				/* "uniform" or "zipf" */
+	const char   *op;				/* "add", "iterate", "find_hit" or "find_miss" */
+	unsigned long ops;
+	double        ns_per_op;
+	double        per_op[PERF_EVENTS];	/* Events per operation, or -1 */
+} MICRO_RESULT;
+
+/* A chunk of retained lines on its way from the tail stage to the count
+ * stage, each line ended by a newline.
+ */
+typedef struct tail_chunk {
+	char   *text;
+	size_t  used;
+	size_t  size;
+} TAIL_CHUNK;
+
+/* A line kept in the tail stage's ring.
+ */
+typedef struct tail_line {
+	char   *text;
+	size_t  len;
+	size_t  size;					/* Of text */
+} TAIL_LINE;
+
+/* The tail pipeline: the queue between its two stages, and what each
+ * stage counts.  The tail stage fills the chunk after the last one
+ * waiting; the count stage takes them from head.
+ */
+typedef struct tail_pipe {
+	TAIL_CHUNK      chunk[TAIL_QUEUESIZE];
+	int             head;			/* Next chunk for the count stage */
+	int             count;			/* Chunks waiting */
+	int             done;			/* TRUE once the tail stage is through */
+	TAIL_CHUNK     *filling;		/* The tail stage's chunk, or NULL */
+	pthread_mutex_t lock;
+	pthread_cond_t  not_full;
+	pthread_cond_t  not_empty;
+	INPUT_MAP       input;			/* Opened for the tail stage */
+	unsigned long   nlines;			/* Lines to keep */
+	HASH_TAB       *hash_tab;
+	int             longest;		/* Longest word in the table */
+	char           *key;			/* The count stage's copy of a word */
+	unsigned long   lines_read;
+	unsigned long   lines_kept;
+	int             from_end;		/* TRUE if the file was read from its end */
+	int             failed;			/* TRUE if reading stopped short */
+	unsigned long   full_waits;
+	unsigned long   empty_waits;
+	unsigned long   words;
+	unsigned long   found;
+	unsigned long   distinct;
+} TAIL_PIPE;
+
 /** Function prototypes
  ***********************/
 
 int /* Hashes key to an integer value */
-hashKey(char *);
+hashKey(char *, int, int);
 
 int /* Recalculates key index for quadratic probing method */ 
-hashKeyQuad(int);
+hashKeyQuad(int, int);
+
+int /* Looks up a hash function by name */
+hashFunctionNumber(char *);
 
 int /* Probes table until empty cell is found. Passes back index value */
-rehashKey(int, HASH_TAB);
+rehashKey(int, HASH_TAB *, unsigned int *);
 
 int /* Finds empty cell to add a node to the table based on algorithm */
-findRehashKey(int, HASH_TAB, char *);
+findRehashKey(int, HASH_TAB *, char *, unsigned int *);
+
+NODE_PTR /* Takes a string out of the table */
+deleteHashEntry(HASH_TAB *, char *);
+
+int /* Tells whether an item was probed through a bucket */
+probePathCrosses(HASH_TAB *, int, int, int);
+
+void /* Moves probed items back into a bucket a delete emptied */
+shiftHashHole(HASH_TAB *, int);
+
+int /* Records a search in the table's statistics */
+recordHashFind(HASH_TAB *, int, unsigned int);
+
+void /* Adds the search statistics of one table to another's */
+mergeHashStats(HASH_STATS *, HASH_STATS *);
+
+void /* Writes a table's statistics as text or JSON */
+printHashStats(HASH_TAB *, char *);
 
 void /* Initializes hash table so all buckets are empty */
-initHashTable(HASH_TAB);
+initHashTable(HASH_TAB *, int, int);
 
 void /* Adds a node to the table */
-addHashEntry(HASH_TAB, NODE_PTR);
+addHashEntry(HASH_TAB *, NODE_PTR);
 
 void /* Prints non-empty hash table cells */
-printHashEntries(HASH_TAB);
+printHashEntries(HASH_TAB *);
 
 int /* Finds a string in hash table; returns true or false indicator */
-findHashEntry(HASH_TAB, char *);
+findHashEntry(HASH_TAB *, char *);
 
 int /* Walks chains searching entries for a specified string */
 sequentialSearch(NODE_PTR, char *);  
 
-NODE_PTR  /* Allocates memory for a node structure */
-node_alloc(void);
+NODE_PTR  /* Allocates memory for a node structure and its text */
+node_alloc(ARENA *, int);
 
 NODE_PTR /* Allocates memory for character array */
-makenode(char *);
+makenode(ARENA *, char *);
 
 void /* Pulls lines from the input file and inserts them to hash table */
-processInputFile(char *, HASH_TAB);
+processInputFile(char *, HASH_TAB *, int, int, int);
 
 char * /* Creates a handle for the character array */
 stringDup(char *);
@@ -232,557 +1353,8649 @@ void  /* Prints non-empty cells in the hashtable to file */
 printNodeEntry(NODE_PTR);
 
 void /* Allows user to query the hash table for a reserved word */
-queryHashTable(HASH_TAB); 
+queryHashTable(HASH_TAB *); 
 
 void /* Prompts user for an input file */
 getInputFile(char *);
 
-/* Beginning of main() */
+void * /* Carves storage out of an arena */
+arenaAlloc(ARENA *, size_t);
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <math.h>
+int /* Sets aside one block for a known amount of arena storage */
+arenaReserve(ARENA *, size_t);
 
-/* Main():
-/* - Prompts user for an input file.
-/* - Reads the data from the input file and stores it a the HASH table.
-/* - Produces a report for each non-empty cell in the HASH table and
-/*   while listing all reserved words that occur in each chain.
-/* - Handles collisions using quadratic probing. When probing fails, 
-/*   chaining results.
-/* - Has a search engine and prompts user to find a reserved word 
-/*   in the HASH table.
- */
-void 
-main(void)
-{ 
-	HASH_TAB hash_tab;
-	char input_filename[MAXARRAY]; 
-	getInputFile(input_filename); 
+void /* Hands all of one arena's blocks over to another */
+arenaAdopt(ARENA *, ARENA *);
 
-	/** Initialize buckets to NULL... 
-	 **/							
-	initHashTable(hash_tab);
+void /* Releases every block of an arena */
+arenaFree(ARENA *);
 
-	/** Process the input file and make the hash table... 
-	 **/
-	processInputFile(input_filename, hash_tab); 
-	
-	printf("\n\n");
+void /* Releases a hash table's nodes and text in one go */
+freeHashTable(HASH_TAB *);
 
-	/** Access buckets and visit chained nodes and print contents... 
-	 **/
-	printHashEntries(hash_tab);
+void /* Prints command line usage */
+printUsage(char *);
 
-	/** Find a reserved word as specified by the user... 
-	 **/
-	queryHashTable(hash_tab);
+void /* Fills in the character class table used by the lexer */
+initCharClasses(void);
 
-} /* End main. */
+int /* Measures the run of identifier characters at a position */
+identSpan(const char *, const char *);
 
-/* This function finds a 'hash entry' (a node that was stored by way of
-/* the hashing algorithms of this program) and returns 1, or returns an 
-/* indication that the entry does not exist in the table (0).
-/*
-/* The following cases return 1:
-/* - The item is found where expected (first hashing of the key renders
-/*   the index).
-/* - The item found in the list pointed to by the index.  In other words,
-/*   due to a collision, it was chained.
-/* - The item was found in a rehashed index by stepping through the 
-/*   probing algorithm.
-/* 
-/* The following case retuns 0:
-/* The function is not found in the expected location, and it is not
-/* found in the chained list of the expected location, and it is not
+const char * /* Steps over whitespace and punctuation to the next token */
+skipGap(const char *, const char *);
+
+const char * /* Steps over the rest of a block comment */
+skipBlockComment(const char *, const char *);
+
+const char * /* Steps to the end of a line, honouring continuations */
+skipToLineEnd(const char *, const char *);
+
+const char * /* Steps over a preprocessor directive */
+skipDirective(const char *, const char *);
+
+const char * /* Steps over a string or character literal */
+skipQuoted(const char *, const char *);
+
+const char * /* Steps over a numeric constant */
+skipNumber(const char *, const char *);
+
+int /* Tells whether a '#' is the first thing on its line */
+startsDirective(const char *, const char *);
+
+int /* Tells whether an identifier is a literal prefix such as L or u8 */
+isLiteralPrefix(const char *, int);
+
+void /* Hands every identifier in a buffer of C source to a visitor */
+lexSourceBuffer(const char *, long, TOKEN_VISITOR, void *);
+
+char * /* Reads a whole file into memory */
+readWholeFile(char *, long *);
+
+int /* Finds the length of the longest word in the table */
+longestHashEntry(HASH_TAB *);
+
+int /* Looks an identifier up in the table of reserved words */
+isReservedToken(LEX_CONTEXT *, const char *, int);
+
+void /* Classifies one identifier as reserved or user-defined */
+classifyToken(const char *, int, void *);
+
+void /* Tokenizes source files and reports identifier counts */
+lexSourceFiles(int, char **, HASH_TAB *);
+
+double /* Reads a monotonic clock in seconds */
+elapsedSeconds(void);
+
+void /* Adds a name to a list of files */
+addFileName(FILE_LIST *, char *);
+
+int /* Tells whether a file name ends in .c or .h */
+isSourceFileName(char *);
+
+void /* Collects the source files at or under a path */
+collectSourceFiles(char *, FILE_LIST *, int);
+
+int /* Claims the next file for a worker, stealing if need be */
+claimFile(INDEX_WORKER *);
+
+int /* Steals half of another worker's remaining files */
+stealFiles(INDEX_WORKER *);
+
+void /* Adds one identifier to a worker's table */
+indexToken(const char *, int, void *);
+
+void * /* Thread body: tokenizes files until none are left */
+indexWorker(void *);
+
+int /* Compares two nodes by text for qsort() */
+compareNodeText(const void *, const void *);
+
+unsigned long /* Merges the worker tables into one table */
+mergeWorkerTables(INDEX_POOL *, HASH_TAB *, int);
+
+void /* Tokenizes a source tree on several threads */
+indexSourceTree(int, char **, HASH_TAB *, int, char *);
+
+uint64_t /* Checksums a block of memory */
+snapshotChecksum(const char *, size_t);
+
+void /* Writes a hash table to a snapshot file */
+saveHashSnapshot(HASH_TAB *, char *);
+
+int /* Maps a snapshot file and checks it */
+openHashSnapshot(char *, SNAPSHOT *, int);
+
+void /* Unmaps a snapshot file */
+closeHashSnapshot(SNAPSHOT *);
+
+int /* Finds a string in a mapped snapshot */
+findSnapshotEntry(SNAPSHOT *, char *);
+
+int /* Walks a snapshot chain searching for a string */
+sequentialSearchSnapshot(SNAPSHOT *, uint64_t, char *);
+
+void /* Allows user to query a mapped snapshot */
+querySnapshot(SNAPSHOT *);
+
+void /* Prefetches what looking up a batch of keys will touch */
+prefetchBatch(HASH_TAB *, SNAPSHOT *, char **, int);
+
+void /* Looks up a batch of keys and buffers the results */
+answerBatch(HASH_TAB *, SNAPSHOT *, char **, char **, int, char *, size_t, size_t *,
+			BATCH_COUNTS *);
+
+void /* Answers search items read from a file or standard input */
+runBatchQueries(HASH_TAB *, SNAPSHOT *, char *);
+
+void /* Initializes a concurrent table */
+initConcHashTable(CONC_HASH_TAB *, int, int);
+
+void /* Releases a concurrent table's nodes */
+freeConcHashTable(CONC_HASH_TAB *);
+
+int /* Finds a string in a concurrent table without locking */
+findConcHashEntry(CONC_HASH_TAB *, char *);
+
+int /* Adds a string to a concurrent table unless already there */
+addConcHashEntry(CONC_HASH_TAB *, char *);
+
+uint64_t /* Steps a thread's random number generator */
+nextRandom(uint64_t *);
+
+void * /* Thread body: a mix of searches and adds */
+concBenchWorker(void *);
+
+void /* Measures concurrent search rates for 1 up to n threads */
+runConcBenchmark(HASH_TAB *, int);
+
+void /* Reads a word list into memory in file order */
+readWordList(char *, FILE_LIST *);
+
+void /* Builds and measures one table of a sweep */
+sweepTable(FILE_LIST *, SWEEP_RESULT *);
+
+void * /* Thread body: measures tables until none are left */
+sweepWorker(void *);
+
+void /* Measures a range of table sizes and hash functions */
+runSizeSweep(char *, int, int, int, int, unsigned long, int);
+
+void /* Builds a sorted index of a table's words */
+buildPrefixIndex(HASH_TAB *);
+
+void /* Releases a prefix index */
+freePrefixIndex(PREFIX_INDEX *);
+
+void /* Adds a word to a prefix index in order */
+addPrefixEntry(PREFIX_INDEX *, NODE_PTR);
+
+void /* Takes a word out of a prefix index */
+removePrefixEntry(PREFIX_INDEX *, NODE_PTR);
+
+unsigned long /* Finds where a string would go in a prefix index */
+prefixLowerBound(PREFIX_INDEX *, char *);
+
+int /* Finds the words in a table starting with a prefix */
+findHashPrefix(HASH_TAB *, char *, NODE_PTR *, int, unsigned long *);
+
+int /* Measures the edit distance between two strings */
+editDistance(const char *, const char *);
+
+void /* Builds a BK-tree over a table's words */
+buildFuzzyIndex(HASH_TAB *, int);
+
+void /* Adds a word to a BK-tree */
+addFuzzyEntry(FUZZY_INDEX *, NODE_PTR);
+
+int /* Compares two fuzzy matches for qsort() */
+compareFuzzyMatch(const void *, const void *);
+
+int /* Finds the words in a table within an edit distance of a string */
+findHashFuzzy(HASH_TAB *, char *, int, FUZZY_MATCH *, int, unsigned long *);
+
+int /* Finds the smallest prime at least as big as a number */
+nextPrime(int);
+
+uint64_t /* Hashes a word for a Bloom filter */
+bloomHash(char *);
+
+uint64_t /* Stirs the bits of a Bloom filter hash */
+bloomMix(uint64_t);
+
+void /* Sizes and allocates an empty Bloom filter */
+initBloomFilter(BLOOM_FILTER *, unsigned long, double);
+
+void /* Releases a Bloom filter's blocks */
+freeBloomFilter(BLOOM_FILTER *);
+
+void /* Sets a word's bits in a Bloom filter */
+bloomAdd(BLOOM_FILTER *, char *);
+
+int /* Tells whether a word may be in a Bloom filter */
+bloomMayContain(BLOOM_FILTER *, char *);
+
+void /* Builds a Bloom filter over every word in a table */
+buildHashFilter(HASH_TAB *, double);
+
+void /* Times a miss-heavy query stream with and without a filter */
+runFilterBenchmark(HASH_TAB *);
+
+void /* Builds an Aho-Corasick automaton over a table's words */
+buildScanAutomaton(HASH_TAB *, AC_AUTOMATON *);
+
+void /* Releases an Aho-Corasick automaton */
+freeScanAutomaton(AC_AUTOMATON *);
+
+unsigned long /* Reports the whole words ending at a place in a buffer */
+scanMatches(AC_AUTOMATON *, const unsigned char *, size_t, uint32_t, size_t,
+			MATCH_VISITOR, void *);
+
+unsigned long /* Finds every whole word of an automaton in a buffer */
+scanBuffer(AC_AUTOMATON *, const char *, size_t, MATCH_VISITOR, void *);
+
+void /* Writes a scan match to the output buffer */
+printScanMatch(NODE_PTR, size_t, void *);
+
+void /* Scans text files for every word in a table */
+runScan(HASH_TAB *, int, char **);
+
+NODE_PTR /* Finds the node holding a string in a table */
+findHashNode(HASH_TAB *, char *);
+
+void /* Allocates an empty top-k heap */
+initTopHeap(TOP_HEAP *, int);
+
+void /* Releases a top-k heap and its words */
+freeTopHeap(TOP_HEAP *);
+
+int /* Finds a word's place in a top-k heap */
+findTopItem(TOP_HEAP *, char *, uint64_t);
+
+void /* Swaps two items of a top-k heap */
+swapTopItems(TOP_HEAP *, int, int);
+
+void /* Moves a heap item down past smaller counts */
+siftTopItemDown(TOP_HEAP *, int);
+
+void /* Moves a heap item up past bigger counts */
+siftTopItemUp(TOP_HEAP *, int);
+
+void /* Drops a word from a top-k heap's index */
+unindexTopItem(TOP_HEAP *, int);
+
+void /* Adds a word to a top-k heap, displacing the least if full */
+addTopItem(TOP_HEAP *, char *, uint64_t, unsigned long, unsigned long);
+
+void /* Sizes and allocates an empty Count-Min sketch */
+initCountMin(COUNT_MIN *, size_t, double, double);
+
+unsigned long /* Counts a word in a Count-Min sketch */
+countMinAdd(COUNT_MIN *, uint64_t);
+
+void /* Splits text into runs of identifier characters */
+splitWords(const char *, size_t, TOKEN_VISITOR, void *);
+
+void /* Counts one word for -top */
+countToken(const char *, int, void *);
+
+int /* Compares two heap items by count for qsort() */
+compareTopItem(const void *, const void *);
+
+void /* Lists the most frequent words of text files */
+runTopTokens(int, char **, int, int, size_t, double, int, int);
+
+int /* Writes a number as a varint */
+putVarint(unsigned char *, uint64_t);
+
+uint64_t /* Reads a varint */
+getVarint(const unsigned char **);
+
+void /* Adds a place to a cross-reference term */
+addXrefPlace(XREF_TERM *, uint32_t, uint32_t);
+
+XREF_TERM * /* Adds a new term to a cross-reference build */
+newXrefTerm(HASH_TAB *, const char *, int);
+
+void /* Records an identifier's place for a cross-reference build */
+xrefToken(const char *, int, void *);
+
+int /* Takes a file's size and time for an index manifest */
+statXrefFile(char *, XREF_FILE_ENTRY *);
+
+int /* Tokenizes one source file into a cross-reference build */
+xrefFile(XREF_BUILD *, char *, uint32_t, XREF_FILE_ENTRY *);
+
+uint64_t /* Writes a cross-reference build to an index file */
+writeXref(char *, HASH_TAB *, FILE_LIST *, XREF_FILE_ENTRY *, XREF_HEADER *);
+
+void /* Tokenizes a source tree and writes a cross-reference index */
+buildXref(char *, int, char **);
+
+void /* Re-tokenizes the changed files of a cross-reference index */
+refreshXref(char *, int, char **);
+
+int /* Maps a cross-reference index and checks it */
+openXref(char *, XREF *, int);
+
+void /* Unmaps a cross-reference index */
+closeXref(XREF *);
+
+const XREF_RECORD * /* Finds a term in a cross-reference index */
+findXrefTerm(XREF *, char *);
+
+void /* Sets a cursor on the first place of a posting list */
+openXrefCursor(XREF *, const XREF_RECORD *, XREF_CURSOR *);
+
+int /* Moves a cursor to the next place */
+xrefCursorNext(XREF_CURSOR *);
+
+int /* Moves a cursor to the first place at or after a place */
+xrefCursorSeek(XREF_CURSOR *, uint64_t);
+
+unsigned long /* Finds the places of a cross-reference query */
+findXrefPlaces(XREF *, char *, uint64_t **);
+
+int /* Compares two places for qsort() */
+comparePlace(const void *, const void *);
+
+void /* Answers cross-reference queries */
+runXrefQueries(char *, int, char **, int);
+
+void /* Signal handler: asks the lookup server to stop */
+stopServer(int);
+
+int /* Makes the socket the lookup server listens on */
+openServerSocket(char *);
+
+int /* Connects to the lookup server */
+connectServer(char *);
+
+void /* Answers the requests waiting on a server connection */
+answerRequests(HASH_TAB *, SNAPSHOT *, SERVE_CONN *, BATCH_COUNTS *);
+
+int /* Reads, answers and writes for a ready server connection */
+serveConnection(HASH_TAB *, SNAPSHOT *, SERVE_CONN *, BATCH_COUNTS *, int);
+
+void /* Answers lookups over a Unix domain socket */
+runServer(HASH_TAB *, SNAPSHOT *, char *);
+
+void * /* Thread body: keeps requests in flight on one connection */
+loadgenWorker(void *);
+
+unsigned long /* Finds a latency percentile in a histogram */
+latencyPercentile(unsigned long *, unsigned long, double);
+
+void /* Measures a lookup server's rate and latency */
+runLoadGenerator(char *, char *, int, int, int);
+
+int /* Makes a working file that is deleted when the program ends */
+createDiskFile(char *);
+
+void /* Sets up a table's words to be spilled to disk partitions */
+initDiskTable(HASH_TAB *, char *, size_t, uint64_t);
+
+void /* Writes out a partition's buffered words */
+flushDiskPartition(DISK_TABLE *, DISK_PARTITION *);
+
+void /* Spills a word to its partition */
+addDiskEntry(DISK_TABLE *, char *);
+
+int /* qsort() comparison: orders disk records by hash, then text */
+compareDiskRecord(const void *, const void *);
+
+void /* Appends a page to the table file and the directory */
+writeDiskPage(DISK_TABLE *, const char *, size_t, uint64_t *, unsigned long *);
+
+void /* Sorts the partitions into the paged table file */
+sealDiskTable(DISK_TABLE *);
+
+int /* Reads the one page a word could be in and looks for it */
+findDiskEntry(DISK_TABLE *, char *);
+
+void /* Closes and removes a disk table's files */
+freeDiskTable(DISK_TABLE *);
+
+void /* Loads a word list into a table kept on disk */
+loadExternalTable(char *, HASH_TAB *, char *, size_t, FILE *);
+
+TAIL_CHUNK * /* Takes a free chunk for the tail stage, waiting if need be */
+takeTailChunk(TAIL_PIPE *);
+
+void /* Hands the tail stage's chunk to the count stage */
+sendTailChunk(TAIL_PIPE *, int);
+
+void /* Adds a retained line to the tail stage's chunk */
+sendTailLine(TAIL_PIPE *, const char *, size_t);
+
+void * /* Thread body: finds the last lines of the input */
+tailStage(void *);
+
+void /* Counts a word of a retained line if it is in the table */
+countTailWord(const char *, int, void *);
+
+void * /* Thread body: counts the table's words in retained lines */
+countStage(void *);
+
+int /* Compares two nodes by count for qsort() */
+compareNodeCount(const void *, const void *);
+
+void /* Counts the table's words in the last lines of a file */
+runTailPipeline(HASH_TAB *, char *, unsigned long);
+
+void /* Prints a churn benchmark row */
+printChurnRound(HASH_TAB *, int, NODE_PTR *, char **, unsigned long, double);
+
+void /* Measures searches as words are deleted and added */
+runChurnBenchmark(HASH_TAB *);
+
+int /* Opens hardware event counters for this thread */
+openPerfCounters(PERF_COUNTERS *);
+
+void /* Starts or stops hardware event counters */
+switchPerfCounters(PERF_COUNTERS *, int);
+
+void /* Reads hardware event counters and zeroes them */
+readPerfCounters(PERF_COUNTERS *);
+
+void /* Closes hardware event counters */
+closePerfCounters(PERF_COUNTERS *);
+
+void /* Sets up a Zipfian generator */
+initZipf(ZIPF_GEN *, unsigned long, double, double);
+
+unsigned long /* Draws a rank from a Zipfian generator */
+nextZipf(ZIPF_GEN *, uint64_t *);
+
+uint64_t /* Stirs the bits of a number, one to one */
+microMix(uint64_t);
+
+void /* Makes the text of a microbenchmark key */
+microKey(uint64_t, char *);
+
+void /* Fills in a row of microbenchmark results */
+microRow(MICRO_RESULT *, const char *, const char *, unsigned long, double, PERF_COUNTERS *);
+
+unsigned long /* Times a buffer of searches */
+microFinds(HASH_TAB *, char *, PERF_COUNTERS *, double *);
+
+void /* Measures the operations of one table */
+microTable(unsigned long, int, ZIPF_GEN *, char *, PERF_COUNTERS *, MICRO_RESULT *);
+
+void /* Writes a row of microbenchmark results */
+printMicroRow(FILE *, int, int, MICRO_RESULT *);
+
+void /* Measures the table's operations over a range of sizes */
+runMicroBenchmark(char *, unsigned long, int);
+
+void /* Folds the ASCII letters of a string to lower case */
+foldCase(char *, const char *, size_t);
+
+int /* Tells whether a string is well-formed UTF-8 */
+validUtf8(const char *, size_t);
+
+void /* Copies a key to search for or add, folded if the table ignores case */
+copyKey(HASH_TAB *, char *, const char *, size_t);
+
+void /* Lets the lexer take identifiers in UTF-8 */
+allowUtf8Identifiers(void);
+
+/* Beginning of main() */
+
+/* Main():
+/* - Picks up options from the command line.
+/* - Prompts user for an input file when no word list was named.
+/* - Reads the data from the input file and stores it a the HASH table.
+/* - Produces a report for each non-empty cell in the HASH table and
+/*   while listing all reserved words that occur in each chain.
+/* - Handles collisions using quadratic probing. When probing fails, 
+/*   chaining results.
+/* - Has a search engine and prompts user to find a reserved word 
+/*   in the HASH table.
+/* - With -lex, tokenizes the remaining arguments as C source files
+/*   instead of reporting and querying.
+/* - With -index, tokenizes every source file under the remaining
+/*   arguments on several threads and reports the identifiers found.
+/* - With -save, writes the table to a snapshot file; with -load, maps
+/*   a snapshot and queries it without building a table at all.
+/* - With -batch, answers every search item in a file (or standard
+/*   input) instead of prompting for one.
+/* - With -cbench, benchmarks the table shared between threads.
+/* - With -stats, writes the table's chain lengths and probe counts to
+/*   a report file when done.
+/* - With -size and -hash, uses a table of another size or another hash
+/*   function; with -sweep, builds tables of many sizes with each hash
+/*   function and recommends one.
+/* - With -bloom, puts a Bloom filter in front of the table so most
+/*   searches for missing words never touch it; -filterbench measures
+/*   how much that saves.
+/* - With -prefix, keeps the words in sorted order as well, so a search
+/*   item ending in '*' lists the words starting with it.
+/* - With -fuzzy, keeps the words in a BK-tree as well, so a search item
+/*   that isn't found gets the nearest words suggested.
+/* - With -scan, reports every place a word of the table occurs in the
+/*   text files that follow (or standard input).
+/* - With -top, lists the most frequent words of the text files that
+/*   follow (or standard input), exactly or within a memory budget.
+/* - With -xref, writes where every identifier of a source tree appears
+/*   to an index file; with -lookup, answers queries from one; with
+/*   -refresh, updates one for the files that changed.
+/* - With -serve, answers lookups on a Unix domain socket until stopped;
+/*   with -loadgen, measures a server's rate and latency.
+/* - With -external, keeps the words on disk in hash order, in working
+/*   files deleted when it ends, for word lists bigger than memory.
+/* - With -readbench, times the line reader shared with tailx against
+/*   getc() and fgets() on the word list.
+/* - With -tail, counts the words of the table in the last lines of a
+/*   text file (or standard input), without tailx or a file between.
+/* - With -churn, measures whether searches slow down as words are
+/*   deleted and added.
+/* - With -microbench, times each operation of the table on generated
+/*   keys over a range of table sizes, writing the results to a file.
+/* - With -fold, the table ignores the case of ASCII letters, and -lex
+/*   and -index take identifiers in UTF-8, checking that they are.
+ */
+int 
+main(int argc, char *argv[])
+{ 
+	HASH_TAB hash_tab;
+	char input_filename[MAXARRAY]; 
+	char *word_filename = NULL;
+	int lex_mode = FALSE;
+	int index_mode = FALSE;
+	int nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	char *save_filename = NULL;
+	char *load_filename = NULL;
+	int verify = FALSE;
+	int batch_mode = FALSE;
+	int cbench_mode = FALSE;
+	char *stats_filename = NULL;
+	int hash_size = HASHSIZE;
+	char *hash_name = NULL;
+	int hash_fn = -1;
+	int sweep_mode = FALSE;
+	unsigned long target = 0;
+	double bloom_fpr = 0.0;
+	int fbench_mode = FALSE;
+	int prefix_index = FALSE;
+	int fuzzy_distance = -1;
+	int scan_mode = FALSE;
+	int top_k = 0;
+	char *estimator_name = NULL;
+	int estimator = TOP_SPACESAVING;
+	size_t budget = TOP_BUDGET;
+	int budget_named = FALSE;
+	double epsilon = 0.0;
+	int size_named = FALSE;
+	char *xref_filename = NULL;
+	char *lookup_filename = NULL;
+	char *refresh_filename = NULL;
+	char *serve_filename = NULL;
+	char *loadgen_filename = NULL;
+	char *external_filename = NULL;
+	int rbench_mode = FALSE;
+	unsigned long tail_lines = 0;
+	int churn_mode = FALSE;
+	char *micro_filename = NULL;
+	int fold_case = FALSE;
+	char *suffix;
+	SNAPSHOT snapshot;
+	double start;
+	int i;
+
+	/** Pick up options from the command line... 
+	 **/
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-lex") == 0)
+			lex_mode = TRUE;
+		else if (strcmp(argv[i], "-index") == 0)
+			index_mode = TRUE;
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			nthreads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-save") == 0 && i + 1 < argc)
+			save_filename = argv[++i];
+		else if (strcmp(argv[i], "-load") == 0 && i + 1 < argc)
+			load_filename = argv[++i];
+		else if (strcmp(argv[i], "-verify") == 0)
+			verify = TRUE;
+		else if (strcmp(argv[i], "-batch") == 0)
+			batch_mode = TRUE;
+		else if (strcmp(argv[i], "-cbench") == 0)
+			cbench_mode = TRUE;
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			word_filename = argv[++i];
+		else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc)
+			stats_filename = argv[++i];
+		else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			hash_size = (strcmp(argv[++i], "auto") == 0) ? 0 : atoi(argv[i]);
+			size_named = TRUE;
+		} else if (strcmp(argv[i], "-hash") == 0 && i + 1 < argc)
+			hash_name = argv[++i];
+		else if (strcmp(argv[i], "-sweep") == 0)
+			sweep_mode = TRUE;
+		else if (strcmp(argv[i], "-bloom") == 0 && i + 1 < argc)
+			bloom_fpr = atof(argv[++i]);
+		else if (strcmp(argv[i], "-filterbench") == 0)
+			fbench_mode = TRUE;
+		else if (strcmp(argv[i], "-prefix") == 0)
+			prefix_index = TRUE;
+		else if (strcmp(argv[i], "-fuzzy") == 0 && i + 1 < argc)
+			fuzzy_distance = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-scan") == 0)
+			scan_mode = TRUE;
+		else if (strcmp(argv[i], "-top") == 0 && i + 1 < argc)
+			top_k = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-estimator") == 0 && i + 1 < argc)
+			estimator_name = argv[++i];
+		else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+			budget = strtoul(argv[++i], &suffix, 10);
+			if (*suffix == 'k' || *suffix == 'K')
+				budget <<= 10;
+			else if (*suffix == 'm' || *suffix == 'M')
+				budget <<= 20;
+			else if (*suffix == 'g' || *suffix == 'G')
+				budget <<= 30;
+			budget_named = TRUE;
+		} else if (strcmp(argv[i], "-epsilon") == 0 && i + 1 < argc)
+			epsilon = atof(argv[++i]);
+		else if (strcmp(argv[i], "-xref") == 0 && i + 1 < argc)
+			xref_filename = argv[++i];
+		else if (strcmp(argv[i], "-lookup") == 0 && i + 1 < argc)
+			lookup_filename = argv[++i];
+		else if (strcmp(argv[i], "-refresh") == 0 && i + 1 < argc)
+			refresh_filename = argv[++i];
+		else if (strcmp(argv[i], "-serve") == 0 && i + 1 < argc)
+			serve_filename = argv[++i];
+		else if (strcmp(argv[i], "-loadgen") == 0 && i + 1 < argc)
+			loadgen_filename = argv[++i];
+		else if (strcmp(argv[i], "-external") == 0 && i + 1 < argc)
+			external_filename = argv[++i];
+		else if (strcmp(argv[i], "-readbench") == 0)
+			rbench_mode = TRUE;
+		else if (strcmp(argv[i], "-tail") == 0 && i + 1 < argc)
+			tail_lines = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-churn") == 0)
+			churn_mode = TRUE;
+		else if (strcmp(argv[i], "-microbench") == 0 && i + 1 < argc)
+			micro_filename = argv[++i];
+		else if (strcmp(argv[i], "-fold") == 0)
+			fold_case = TRUE;
+		else if (strcmp(argv[i], "-target") == 0 && i + 1 < argc)
+			target = strtoul(argv[++i], NULL, 10);
+		else {
+			printUsage(argv[0]);
+			exit(0);
+		}
+	}
+
+	if (estimator_name != NULL)
+		for (estimator = 0; estimator < TOP_ESTIMATORS; estimator++)
+			if (strcmp(estimator_name, estimator_names[estimator]) == 0)
+				break;
+
+	if ((i < argc && strcmp(argv[i], "?") == 0) ||
+		hash_size < 0 || hash_size > MAXHASHSIZE || bloom_fpr < 0.0 || bloom_fpr >= 1.0 ||
+		(hash_name != NULL && (hash_fn = hashFunctionNumber(hash_name)) < 0) ||
+		top_k < 0 || estimator == TOP_ESTIMATORS || epsilon < 0.0 || epsilon >= 1.0 ||
+		(external_filename != NULL && (lex_mode || index_mode || save_filename != NULL ||
+		 cbench_mode || sweep_mode || fbench_mode || scan_mode || prefix_index ||
+		 fuzzy_distance >= 0 || bloom_fpr > 0.0 || tail_lines > 0 || churn_mode)) ||
+		(churn_mode && (prefix_index || fuzzy_distance >= 0)) ||
+		(fold_case && (save_filename != NULL || load_filename != NULL ||
+		 external_filename != NULL)) ||
+		(micro_filename != NULL && i < argc &&
+		 (strtoul(argv[i], NULL, 10) < HASHSIZE ||
+		  strtoul(argv[i], NULL, 10) > MAXHASHSIZE / 2))) {
+		printUsage(argv[0]);
+		exit(0);
+	}
+
+	/** Query a saved snapshot in place of building the table, if asked... 
+	 **/
+	if (load_filename != NULL) {
+		start = elapsedSeconds();
+		if (!openHashSnapshot(load_filename, &snapshot, verify))
+			exit(-1);
+		fprintf((batch_mode || serve_filename != NULL) ? stderr : stdout,
+				"Mapped %lu words from %s in %.3f ms\n\n",
+				(unsigned long) snapshot.header->nwords, load_filename,
+				(elapsedSeconds() - start) * 1e3);
+
+		if (serve_filename != NULL)
+			runServer(NULL, &snapshot, serve_filename);
+		else if (batch_mode)
+			runBatchQueries(NULL, &snapshot, (i < argc) ? argv[i] : NULL);
+		else
+			querySnapshot(&snapshot);
+		closeHashSnapshot(&snapshot);
+		return 0;
+	}
+
+	/** Build or query a cross-reference index instead, if asked...
+	 **/
+	if (xref_filename != NULL) {
+		buildXref(xref_filename, argc - i, argv + i);
+		return 0;
+	}
+	if (refresh_filename != NULL) {
+		refreshXref(refresh_filename, argc - i, argv + i);
+		return 0;
+	}
+	if (lookup_filename != NULL) {
+		runXrefQueries(lookup_filename, argc - i, argv + i, verify);
+		return 0;
+	}
+
+	/** Ask for the word list unless it was named or a default will do... 
+	 **/
+	if (word_filename == NULL && !lex_mode && !index_mode && !batch_mode &&
+		!cbench_mode && !sweep_mode && !fbench_mode && !scan_mode && top_k == 0 &&
+		save_filename == NULL && serve_filename == NULL && loadgen_filename == NULL &&
+		!rbench_mode && tail_lines == 0 && !churn_mode && micro_filename == NULL) {
+		getInputFile(input_filename); 
+		word_filename = input_filename;
+	} else if (word_filename == NULL)
+		word_filename = DEFAULT_WORDFILE;
+
+	/** Time the ways of reading the word list instead, if asked...
+	 **/
+	if (rbench_mode) {
+		runReadBenchmark(word_filename);
+		return 0;
+	}
+
+	/** Try out table sizes and hash functions instead, if asked... 
+	 **/
+	if (sweep_mode) {
+		runSizeSweep(word_filename, (i < argc) ? atoi(argv[i]) : 0,
+					 (i + 1 < argc) ? atoi(argv[i + 1]) : 0,
+					 (i + 2 < argc) ? atoi(argv[i + 2]) : 1,
+					 hash_fn, target, nthreads < 1 ? 1 : nthreads);
+		return 0;
+	}
+
+	/** Drive a lookup server instead, if asked...
+	 **/
+	if (loadgen_filename != NULL) {
+		runLoadGenerator(loadgen_filename, word_filename,
+						 (i < argc) ? atoi(argv[i]) : LOADGEN_CONNECTIONS,
+						 (i + 1 < argc) ? atoi(argv[i + 1]) : LOADGEN_DEPTH,
+						 (i + 2 < argc) ? atoi(argv[i + 2]) : LOADGEN_SECONDS);
+		return 0;
+	}
+
+	/** Measure the table on generated keys instead, if asked...
+	 **/
+	if (micro_filename != NULL) {
+		runMicroBenchmark(micro_filename,
+						  (i < argc) ? strtoul(argv[i], NULL, 10) : MICRO_MAXKEYS,
+						  hash_fn < 0 ? HASH_FNV1A : hash_fn);
+		return 0;
+	}
+
+	/** Count the words of a text instead, if asked...
+	 **/
+	if (top_k > 0) {
+		runTopTokens(argc - i, argv + i, top_k, estimator, budget, epsilon,
+					 size_named ? hash_size : 0, hash_fn < 0 ? HASH_FNV1A : hash_fn);
+		return 0;
+	}
+
+	/** Process the input file and make the hash table, with its
+	 ** buckets initialized to NULL first, or keep its words on disk
+	 ** if asked... 
+	 **/
+	if (external_filename != NULL)
+		loadExternalTable(word_filename, &hash_tab, external_filename,
+						  budget_named ? budget : EXTERNAL_BUDGET,
+						  (batch_mode || serve_filename != NULL) ? stderr : stdout);
+	else
+		processInputFile(word_filename, &hash_tab, hash_size,
+						 hash_fn < 0 ? HASH_ORIGINAL : hash_fn, fold_case); 
+
+	/** Put a filter in front of the table, if asked... 
+	 **/
+	if (bloom_fpr > 0.0)
+		buildHashFilter(&hash_tab, bloom_fpr);
+
+	/** Index the words in order for prefix searches, if asked... 
+	 **/
+	if (prefix_index)
+		buildPrefixIndex(&hash_tab);
+
+	/** Index the words by edit distance for suggestions, if asked... 
+	 **/
+	if (fuzzy_distance >= 0)
+		buildFuzzyIndex(&hash_tab, fuzzy_distance);
+
+	/** Save the table for later runs to map, if asked... 
+	 **/
+	if (save_filename != NULL) {
+		saveHashSnapshot(&hash_tab, save_filename);
+		return 0;
+	}
+
+	/** Tokenize source files against the table instead, if asked... 
+	 **/
+	if (lex_mode) {
+		lexSourceFiles(argc - i, argv + i, &hash_tab);
+		if (stats_filename != NULL)
+			printHashStats(&hash_tab, stats_filename);
+		return 0;
+	}
+
+	if (index_mode) {
+		indexSourceTree(argc - i, argv + i, &hash_tab, nthreads < 1 ? 1 : nthreads,
+						stats_filename);
+		return 0;
+	}
+
+	if (serve_filename != NULL) {
+		runServer(&hash_tab, NULL, serve_filename);
+		if (stats_filename != NULL)
+			printHashStats(&hash_tab, stats_filename);
+		return 0;
+	}
+
+	if (batch_mode) {
+		runBatchQueries(&hash_tab, NULL, (i < argc) ? argv[i] : NULL);
+		if (stats_filename != NULL)
+			printHashStats(&hash_tab, stats_filename);
+		return 0;
+	}
+
+	if (cbench_mode) {
+		runConcBenchmark(&hash_tab, nthreads < 1 ? 1 : nthreads);
+		return 0;
+	}
+
+	if (fbench_mode) {
+		runFilterBenchmark(&hash_tab);
+		return 0;
+	}
+
+	if (scan_mode) {
+		runScan(&hash_tab, argc - i, argv + i);
+		return 0;
+	}
+
+	if (tail_lines > 0) {
+		runTailPipeline(&hash_tab, (i < argc) ? argv[i] : NULL, tail_lines);
+		return 0;
+	}
+
+	if (churn_mode) {
+		runChurnBenchmark(&hash_tab);
+		return 0;
+	}
+	
+	printf("\n\n");
+
+	/** Access buckets and visit chained nodes and print contents... 
+	 **/
+	if (hash_tab.disk == NULL)
+		printHashEntries(&hash_tab);
+
+	/** Find a reserved word as specified by the user... 
+	 **/
+	queryHashTable(&hash_tab);
+
+	if (stats_filename != NULL)
+		printHashStats(&hash_tab, stats_filename);
+
+	return 0;
+} /* End main. */
+
+/* This function finds a 'hash entry' (a node that was stored by way of
+/* the hashing algorithms of this program) and returns 1, or returns an 
+/* indication that the entry does not exist in the table (0).
+/*
+/* The following cases return 1:
+/* - The item is found where expected (first hashing of the key renders
+/*   the index).
+/* - The item found in the list pointed to by the index.  In other words,
+/*   due to a collision, it was chained.
+/* - The item was found in a rehashed index by stepping through the 
+/*   probing algorithm.
+/* 
+/* The following case retuns 0:
+/* The function is not found in the expected location, and it is not
+/* found in the chained list of the expected location, and it is not
 /* found elsewhere when stepping through each of the possible other
-/* indices using the probing algorithmn.
+/* indices using the probing algorithmn.  An empty expected location
+/* returns 0 straight away, since addHashEntry() always fills the
+/* expected location first.
+/*
+/* This function calls hashKey(), sequentialSearch(), findRehashKey ().
+*/
+int 
+findHashEntry(HASH_TAB *hash_tab, char *key)
+{ 
+	int i = 0;
+	unsigned int probes = 1;	/* Buckets looked in */
+	NODE_PTR target_node_ptr;
+	
+	/** The filter, if there is one, turns away most missing items
+	 ** before any bucket is looked in...
+	 **/
+	if (hash_tab->bloom != NULL && !bloomMayContain(hash_tab->bloom, key)) {
+		if (hash_tab->stats.enabled)
+			hash_tab->stats.filtered++;
+		return recordHashFind(hash_tab, 0, 0);
+	}
+
+	/** An external table reads the one page the item could be in...
+	 **/
+	if (hash_tab->disk != NULL)
+		return recordHashFind(hash_tab, findDiskEntry(hash_tab->disk, key), 1);
+
+	/**  Get converted or "hashed" key from hash function...
+	 **/
+	i = hashKey(key, hash_tab->hash_fn, hash_tab->size);
+
+	/**  Use hashed key as array index to get list pointer...
+	 **/
+	target_node_ptr = hash_tab->bucket[i]; 
+
+	/** An empty bucket means nothing hashing here was ever added...
+     **/
+	if (target_node_ptr == NULL)
+		return recordHashFind(hash_tab, 0, probes);	/* Return Empty bucket indicator... */
+
+	/** Check if item matches the item in current bucket...  
+	 **/
+	if ( strcmp(target_node_ptr->line_text, key) == 0) 
+		return recordHashFind(hash_tab, 1, probes);  /* Return match indicator...*/
+		
+	/** Check to see if item was placed on list due to overflow
+	 ** condition...  
+	 **/
+	if ( sequentialSearch(target_node_ptr, key) == 1)
+		return recordHashFind(hash_tab, 1, probes);	/* Return match indicator...*/
+
+	/** Check to see if item was placed in rehashed bucket
+	 ** because its own bucket was already taken...
+	 **/
+	if ( findRehashKey (i, hash_tab, key, &probes) == 1)
+		return recordHashFind(hash_tab, 1, probes);
+
+	return recordHashFind(hash_tab, 0, probes);	/* Return new item indicator... */
+
+} /* End findHashEntry. */
+
+/* The purpose of this function is to search a list for a target item.
+/* It searches the list until the end of the list is indicated by NULL.
+/* 
+/* It expects the calling function will pass it a pointer to the head 
+/* of the list and search item.
+/* 
+/* If successful, this function returns 1.
+/* 
+/* If the item is not found, this function returns 0.
+/*
+/* It has no side effects.
+*/
+int 
+sequentialSearch(NODE_PTR current_ptr, char *search_item)
+{
+	while (current_ptr != NULL) {
+	
+		if ( strcmp(current_ptr->line_text, search_item) == 0)
+		return 1;
+		
+		current_ptr = current_ptr->next_ptr;
+	}
+	return 0;
+}
+
+/* This function hashes a character to string to an integer hash table
+/* index.
+/* It expects the caller pass it an ascii string, the hash function to
+/* use, and the number of buckets in the table.
+/* HASH_ORIGINAL adds the ascii integer equivalents to the last char in
+/* the string and adds it to the factor of the number of letters in the
+/* string + 8 and the last character's ascii equivalent.  The others are
+/* the well-known djb2, sdbm and FNV-1a string hashes, which use every
+/* character.
+/* 
+/* It passes this key hashed as an index to the caller.
+*/
+int 
+hashKey(char *key, int hash_fn, int size)
+{ 
+	int i;
+	int value = 0;
+	uint32_t h;
+	char *hold_key = key;  
+	
+	switch (hash_fn) {
+	case HASH_DJB2:
+		for (h = 5381; *key != '\0'; key++)
+			h = h * 33 + (unsigned char) *key;
+		return h % size;
+
+	case HASH_SDBM:
+		for (h = 0; *key != '\0'; key++)
+			h = (unsigned char) *key + (h << 6) + (h << 16) - h;
+		return h % size;
+
+	case HASH_FNV1A:
+		for (h = 2166136261u; *key != '\0'; key++)
+			h = (h ^ (unsigned char) *key) * 16777619u;
+		return h % size;
+	}
+
+	i = strlen(key);
+
+	if (i > 0) {
+		value =  (key[i-1]) + key[0] * (i + 8) ;   /* A little this and that. */
+	}
+
+	return abs(value % size);  /* To bound values within the array. */
+} /* End hash. */
+
+/* This function recalculate the key quadratically.
+/* It expects the calling funciton will pass the hashed key (of type int)
+/* calculated on the first unsuccessful attempt to find an empty bucket. 
+/* 
+/* The function returns a new key so that the caller can use the key to
+/* make a step through the hash table quadratically.
+/*
+/* This function expects to be passed the number of buckets in the hash
+/* table as well.  The square is taken in long long, since it overflows
+/* an int on tables past 46341 buckets.
+*/
+int hashKeyQuad(int i, int size)
+{
+	i = (int) ((i + ((long long) i * i)) % size);  /* Rehash based on original key */
+	
+	return i;
+}
+
+/* This function looks up a hash function by the name -hash knows it by.
+/* It returns the function's number, or -1 if there is no such function.
+*/
+int
+hashFunctionNumber(char *name)
+{
+	int i;
+
+	for (i = 0; i < HASH_FUNCTIONS; i++)
+		if (strcmp(name, hash_names[i]) == 0)
+			return i;
+	return -1;
+}
+
+/* This function allocates the buckets of the hashtable, initializes
+/* them to NULL, and gives the table an empty arena for its nodes.
+/* It expects the calling function will pass the address of the table,
+/* the number of buckets, and the hash function to use.
+/* 
+/* Nothing is returned.  If memory runs out, it prints an appropriate
+/* message and exits from the program.
+*/
+void 
+initHashTable(HASH_TAB *hash_tab, int size, int hash_fn)
+{ 
+	int i;
+ 
+	if ((hash_tab->bucket = (NODE_PTR *) malloc(size * sizeof(NODE_PTR))) == NULL) {
+		printf("Error: Unable to allocate bucket storage\n");
+		exit(-1);
+	}
+	hash_tab->size = size;
+	hash_tab->hash_fn = hash_fn;
+
+	for(i = 0; i <= size - 1; i++)     
+		hash_tab->bucket[i] = NULL;
+
+	hash_tab->arena.head  = NULL;
+	hash_tab->arena.bytes = 0;
+	hash_tab->bloom = NULL;
+	hash_tab->prefix = NULL;
+	hash_tab->fuzzy = NULL;
+	hash_tab->disk = NULL;
+	hash_tab->fold_case = FALSE;
+
+	memset(&hash_tab->stats, 0, sizeof(hash_tab->stats));
+	hash_tab->stats.enabled = TRUE;
+
+} /* End initHashTable. */
+
+/* This function releases every node in the table, and the text stored
+/* in each, in one go, along with the buckets.
+/* It expects the address of a table set up by initHashTable(), and
+/* leaves it to be set up again before any further use.
+*/
+void
+freeHashTable(HASH_TAB *hash_tab)
+{
+	arenaFree(&hash_tab->arena);
+	free(hash_tab->bucket);
+	hash_tab->bucket = NULL;
+	hash_tab->size = 0;
+
+	if (hash_tab->bloom != NULL) {
+		freeBloomFilter(hash_tab->bloom);
+		free(hash_tab->bloom);
+		hash_tab->bloom = NULL;
+	}
+
+	if (hash_tab->prefix != NULL) {
+		freePrefixIndex(hash_tab->prefix);
+		free(hash_tab->prefix);
+		hash_tab->prefix = NULL;
+	}
+
+	if (hash_tab->fuzzy != NULL) {
+		arenaFree(&hash_tab->fuzzy->arena);
+		free(hash_tab->fuzzy);
+		hash_tab->fuzzy = NULL;
+	}
+
+	if (hash_tab->disk != NULL) {
+		freeDiskTable(hash_tab->disk);
+		free(hash_tab->disk);
+		hash_tab->disk = NULL;
+	}
+}
+
+/* Read the reserved words from the input file ( one word per line), make a node
+for the linked list, add the node to the linked list if the word has not been
+previously entered.
+
+The file is mapped and its lines counted first.  That sizes the table when
+hash_size is 0 (auto), and sets aside a single arena block big enough for every
+node and its text, so building the table takes no allocation per word.  The
+lines are then taken from nextLine(), so they may be of any length; a <CR>
+before the <NL> and a missing final <NL> are both fine.  With fold_case the
+words are folded as they are copied into their nodes, and any that isn't
+UTF-8 is reported and left out.  */
+
+void 
+processInputFile(char *input_filename, HASH_TAB *hash_tab, int hash_size, int hash_fn,
+				 int fold_case)
+{
+	INPUT_MAP input;
+	const char *line;
+	size_t len;
+	unsigned long nlines;
+	NODE_PTR node_ptr, batch[BATCH_SIZE];
+	int count, n;
+ 
+	/** Open input file. Test for good file name. 
+	 **/
+	if (!openInputMap(input_filename, &input)) {
+		printf("Can't find input file: %s\n",input_filename);
+		exit(-1);    /* Stop processing. */ 
+	}
+	/** Count the lines, at most one word each, and size the table
+	 ** and the arena to fit... 
+	 **/
+	nlines = countLines(input.base, input.base + input.size) + 1;
+
+	if (hash_size == 0)
+		hash_size = nextPrime(nlines <= MAXHASHSIZE / 2 ? 2 * nlines : MAXHASHSIZE);
+	initHashTable(hash_tab, hash_size, hash_fn);
+	hash_tab->fold_case = fold_case;
+
+	if (!arenaReserve(&hash_tab->arena, input.size +
+					  nlines * (sizeof(NODE_ENTRY) + ARENA_ALIGN))) {
+		printf("Error: Unable to allocate linked node storage\n");
+		exit(-1);
+	}
+ 
+	/** Take the lines BATCH_SIZE at a time, so the buckets of a whole
+	 ** batch can be fetched from memory together... 
+	 **/
+	do {
+		for (count = 0; count < BATCH_SIZE && nextLine(&input, &line, &len); ) {
+
+			/** Blank lines hold no word...
+			 **/
+			if (len == 0)
+				continue;
+
+			if (fold_case && !validUtf8(line, len)) {
+				printf("\"%.*s\" is not UTF-8 and was left out\n", (int) len, line);
+				continue;
+			}
+
+			/** Copy the word straight into a node, so it is null
+			 ** terminated for searching.  A duplicate's node is just
+			 ** left unused...
+			 **/
+			if ((node_ptr = node_alloc(&hash_tab->arena, len)) == NULL) {
+				printf("Error: Unable to allocate linked node storage\n");
+				exit(-1);
+			}
+			node_ptr->next_ptr = NULL;
+			copyKey(hash_tab, node_ptr->line_text, line, len);
+			batch[count++] = node_ptr;
+		}
+
+		for (n = 0; n < count; n++)
+			__builtin_prefetch(&hash_tab->bucket[hashKey(batch[n]->line_text,
+														 hash_fn, hash_size)]);
+
+		/** If a node with the same key either does NOT already exist
+		 ** --or does not match, drop the new node in...
+		 **/
+		for (n = 0; n < count; n++)
+			if (!findHashEntry(hash_tab, batch[n]->line_text))
+				addHashEntry(hash_tab, batch[n]); 
+			else
+				printf("\"%s\" has already been entered into the hash table\n",
+			batch[n]->line_text); 
+	} while (count == BATCH_SIZE);
+
+	closeInputMap(&input);
+} /* End  processInputFile. */
+
+/* Add an entry to the hash table, if an entry already exists at that cell,
+   then insert the new node first in the list since all reserved words in
+   the input file are unique. */
+
+/* This function adds an entry into the chained hash table.
+/* 
+/* It EXPECTS the caller to pass to it:
+/*  - An array of pointers, or that is to say, a "hash table."
+/*  - A pointer to a new node containing arbitrary data.
+/* 
+/* The purpose of this function is to get an appropriate key and
+/* insert the node into a any one of the lists pointed too by the
+/* hash table.  
+*/
+void 
+addHashEntry(HASH_TAB *hash_tab, NODE_PTR new_node_ptr)
+{
+	int h = 0; /* */
+	int r; /* Rehashed key */
+	unsigned int probes = 0; /* Buckets rehashKey() stepped to */
+	char *key;
+	
+	NODE_PTR target_node_ptr;
+
+	key = new_node_ptr->line_text;
+
+	/** An external table keeps just the text, in a partition file...
+	 **/
+	if (hash_tab->disk != NULL) {
+		addDiskEntry(hash_tab->disk, key);
+		return;
+	}
+
+	if (hash_tab->bloom != NULL)
+		bloomAdd(hash_tab->bloom, key);
+	if (hash_tab->prefix != NULL)
+		addPrefixEntry(hash_tab->prefix, new_node_ptr);
+	if (hash_tab->fuzzy != NULL)
+		addFuzzyEntry(hash_tab->fuzzy, new_node_ptr);
+	
+	/**  Get converted or "hashed" key from hash function...
+	 **/
+	h = hashKey(key, hash_tab->hash_fn, hash_tab->size);
+
+	/**  Use hashed key as array index to get intended list pointer...
+	 **/
+	target_node_ptr = hash_tab->bucket[h]; 
+
+	/** Bucket EMPTY...
+	 ** Assign the address of new node...
+     **/
+	if (target_node_ptr == NULL) {
+		hash_tab->bucket[h] = new_node_ptr;
+		hash_tab->stats.home_adds++;
+	}
+	
+	/** Bucket NOT empty...
+	 ** Rehash key...
+     **/
+	if (target_node_ptr != NULL) {
+		r = rehashKey(h, hash_tab, &probes);
+		
+		/** If rehashKey indicates assumed overflow conditions exist
+		 ** --add node to list using original key...
+		 **/
+		if (r == -1) {	
+			target_node_ptr = hash_tab->bucket[h];
+			new_node_ptr->next_ptr = target_node_ptr;
+			hash_tab->bucket[h] = new_node_ptr;
+			hash_tab->stats.chained_adds++;
+		
+		/** If rehashKey returns a key, an empty bucket was found...
+		 ** Add node to the table using rehashed key...
+		 **/
+		} else {
+			hash_tab->bucket[r] = new_node_ptr;
+			hash_tab->stats.probed_adds++;
+		}
+
+		hash_tab->stats.add_probes += probes;
+		if (probes > hash_tab->stats.max_add_probes)
+			hash_tab->stats.max_add_probes = probes;
+	}
+
+} /* End addHashEntry. */
+
+/* The purpose of this function to perform a quadratic search for an
+/* empty bucket until either the empty bucket is found or an overflow
+/* indication is detected.
+/*
+/* If an overflow indication is detected, this function will return 
+/* -1 back to the caller to indicate that the search for an empty
+/* bucket failed.
+/* 
+/* If the function finds an empty bucket, the key for that bucket is 
+/* return to the caller.
+/*  
+/* This function expects to be passed:
+/* - A empty, full, or partially full hash table.
+/* - Any key for that hash table.
+/* - The address of a count it adds the number of steps taken to.
+*/
+int 
+rehashKey(int h, HASH_TAB *hash_tab, unsigned int *probes)
+{
+	NODE_PTR target_node_ptr;
+
+	int assume_over_flow = 0;
+
+	target_node_ptr = hash_tab->bucket[h];
+
+	while (target_node_ptr != NULL) {
+		if ( assume_over_flow == PROBE_LIMIT(hash_tab->size)) {
+			/** Indicate to caller probing failed to find empty bucket... 
+			 **/
+			return -1; 
+		}
+		
+		h = hashKeyQuad(h, hash_tab->size); /* Rehash based on original key */
+		assume_over_flow++;
+		(*probes)++;
+		target_node_ptr = hash_tab->bucket[h]; /* Get pointer at new key position */
+			
+	}
+	/** Return successful rehash to caller... 
+	 **/
+	return h;
+}
+
+/* The purpose of this function is to use quadratic probing to backtrack 
+/* over the buckets to find a key not in the expected (hashed) position.
+/*
+/* It steps through the same buckets, in the same order, as rehashKey()
+/* did when the item was added.  Since rehashKey() takes the first empty
+/* bucket it meets, reaching an empty bucket ends the search;
+/* deleteHashEntry() keeps that so by never leaving a hole behind.
+/* Items chained onto a bucket are searched along with its first item.
+/* Every bucket looked in is added to the count at probes.
+*/
+int 
+findRehashKey(int h, HASH_TAB *hash_tab, char *search_item, unsigned int *probes)
+{
+	NODE_PTR target_node_ptr;
+
+	int assume_all_buckets_searched = 0;
+
+	while ( assume_all_buckets_searched != PROBE_LIMIT(hash_tab->size)) {
+		h = hashKeyQuad(h, hash_tab->size);	/* Rehash based on original key */
+		assume_all_buckets_searched++;
+		(*probes)++;
+		target_node_ptr = hash_tab->bucket[h]; /* Get pointer at new key position */
+
+		if (target_node_ptr == NULL) {
+			/** Indicate to caller probing found no match... 
+			 **/
+			return 0; 
+		}
+
+		if (sequentialSearch(target_node_ptr, search_item) == 1) {
+			return 1; 
+		}	
+	}
+	/** Search unsuccessful.  Indicate 'item not found' to caller... 
+	 **/
+	return 0;
+}
+
+/* This function takes an item out of the table and returns its node,
+/* or NULL if the item isn't in the table.  The node is only unlinked;
+/* its storage belongs to the table's arena as before, so the caller may
+/* put it back or use it again.
+/*
+/* It looks in the same buckets, in the same order, as findHashEntry().
+/* An item in a chain, or in a bucket that still holds others, is just
+/* unlinked.  An item that leaves its bucket empty would cut short the
+/* search for any item that was probed past that bucket, so
+/* shiftHashHole() moves such items back into it, leaving no marker
+/* behind to slow probes down.
+/* The word stays in a Bloom filter, which only costs a false positive,
+/* and in a fuzzy index, whose searches skip words no longer in the
+/* table; it is taken out of a prefix index.
+*/
+NODE_PTR
+deleteHashEntry(HASH_TAB *hash_tab, char *key)
+{
+	NODE_PTR node_ptr, *link;
+	int h, i;
+
+	if (hash_tab->disk != NULL)
+		return NULL;
+
+	h = hashKey(key, hash_tab->hash_fn, hash_tab->size);
+	for (i = 0; ; i++) {
+		if (hash_tab->bucket[h] == NULL)
+			return NULL;
+		for (link = &hash_tab->bucket[h]; *link != NULL; link = &(*link)->next_ptr)
+			if (strcmp((*link)->line_text, key) == 0)
+				break;
+		if (*link != NULL)
+			break;
+		if (i == PROBE_LIMIT(hash_tab->size))
+			return NULL;
+		h = hashKeyQuad(h, hash_tab->size);
+	}
+
+	node_ptr = *link;
+	*link = node_ptr->next_ptr;
+	node_ptr->next_ptr = NULL;
+	hash_tab->stats.deletes++;
+
+	if (hash_tab->prefix != NULL)
+		removePrefixEntry(hash_tab->prefix, node_ptr);
+
+	if (hash_tab->bucket[h] == NULL)
+		shiftHashHole(hash_tab, h);
+
+	return node_ptr;
+} /* End deleteHashEntry. */
+
+/* This function tells whether an item whose expected bucket is home,
+/* and which sits in bucket at, was probed through bucket hole on the
+/* way there: whether hole comes before at on the path rehashKey()
+/* steps along from home.
+*/
+int
+probePathCrosses(HASH_TAB *hash_tab, int home, int hole, int at)
+{
+	int i;
+
+	for (i = 0; i <= PROBE_LIMIT(hash_tab->size); i++) {
+		if (home == at)
+			return 0;
+		if (home == hole)
+			return 1;
+		home = hashKeyQuad(home, hash_tab->size);
+	}
+	return 0;
+}
+
+/* This function fills a bucket deleteHashEntry() emptied.  A search
+/* stops at the first empty bucket on its path, so every item that was
+/* probed through the hole to a bucket further along must be found
+/* another way.  Each bucket's path onward is the same whatever item is
+/* probing, so any such item sits within PROBE_LIMIT steps of the hole,
+/* before the next empty bucket.  Only the oldest item in a bucket, the
+/* last in its chain, can have been probed there; the rest were chained
+/* onto their expected bucket.
+/*
+/* The first item found that was probed through the hole is moved back
+/* into it, which leaves it fewer buckets from its expected one.  If
+/* that empties its old bucket, the same is done for that bucket, and
+/* so on until a move leaves a bucket occupied or no item needs moving.
+*/
+void
+shiftHashHole(HASH_TAB *hash_tab, int hole)
+{
+	NODE_PTR node_ptr, *link;
+	int at, home, i;
+
+	for (;;) {
+		at = hole;
+		for (i = 0; i < PROBE_LIMIT(hash_tab->size); i++) {
+			at = hashKeyQuad(at, hash_tab->size);
+			if (hash_tab->bucket[at] == NULL)
+				return;
+
+			for (link = &hash_tab->bucket[at]; (*link)->next_ptr != NULL;
+				 link = &(*link)->next_ptr)
+				;
+			home = hashKey((*link)->line_text, hash_tab->hash_fn, hash_tab->size);
+			if (probePathCrosses(hash_tab, home, hole, at))
+				break;
+		}
+		if (i == PROBE_LIMIT(hash_tab->size))
+			return;
+
+		node_ptr = *link;
+		*link = NULL;
+		hash_tab->bucket[hole] = node_ptr;
+		hash_tab->stats.moved_back++;
+
+		if (hash_tab->bucket[at] != NULL)
+			return;
+		hole = at;
+	}
+} /* End shiftHashHole. */
+
+
+/* Makes a new node for the linked list and pass the pointer
+   back to caller.  If an error occurs during space allocation
+   print an appropriate message and exit from the program.
+
+   It expects the caller pass it a character array that it
+   can store in the newly allocated node.
+
+   If the char array is real data and there is enough memory for
+   the node, it initializes the next ptr to NULL and returns
+   a pointer to the node to the caller.
+
+   This function has no side effects.
+*/
+
+NODE_PTR 
+makenode(ARENA *arena, char *w)
+{
+	
+	NODE_PTR ptr = NULL; 
+	int len = strlen(w);
+	
+	/** Get pointer to node and initialize terminal node...
+	 **/
+	if  ((ptr = node_alloc(arena, len)) != NULL) { /* If memory exists. */
+        ptr->next_ptr = NULL;            /* Initialize next to NULL. */
+		
+		/** Copy item into the text space that follows the node...
+		 **/
+		memcpy(ptr->line_text, w, len + 1);
+	}  else {
+        printf("Error: Unable to allocate linked node storage\n");
+        exit(-1);  
+	}  
+	return ptr;  /* Which can't be NULL! */
+} /* End makenode. */
+
+/* Allocate memory for the node and len characters of text (plus the
+   null terminator) right behind it, from the arena.  Point the node at
+   its text, return NULL if the arena can't grow. */
+NODE_PTR 
+node_alloc(ARENA *arena, int len)
+{
+	NODE_PTR ptr;
+
+	if ((ptr = (NODE_PTR) arenaAlloc(arena, sizeof(NODE_ENTRY) + len + 1)) != NULL) {
+		ptr->line_text = (char *) (ptr + 1);
+		ptr->count = 1;
+	}
+
+	return ptr;
+}
+
+/* Copy the string w to a safe place in memory, return the location
+   pointer to caller.*/
+char *
+stringDup(char *w)
+{  
+	char *p;
+
+	p = (char *)malloc(strlen(w) + 1); /* 1 added for null terminator. */
+  
+	if (p != NULL)      
+		strcpy(p, w);  
+	return p;
+}
+
+/* Carve size bytes out of the arena, rounded up to ARENA_ALIGN.  When
+   the current block is full a new one is malloc'd; a request too big
+   for a normal block gets a block of its own, filed behind the current
+   one so the current one keeps filling.  Return NULL if malloc fails. */
+void *
+arenaAlloc(ARENA *arena, size_t size)
+{
+	ARENA_BLOCK *block = arena->head;
+	size_t block_size = ARENA_BLOCKSIZE - sizeof(ARENA_BLOCK);
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (block == NULL || block->size - block->used < size) {
+		if (size > block_size)
+			block_size = size;
+
+		if ((block = (ARENA_BLOCK *) malloc(sizeof(ARENA_BLOCK) + block_size)) == NULL)
+			return NULL;
+		block->used = 0;
+		block->size = block_size;
+
+		if (arena->head != NULL && size > ARENA_BLOCKSIZE / 2) {
+			block->next = arena->head->next;	/* Keep filling the current one */
+			arena->head->next = block;
+		} else {
+			block->next = arena->head;
+			arena->head = block;
+		}
+	}
+
+	p = (char *) (block + 1) + block->used;
+	block->used += size;
+	arena->bytes += size;
+
+	return p;
+}
+
+/* Make sure the next size bytes carved out of the arena, in whatever
+   pieces, come out of one block, so that storing an amount of data known
+   ahead of time takes a single malloc.  Return 0 if malloc fails. */
+int
+arenaReserve(ARENA *arena, size_t size)
+{
+	ARENA_BLOCK *block = arena->head;
+
+	if (block != NULL && block->size - block->used >= size)
+		return 1;
+
+	if ((block = (ARENA_BLOCK *) malloc(sizeof(ARENA_BLOCK) + size)) == NULL)
+		return 0;
+	block->used = 0;
+	block->size = size;
+	block->next = arena->head;
+	arena->head = block;
+
+	return 1;
+}
+
+/* Hand every block of the from arena over to the to arena, leaving the
+   from arena empty.  Whatever was carved out of either stays put. */
+void
+arenaAdopt(ARENA *to, ARENA *from)
+{
+	ARENA_BLOCK *tail;
+
+	if (from->head == NULL)
+		return;
+
+	if (to->head == NULL)
+		to->head = from->head;
+	else {
+		for (tail = to->head; tail->next != NULL; tail = tail->next)
+			;
+		tail->next = from->head;
+	}
+
+	to->bytes += from->bytes;
+	from->head = NULL;
+	from->bytes = 0;
+}
+
+/* Free every block of the arena in one pass and leave it empty.  Any
+   pointer carved out of the arena is invalid afterwards. */
+void
+arenaFree(ARENA *arena)
+{
+	ARENA_BLOCK *block, *next;
+
+	for (block = arena->head; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+
+	arena->head = NULL;
+	arena->bytes = 0;
+}
+
+/* This function prompts user for an input file 
+/* It expects a character array.
+/* It returns nothing. 
+*/
+void 
+getInputFile(char *input_filename)
+{
+ 
+	printf("Please type the name of the file you want hashed!\n");
+	scanf("%s", input_filename);
+
+} /* End getInputFile. */
+
+  
+/* Step through the hash table and display any cell's linked list 
+/* entries when the cell contains a nonNULL value. 
+/* 
+/* It expects the caller pass it the address of an array of pointers 
+/* to structures, i.e., a hash table.
+/* 
+/* It returns nothing.
+/* 
+/* It has no side effects.
+*/
+
+void 
+printHashEntries(HASH_TAB *hash_tab)
+{ 
+
+	FILE *output_fptr;
+	int i = 0;
+	int first_while_string_count = 0;
+	NODE_PTR head_ptr;
+	
+	/** Open output file...
+	 **/
+	if ((output_fptr = fopen("output.txt", "w")) == NULL) {
+		printf("Can't open output file\n"); 
+		exit(1);
+	}
+
+	fprintf(output_fptr, "Table Index\tStored word(s)\n");
+	fprintf(output_fptr, "===========\t==============\n");
+
+	for (i = 0; i <= (hash_tab->size - 1); i++) {
+		
+		head_ptr = hash_tab->bucket[i];
+
+		if ( head_ptr != NULL)
+			fprintf(output_fptr, "\nAt address [%d]: ", i);
+
+		while ( head_ptr != NULL) {	
+			fprintf(output_fptr, "%s ", head_ptr->line_text);
+			first_while_string_count++;
+			head_ptr = head_ptr->next_ptr;
+		}
+	
+	} /* End For */
+	
+	/* print trailer infomation */
+
+	fprintf(output_fptr, "\n<p>Total words \t= %10d\nHASHSIZE\t= %10d", 
+		first_while_string_count, hash_tab->size);
+	fprintf(output_fptr, "\n<p>----------------Program Done--------------\n\n");
+
+	fclose(output_fptr);
+	
+} /* End printHashEntries */
+
+/* This function adds one findHashEntry() call to the table's
+/* statistics: whether it found the item and how many buckets it
+/* looked in.  Nothing is recorded while statistics are disabled.
+/* 
+/* It returns found, so the caller can return its result through it.
+*/
+int
+recordHashFind(HASH_TAB *hash_tab, int found, unsigned int probes)
+{
+	HASH_STATS *stats = &hash_tab->stats;
+
+	if (!stats->enabled)
+		return found;
+
+	if (found) {
+		stats->hits++;
+		stats->hit_probes += probes;
+		if (probes > stats->max_hit_probes)
+			stats->max_hit_probes = probes;
+	} else {
+		stats->misses++;
+		stats->miss_probes += probes;
+		if (probes > stats->max_miss_probes)
+			stats->max_miss_probes = probes;
+	}
+	return found;
+}
+
+/* This function adds the search statistics of one table to those of
+/* another, as when per-thread tables are merged.
+*/
+void
+mergeHashStats(HASH_STATS *to, HASH_STATS *from)
+{
+	to->hits        += from->hits;
+	to->hit_probes  += from->hit_probes;
+	to->misses      += from->misses;
+	to->miss_probes += from->miss_probes;
+	to->filtered    += from->filtered;
+	to->deletes     += from->deletes;
+	to->moved_back  += from->moved_back;
+
+	if (from->max_hit_probes > to->max_hit_probes)
+		to->max_hit_probes = from->max_hit_probes;
+	if (from->max_miss_probes > to->max_miss_probes)
+		to->max_miss_probes = from->max_miss_probes;
+}
+
+/* This function writes the table's statistics to the named file.  If
+/* the name ends in .json the report is a JSON object; otherwise it is
+/* laid out like the trailer of printHashEntries().
+/* 
+/* Chain lengths are counted here by walking every bucket; everything
+/* else was collected as the table was used.
+/* 
+/* It expects the address of the table and the report file name.
+*/
+void
+printHashStats(HASH_TAB *hash_tab, char *stats_filename)
+{
+	HASH_STATS *stats = &hash_tab->stats;
+	unsigned long histogram[STATS_MAXCHAIN + 1];
+	unsigned long words = 0, used = 0, longest = 0, len;
+	double hit_avg, miss_avg, add_avg;
+	NODE_PTR node_ptr;
+	FILE *fptr;
+	int json, i;
+
+	len = strlen(stats_filename);
+	json = (len > 5 && strcmp(stats_filename + len - 5, ".json") == 0);
+
+	if ((fptr = fopen(stats_filename, "w")) == NULL) {
+		printf("Can't open statistics file: %s\n", stats_filename);
+		exit(1);
+	}
+
+	memset(histogram, 0, sizeof(histogram));
+	for (i = 0; i <= hash_tab->size - 1; i++) {
+		len = 0;
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			len++;
+
+		histogram[len < STATS_MAXCHAIN ? len : STATS_MAXCHAIN]++;
+		words += len;
+		used += (len > 0);
+		if (len > longest)
+			longest = len;
+	}
+
+	hit_avg  = stats->hits ? (double) stats->hit_probes / stats->hits : 0.0;
+	miss_avg = stats->misses ? (double) stats->miss_probes / stats->misses : 0.0;
+	add_avg  = (stats->probed_adds + stats->chained_adds) ?
+		(double) stats->add_probes / (stats->probed_adds + stats->chained_adds) : 0.0;
+
+	if (json) {
+		fprintf(fptr, "{\n");
+		fprintf(fptr, "  \"hashsize\": %d,\n", hash_tab->size);
+		fprintf(fptr, "  \"hash_function\": \"%s\",\n", hash_names[hash_tab->hash_fn]);
+		fprintf(fptr, "  \"words\": %lu,\n", words);
+		fprintf(fptr, "  \"buckets_used\": %lu,\n", used);
+		fprintf(fptr, "  \"load_factor\": %.4f,\n", (double) words / hash_tab->size);
+		fprintf(fptr, "  \"longest_chain\": %lu,\n", longest);
+		fprintf(fptr, "  \"chain_lengths\": {");
+		for (i = 0, len = 0; i <= STATS_MAXCHAIN; i++)
+			if (histogram[i] != 0)
+				fprintf(fptr, "%s\"%d%s\": %lu", len++ ? ", " : "",
+						i, i == STATS_MAXCHAIN ? "+" : "", histogram[i]);
+		fprintf(fptr, "},\n");
+		fprintf(fptr, "  \"adds\": {\"home\": %lu, \"probed\": %lu, \"chained\": %lu, "
+				"\"avg_probe_steps\": %.3f, \"max_probe_steps\": %lu},\n",
+				stats->home_adds, stats->probed_adds, stats->chained_adds,
+				add_avg, stats->max_add_probes);
+		fprintf(fptr, "  \"successful_finds\": {\"count\": %lu, \"avg_probes\": %.3f, "
+				"\"max_probes\": %lu},\n", stats->hits, hit_avg, stats->max_hit_probes);
+		fprintf(fptr, "  \"unsuccessful_finds\": {\"count\": %lu, \"avg_probes\": %.3f, "
+				"\"max_probes\": %lu, \"filtered\": %lu},\n", stats->misses, miss_avg,
+				stats->max_miss_probes, stats->filtered);
+		fprintf(fptr, "  \"deletes\": {\"count\": %lu, \"moved_back\": %lu}\n",
+				stats->deletes, stats->moved_back);
+		fprintf(fptr, "}\n");
+	} else {
+		fprintf(fptr, "Hash table statistics\n");
+		fprintf(fptr, "=====================\n");
+		fprintf(fptr, "HASHSIZE\t\t= %10d\n", hash_tab->size);
+		fprintf(fptr, "Hash function\t\t= %10s\n", hash_names[hash_tab->hash_fn]);
+		fprintf(fptr, "Total words\t\t= %10lu\n", words);
+		fprintf(fptr, "Buckets used\t\t= %10lu\n", used);
+		fprintf(fptr, "Load factor\t\t= %10.3f\n", (double) words / hash_tab->size);
+		fprintf(fptr, "Longest chain\t\t= %10lu\n", longest);
+
+		fprintf(fptr, "\nChain length\tBuckets\n");
+		fprintf(fptr, "============\t=======\n");
+		for (i = 0; i <= STATS_MAXCHAIN; i++)
+			if (histogram[i] != 0)
+				fprintf(fptr, "%10d%s\t%7lu\n", i, i == STATS_MAXCHAIN ? "+" : " ", histogram[i]);
+
+		fprintf(fptr, "\nAdded to expected bucket = %10lu\n", stats->home_adds);
+		fprintf(fptr, "Added by rehashKey()     = %10lu\n", stats->probed_adds);
+		fprintf(fptr, "Added by chaining        = %10lu\n", stats->chained_adds);
+		fprintf(fptr, "Probe steps per rehash   = %10.3f avg %6lu max\n",
+				add_avg, stats->max_add_probes);
+
+		fprintf(fptr, "\nSuccessful finds         = %10lu, %7.3f avg %6lu max buckets\n",
+				stats->hits, hit_avg, stats->max_hit_probes);
+		fprintf(fptr, "Unsuccessful finds       = %10lu, %7.3f avg %6lu max buckets\n",
+				stats->misses, miss_avg, stats->max_miss_probes);
+		if (hash_tab->bloom != NULL)
+			fprintf(fptr, "Turned away by filter    = %10lu\n", stats->filtered);
+		if (stats->deletes != 0)
+			fprintf(fptr, "Deleted                  = %10lu, %7lu moved back\n",
+					stats->deletes, stats->moved_back);
+	}
+
+	fclose(fptr);
+} /* End printHashStats. */
+
+/* This function:
+/* -Prompts the user for search criteria
+/* -Searches for the specified string.
+/* -Prints the results to the screen.
+/* 
+/* When the table has a prefix index, a search item ending in '*' lists
+/* up to PREFIX_TOPK words starting with the rest of it instead.  When
+/* it has a fuzzy index, an item not found gets up to FUZZY_TOPK of the
+/* nearest words suggested in its place.  A search item starting with
+/* '!' deletes the rest of it from the table instead; '-' isn't used for
+/* that, as word lists of options and negative numbers start with it.
+/* 
+/* It expects the caller to pass it the address of the hash table.
+/* 
+/* It returns nothing.
+/* 
+/* It has no side effects.
+*/
+void
+queryHashTable(HASH_TAB *hash_tab)
+{
+	char search_item[MAXARRAY]; 
+	NODE_PTR matches[PREFIX_TOPK];
+	FUZZY_MATCH suggestions[FUZZY_TOPK];
+	unsigned long total;
+	double start;
+	int i = 0;
+	int len;
+	
+	/** Prompt user for seach item...
+	 **/
+	printf("Enter a search item:\n");
+		scanf("%s", search_item);
+		printf("\n");
+
+	/** Take the item out of the table, if asked...
+	 **/
+	len = strlen(search_item);
+	if (hash_tab->fold_case)
+		foldCase(search_item, search_item, len);
+	if (len > 1 && search_item[0] == '!') {
+		start = elapsedSeconds();
+		i = (deleteHashEntry(hash_tab, search_item + 1) != NULL);
+		start = elapsedSeconds() - start;
+
+		printf("%s %s (%.1f us).\n\n", i ? "Deleted" : "Did not find", search_item + 1,
+			   start * 1e6);
+		return;
+	}
+
+	/** List the words starting with a prefix, if asked...
+	 **/
+	if (hash_tab->prefix != NULL && len > 0 && search_item[len - 1] == '*') {
+		search_item[len - 1] = '\0';
+		start = elapsedSeconds();
+		i = findHashPrefix(hash_tab, search_item, matches, PREFIX_TOPK, &total);
+		start = elapsedSeconds() - start;
+
+		printf("%lu word(s) start with %s (%.1f us):\n", total, search_item, start * 1e6);
+		for (len = 0; len < i; len++)
+			printf("   %s\n", matches[len]->line_text);
+		if (total > (unsigned long) i)
+			printf("   ...\n");
+		printf("\n");
+		return;
+	}
+
+	/** Seach for item in table...
+	 **/
+	i = findHashEntry(hash_tab, search_item);
+
+	/** Print results...
+	 **/
+	printf("Found %d occurance(s) of %s.\n\n", i, search_item);
+
+	/** Suggest near misses for an item not found, if there is a
+	 ** fuzzy index...
+	 **/
+	if (i == 0 && hash_tab->fuzzy != NULL) {
+		start = elapsedSeconds();
+		i = findHashFuzzy(hash_tab, search_item, hash_tab->fuzzy->max_distance,
+						  suggestions, FUZZY_TOPK, &total);
+		start = elapsedSeconds() - start;
+
+		if (i == 0)
+			printf("No word within %d edit(s) of %s (%.1f us).\n\n",
+				   hash_tab->fuzzy->max_distance, search_item, start * 1e6);
+		else {
+			printf("Did you mean (%.1f us):\n", start * 1e6);
+			for (len = 0; len < i; len++)
+				printf("   %s\t(%d edit%s)\n", suggestions[len].word->line_text,
+					   suggestions[len].distance, suggestions[len].distance == 1 ? "" : "s");
+			printf("\n");
+		}
+	}
+}
+/* This function prints command line usage.
+/* It expects the name the program was run under.
+/* It returns nothing.
+*/
+void
+printUsage(char *program_name)
+{
+	printf("Usage:\n");
+	printf("%s [-w wordFile] [-prefix] [-fuzzy distance]\n", program_name);
+	printf("%s [-w wordFile] -lex sourceFile...\n", program_name);
+	printf("%s [-w wordFile] [-j threads] -index path...\n", program_name);
+	printf("%s [-w wordFile] -save snapshotFile\n", program_name);
+	printf("%s [-verify] -load snapshotFile\n", program_name);
+	printf("%s [-w wordFile | -load snapshotFile] -batch [queryFile]\n", program_name);
+	printf("%s [-w wordFile] [-j threads] -cbench\n", program_name);
+	printf("%s [-w wordFile] [-j threads] [-hash function] [-target n] -sweep [min [max [step]]]\n",
+		   program_name);
+	printf("%s [-w wordFile] -filterbench\n", program_name);
+	printf("%s [-w wordFile] -scan [textFile...]\n", program_name);
+	printf("%s [-estimator name] [-budget bytes | -epsilon e] -top k [textFile...]\n",
+		   program_name);
+	printf("%s -xref indexFile path...\n", program_name);
+	printf("%s -refresh indexFile path...\n", program_name);
+	printf("%s [-verify] -lookup indexFile [query...]\n", program_name);
+	printf("%s [-w wordFile | -load snapshotFile] -serve socketFile\n", program_name);
+	printf("%s [-w wordFile] -loadgen socketFile [connections [depth [seconds]]]\n",
+		   program_name);
+	printf("%s [-w wordFile] [-budget bytes] -external tableFile [-batch [queryFile] |\n",
+		   program_name);
+	printf("      -serve socketFile]\n");
+	printf("%s [-w wordFile] -readbench\n", program_name);
+	printf("%s [-w wordFile] -tail n [textFile]\n", program_name);
+	printf("%s [-w wordFile] -churn\n", program_name);
+	printf("%s [-hash function] -microbench resultsFile [maxKeys]\n", program_name);
+	printf("(-size n, -hash function, -bloom rate and -stats reportFile may be added to any\n");
+	printf(" but -load, -sweep, -top, -xref, -refresh, -lookup, -readbench and -microbench;\n");
+	printf(" -stats not to -save, -cbench, -scan, -tail or -churn; -size, -hash and -bloom\n");
+	printf(" not to -external; -fold to any that hashes wordFile but -save and -external)\n\n");
+	printf("   -w wordFile  - file of words to hash, one per line (prompted for,\n");
+	printf("                  or \"%s\" with -lex and -index)\n", DEFAULT_WORDFILE);
+	printf("   -lex         - tokenize the C source files that follow and count\n");
+	printf("                  reserved words and user identifiers\n");
+	printf("   -index       - tokenize every .c and .h file under the paths that\n");
+	printf("                  follow and write the distinct user identifiers to\n");
+	printf("                  output.txt\n");
+	printf("   -j threads   - number of threads for -index, or the most for -cbench\n");
+	printf("                  (default is one per CPU)\n");
+	printf("   -save file   - write the hashed words to a snapshot file\n");
+	printf("   -load file   - map a snapshot file and query it\n");
+	printf("   -verify      - check the snapshot's (or index's) checksum when loading it\n");
+	printf("   -batch       - look up every line of queryFile (default is standard\n");
+	printf("                  input) and write \"1\\tword\" or \"0\\tword\" for each\n");
+	printf("   -cbench      - measure search rates on a shared table with %d%% of\n", CBENCH_WRITE_PERCENT);
+	printf("                  operations adding words, for 1 up to -j threads\n");
+	printf("   -stats file  - write chain lengths and probe counts to file when done\n");
+	printf("                  (as JSON if file ends in .json)\n");
+	printf("   -size n      - number of buckets in the table (default %d), or auto\n", HASHSIZE);
+	printf("                  for about twice the number of words\n");
+	printf("   -hash name   - hash function: original (the default), djb2, sdbm\n");
+	printf("                  or fnv1a\n");
+	printf("   -sweep       - build a table for every size from min to max (default\n");
+	printf("                  the number of words to eight times that) with every\n");
+	printf("                  hash function, or just -hash, on -j threads, report\n");
+	printf("                  collisions, chains, memory and search time for each,\n");
+	printf("                  and recommend the smallest size meeting -target\n");
+	printf("   -target n    - most collisions -sweep accepts (default 0)\n");
+	printf("   -bloom rate  - check searches against a Bloom filter with this\n");
+	printf("                  false-positive rate (such as 0.01) first\n");
+	printf("   -filterbench - time searches that mostly miss, without a filter and\n");
+	printf("                  with filters of several false-positive rates\n");
+	printf("   -prefix      - index the words in sorted order too, so that a search\n");
+	printf("                  item ending in * lists up to %d words starting with it\n",
+		   PREFIX_TOPK);
+	printf("   -fuzzy n     - index the words by edit distance too, so that a search\n");
+	printf("                  item not found gets up to %d words within n edits\n", FUZZY_TOPK);
+	printf("                  suggested (%d is a good n)\n", FUZZY_DISTANCE);
+	printf("   -scan        - write \"offset\\tword\" for every whole word of the table\n");
+	printf("                  found in the text files that follow (default is\n");
+	printf("                  standard input), in one pass whatever the number of\n");
+	printf("                  words; offsets get \"file:\" in front for several files\n");
+	printf("   -top k       - list the k most frequent words (runs of letters, digits\n");
+	printf("                  and underscores) in the text files that follow\n");
+	printf("                  (default is standard input)\n");
+	printf("   -estimator   - how -top counts: exact (a table of every word, sized\n");
+	printf("                  by -size, default %d), cms (a Count-Min sketch and\n", TOP_TABLESIZE);
+	printf("                  a heap) or spacesaving (the default)\n");
+	printf("   -budget n    - memory cms and spacesaving keep to, in bytes, or with\n");
+	printf("                  k, m or g after it (default 1m), or that -external\n");
+	printf("                  loads within (default %dm)\n", EXTERNAL_BUDGET >> 20);
+	printf("   -epsilon e   - size cms and spacesaving so that no count is over by\n");
+	printf("                  more than e times the number of words instead\n");
+	printf("   -xref file   - write the file and line of every identifier in every\n");
+	printf("                  .c and .h file under the paths that follow to an\n");
+	printf("                  index file\n");
+	printf("   -refresh     - update the index file named next, written by -xref,\n");
+	printf("                  for the paths that follow, tokenizing only the files\n");
+	printf("                  added or changed since (or build it if there is none)\n");
+	printf("   -lookup file - list the places of each query that follows (default is\n");
+	printf("                  one per line of standard input) from an index file;\n");
+	printf("                  a query is an identifier, or identifiers joined by &\n");
+	printf("                  (all on one line) and | (any of them)\n");
+	printf("   -serve file  - answer lookups on a Unix domain socket until sent\n");
+	printf("                  SIGINT or SIGTERM: each request is a key's length in\n");
+	printf("                  two bytes, low byte first, then the key, and each\n");
+	printf("                  response one byte, 1 if found and 0 if not\n");
+	printf("   -loadgen     - send the server on the socket named next requests\n");
+	printf("                  for the words of wordFile, on connections (default\n");
+	printf("                  %d) with depth requests in flight on each (default\n",
+		   LOADGEN_CONNECTIONS);
+	printf("                  %d) for seconds (default %d), and report lookups per\n",
+		   LOADGEN_DEPTH, LOADGEN_SECONDS);
+	printf("                  second and latencies\n");
+	printf("   -external    - keep the words on disk while the program runs, in a\n");
+	printf("                  working table file made at the path named next\n");
+	printf("                  (which must not exist), for word lists bigger than\n");
+	printf("                  memory: they are spilled to partitions by hash, then\n");
+	printf("                  sorted into %d-byte pages so a search reads one page\n",
+		   EXTERNAL_PAGESIZE);
+	printf("   -readbench   - time reading wordFile a line at a time with getc(),\n");
+	printf("                  fgets() and the line reader\n");
+	printf("   -tail n      - count the words of the table in the last n lines of\n");
+	printf("                  textFile (default is standard input), most frequent\n");
+	printf("                  first, reading and counting on separate threads\n");
+	printf("   -churn       - replace every word of the table at random, %d times\n",
+		   CHURN_ROUNDS);
+	printf("                  over, and report probes and search time each round\n");
+	printf("   -microbench  - time adds, searches that hit and miss (uniform and\n");
+	printf("                  Zipfian) and walks on tables of generated keys, from\n");
+	printf("                  %d keys by powers of ten to maxKeys (default %lu,\n",
+		   HASHSIZE, MICRO_MAXKEYS);
+	printf("                  about 7 Gbytes), counting cycles and cache and branch\n");
+	printf("                  misses where allowed; resultsFile gets JSON if it\n");
+	printf("                  ends in .json, tab-separated values otherwise\n");
+	printf("   -fold        - ignore the case of ASCII letters: words and search items\n");
+	printf("                  are folded to lower case, words that aren't UTF-8 are\n");
+	printf("                  left out, and -lex, -index and -tail take identifiers\n");
+	printf("                  in UTF-8 (-lex and -index count those that aren't)\n");
+	printf("(at the search prompt, !word deletes word from the table)\n\n");
+}
+
+/*********************************************************
+ **                                                     **
+ **                    Source Lexer                     **
+ **                                                     **
+ *********************************************************/
+
+/* Character class of every byte value, filled in by initCharClasses().
+ */
+static unsigned char char_class[256];
+
+/* 0x80 once allowUtf8Identifiers() has been called, so identMask16()
+ * takes bytes with the top bit set, those of UTF-8 sequences, for
+ * identifier characters too; 0 otherwise.
+ */
+static char ident_high = 0;
+
+/* This function fills in the character class table used by the lexer.
+/* It must be called before lexSourceBuffer().
+/* It returns nothing.
+*/
+void
+initCharClasses(void)
+{
+	int c;
+
+	for (c = 0; c < 256; c++) {
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+			char_class[c] = CC_IDENT;
+		else if (c >= '0' && c <= '9')
+			char_class[c] = CC_IDENT | CC_DIGIT;
+		else if (c == '/' || c == '"' || c == '\'' || c == '#')
+			char_class[c] = CC_SPECIAL;
+		else
+			char_class[c] = 0;
+	}
+	ident_high = 0;
+}
+
+#if defined(__SSE2__)
+/* This function builds a sixteen bit mask with one bit set for every
+/* identifier character in the sixteen bytes at p.  Letters are folded
+/* to lower case and shifted down to zero, so one unsigned range test
+/* (min(x, 25) == x) covers both cases; digits get the same treatment.
+/* Bytes with the top bit set count too if high is 0x80.
+*/
+static inline int
+identMask16(const char *p, char high)
+{
+	__m128i c     = _mm_loadu_si128((const __m128i *) p);
+	__m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+								 _mm_set1_epi8('a'));
+	__m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i ident;
+
+	alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(25)), alpha);
+	digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	ident = _mm_or_si128(_mm_or_si128(alpha, digit),
+						 _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+	ident = _mm_or_si128(ident, _mm_and_si128(c, _mm_set1_epi8(high)));
+
+	return _mm_movemask_epi8(ident);
+}
+
+/* This function builds the mask of bytes the lexer has to stop at
+/* between tokens: identifier characters plus the CC_SPECIAL bytes.
+*/
+static inline int
+tokenStartMask16(const char *p, char high)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *) p);
+	__m128i special;
+
+	special = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')),
+					 _mm_cmpeq_epi8(c, _mm_set1_epi8('"'))),
+		_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\'')),
+					 _mm_cmpeq_epi8(c, _mm_set1_epi8('#'))));
+
+	return identMask16(p, high) | _mm_movemask_epi8(special);
+}
+#endif
+
+/* This function is identSpan() for a given ident_high, which is a
+/* constant wherever it is inlined.
+*/
+static inline int
+spanIdent(const char *p, const char *end, char high)
+{
+	const char *start = p;
+#if defined(__SSE2__)
+	unsigned int mask;
+
+	while (end - p >= 16) {
+		mask = ~identMask16(p, high) & 0xFFFF;	/* Bits for non-identifier bytes */
+		if (mask != 0)
+			return (int) (p - start) + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && (char_class[(unsigned char) *p] & CC_IDENT))
+		p++;
+
+	return (int) (p - start);
+}
+
+/* This function measures the run of identifier characters (letters,
+/* digits and underscores) starting at p, stopping at end.
+/* It returns the length of the run, which is 0 if p is not on one.
+/* Plain ASCII gets its own copy of the loop, so taking identifiers in
+/* UTF-8 costs it nothing.
+*/
+int
+identSpan(const char *p, const char *end)
+{
+	if (ident_high)
+		return spanIdent(p, end, (char) 0x80);
+	return spanIdent(p, end, 0);
+}
+
+/* This function is skipGap() for a given ident_high, as spanIdent()
+/* is identSpan().
+*/
+static inline const char *
+stepGap(const char *p, const char *end, char high)
+{
+#if defined(__SSE2__)
+	unsigned int mask;
+
+	while (end - p >= 16) {
+		if ((mask = tokenStartMask16(p, high)) != 0)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < end && char_class[(unsigned char) *p] == 0)
+		p++;
+
+	return p;
+}
+
+/* This function steps over whitespace and punctuation, none of which
+/* can start an identifier, comment, literal or directive.
+/* It returns a pointer to the first byte the lexer must look at, or end.
+*/
+const char *
+skipGap(const char *p, const char *end)
+{
+	if (ident_high)
+		return stepGap(p, end, (char) 0x80);
+	return stepGap(p, end, 0);
+}
+
+/* This function steps over the rest of a block comment.  It expects p
+/* to point just past the opening slash-star.
+/* It returns a pointer just past the closing star-slash, or end if the
+/* comment is never closed.
+*/
+const char *
+skipBlockComment(const char *p, const char *end)
+{
+	while ((p = memchr(p, '*', end - p)) != NULL) {
+		if (p + 1 < end && p[1] == '/')
+			return p + 2;
+		p++;
+	}
+	return end;
+}
+
+/* This function steps to the end of the line holding p.  A newline
+/* preceded by a backslash continues the line, as it does for line
+/* comments and preprocessor directives.  p must not be the first byte
+/* of the buffer.
+/* It returns a pointer to the terminating newline, or end.
+*/
+const char *
+skipToLineEnd(const char *p, const char *end)
+{
+	const char *q;
+
+	while ((p = memchr(p, '\n', end - p)) != NULL) {
+		q = p;
+		if (q[-1] == '\r')		/* Allow for DOS line endings */
+			q--;
+		if (q[-1] != '\\')
+			return p;
+		p++;
+	}
+	return end;
+}
+
+/* This function steps over a preprocessor directive.  It expects p to
+/* point just past the '#'.  Block comments inside the directive may run
+/* on past the end of its line.
+/* It returns a pointer to the newline that ends the directive, or end.
+*/
+const char *
+skipDirective(const char *p, const char *end)
+{
+	const char *eol;
+	const char *slash;
+
+	for (;;) {
+		eol = skipToLineEnd(p, end);
+
+		/** Look for a comment opener before the end of the line...
+		 **/
+		while ((slash = memchr(p, '/', eol - p)) != NULL) {
+			if (slash + 1 < eol && (slash[1] == '*' || slash[1] == '/'))
+				break;
+			p = slash + 1;
+		}
+
+		if (slash == NULL || slash[1] == '/')
+			return eol;
+
+		p = skipBlockComment(slash + 2, end);
+	}
+}
+
+/* This function steps over a string or character literal, including
+/* any backslash escapes in it.  It expects p to point at the opening
+/* quote.  An unterminated literal ends at the end of its line.
+/* It returns a pointer just past the closing quote.
+*/
+const char *
+skipQuoted(const char *p, const char *end)
+{
+	char quote = *p++;
+
+	while (p < end) {
+		if (*p == '\\')
+			p += 2;
+		else if (*p == quote)
+			return p + 1;
+		else if (*p == '\n')
+			return p;
+		else
+			p++;
+	}
+	return end;
+}
+
+/* This function steps over a numeric constant, including the decimal
+/* points, exponent signs and suffixes that can appear in one.  It
+/* expects p to point at the leading digit.
+/* It returns a pointer just past the constant.
+*/
+const char *
+skipNumber(const char *p, const char *end)
+{
+	p += identSpan(p, end);
+
+	while (p < end) {
+		if (*p == '.')
+			p++;
+		else if ((*p == '+' || *p == '-') &&
+				 (p[-1] == 'e' || p[-1] == 'E' || p[-1] == 'p' || p[-1] == 'P'))
+			p++;
+		else
+			break;
+		p += identSpan(p, end);
+	}
+	return p;
+}
+
+/* This function tells whether the '#' at p is the first thing other
+/* than blanks on its line, which makes it a preprocessor directive.
+/* It returns 1 if so, 0 otherwise.
+*/
+int
+startsDirective(const char *buf, const char *p)
+{
+	while (p > buf && (p[-1] == ' ' || p[-1] == '\t'))
+		p--;
+
+	return (p == buf || p[-1] == '\n');
+}
+
+/* This function tells whether the identifier at p is one of the
+/* encoding prefixes (L, u, U, u8) that can sit in front of a literal.
+/* It returns 1 if so, 0 otherwise.
+*/
+int
+isLiteralPrefix(const char *p, int len)
+{
+	if (len == 1)
+		return (p[0] == 'L' || p[0] == 'u' || p[0] == 'U');
+
+	return (len == 2 && p[0] == 'u' && p[1] == '8');
+}
+
+/* This function walks a buffer of C source and hands every identifier
+/* in it to the visitor function, along with the visitor's argument.
+/* Comments, string and character literals, numeric constants and
+/* preprocessor lines are stepped over.
+/* 
+/* The identifier passed to the visitor is NOT null terminated; the
+/* visitor gets a pointer into the buffer and a length.
+/*
+/* It returns nothing.
+*/
+void
+lexSourceBuffer(const char *buf, long len, TOKEN_VISITOR visit, void *arg)
+{
+	const char *p = buf;
+	const char *end = buf + len;
+	int n;
+
+	while ((p = skipGap(p, end)) < end) {
+		switch (*p) {
+
+		case '/':
+			if (p + 1 < end && p[1] == '*')
+				p = skipBlockComment(p + 2, end);
+			else if (p + 1 < end && p[1] == '/')
+				p = skipToLineEnd(p + 2, end);
+			else
+				p++;
+			break;
+
+		case '"':
+		case '\'':
+			p = skipQuoted(p, end);
+			break;
+
+		case '#':
+			if (startsDirective(buf, p))
+				p = skipDirective(p + 1, end);
+			else
+				p++;
+			break;
+
+		default:
+			if (char_class[(unsigned char) *p] & CC_DIGIT) {
+				p = skipNumber(p, end);
+				break;
+			}
+
+			/** Hand over the identifier unless it prefixes a literal...
+			 **/
+			n = identSpan(p, end);
+			if (!(p + n < end && (p[n] == '"' || p[n] == '\'') &&
+				  isLiteralPrefix(p, n)))
+				(*visit)(p, n, arg);
+			p += n;
+			break;
+		}
+	}
+} /* End lexSourceBuffer. */
+
+/* This function reads a whole file into memory and null terminates it.
+/* It expects a file name and the address of a length to fill in.
+/* It returns the buffer, which the caller must free, or NULL if the
+/* file can't be read.
+*/
+char *
+readWholeFile(char *filename, long *len)
+{
+	FILE *fptr;
+	char *buf;
+	long size;
+
+	if ((fptr = fopen(filename, "rb")) == NULL)
+		return NULL;
+
+	if (fseek(fptr, 0L, SEEK_END) != 0 || (size = ftell(fptr)) < 0 ||
+		fseek(fptr, 0L, SEEK_SET) != 0 ||
+		(buf = (char *) malloc(size + 1)) == NULL) {
+		fclose(fptr);
+		return NULL;
+	}
+
+	*len = (long) fread(buf, 1, size, fptr);
+	buf[*len] = '\0';
+	fclose(fptr);
+
+	return buf;
+}
+
+/* This function finds the length of the longest word in the table,
+/* so callers can rule out longer words without hashing them.
+/* It expects the address of the hash table.
+*/
+int
+longestHashEntry(HASH_TAB *hash_tab)
+{
+	NODE_PTR node_ptr;
+	int i, len, longest = 0;
+
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			if ((len = strlen(node_ptr->line_text)) > longest)
+				longest = len;
+
+	return longest;
+}
+
+/* This function is the lexer's visitor for lexSourceFiles().  It counts
+/* the identifier as either a reserved word or a user identifier, or,
+/* with -fold, as neither if it isn't UTF-8.
+/* It expects arg to point to a LEX_CONTEXT.
+*/
+void
+classifyToken(const char *token, int len, void *arg)
+{
+	LEX_CONTEXT *ctx = (LEX_CONTEXT *) arg;
+
+	if (ctx->check_utf8 && !validUtf8(token, len)) {
+		ctx->counts.invalid_utf8++;
+		return;
+	}
+
+	if (isReservedToken(ctx, token, len))
+		ctx->counts.reserved_words++;
+	else
+		ctx->counts.user_identifiers++;
+}
+
+/* This function looks an identifier up in the table of reserved words.
+/* Identifiers longer than the longest reserved word aren't hashed.
+/* It returns 1 if the identifier is a reserved word, 0 otherwise.
+*/
+int
+isReservedToken(LEX_CONTEXT *ctx, const char *token, int len)
+{
+	char word_buffer[MAXARRAY];
+	char *word = word_buffer;
+	int found;
+
+	if (len > ctx->longest_reserved)
+		return 0;
+
+	/** Word lists may hold words longer than the usual buffer...
+	 **/
+	if (len >= MAXARRAY && (word = (char *) malloc(len + 1)) == NULL) {
+		printf("Error: Unable to allocate line text storage\n");
+		exit(-1);
+	}
+	copyKey(ctx->reserved, word, token, len);
+
+	found = findHashEntry(ctx->reserved, word);
+
+	if (word != word_buffer)
+		free(word);
+	return found;
+}
+
+/* This function tokenizes each of the named source files, classifies
+/* the identifiers against the table of reserved words and prints the
+/* totals along with the lexer's throughput.
+/* 
+/* It expects the number of files, their names, and the hash table.
+/* Files that can't be read are reported and skipped.
+*/
+void
+lexSourceFiles(int nfiles, char **filenames, HASH_TAB *hash_tab)
+{
+	LEX_CONTEXT ctx;
+	char *buf;
+	long len;
+	double start, lex_seconds = 0.0;
+	int i;
+
+	initCharClasses();
+	if (hash_tab->fold_case)
+		allowUtf8Identifiers();
+
+	ctx.reserved = hash_tab;
+	ctx.longest_reserved = longestHashEntry(hash_tab);
+	memset(&ctx.counts, 0, sizeof(ctx.counts));
+
+	for (i = 0; i < nfiles; i++) {
+		if ((buf = readWholeFile(filenames[i], &len)) == NULL) {
+			printf("Can't read source file: %s\n", filenames[i]);
+			continue;
+		}
+
+		/** With -fold, only a file that isn't UTF-8 as a whole needs
+		 ** its identifiers checked one by one...
+		 **/
+		start = elapsedSeconds();
+		ctx.check_utf8 = hash_tab->fold_case && !validUtf8(buf, len);
+		lexSourceBuffer(buf, len, classifyToken, &ctx);
+		lex_seconds += elapsedSeconds() - start;
+
+		ctx.counts.files++;
+		ctx.counts.bytes += len;
+		free(buf);
+	}
+
+	printf("Files lexed     \t= %10lu\n", ctx.counts.files);
+	printf("Bytes lexed     \t= %10lu\n", ctx.counts.bytes);
+	printf("Reserved words  \t= %10lu\n", ctx.counts.reserved_words);
+	printf("User identifiers\t= %10lu\n", ctx.counts.user_identifiers);
+	if (hash_tab->fold_case)
+		printf("Invalid UTF-8   \t= %10lu\n", ctx.counts.invalid_utf8);
+	if (lex_seconds > 0.0)
+		printf("Lexer throughput\t= %10.1f MB/s\n",
+			   ctx.counts.bytes / lex_seconds / 1e6);
+} /* End lexSourceFiles. */
+
+/* This function reads a monotonic clock.
+/* It returns the time in seconds from an arbitrary starting point.
+*/
+double
+elapsedSeconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*********************************************************
+ **                                                     **
+ **                 Parallel Tree Index                 **
+ **                                                     **
+ *********************************************************/
+
+/* This function adds a copy of a file name to a list of files, growing
+/* the list as needed.  If memory runs out, it prints an appropriate
+/* message and exits from the program.
+*/
+void
+addFileName(FILE_LIST *list, char *name)
+{
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 256;
+		list->names = (char **) realloc(list->names,
+										list->capacity * sizeof(char *));
+	}
+
+	if (list->names == NULL || (list->names[list->count] = stringDup(name)) == NULL) {
+		printf("Error: Unable to allocate file list storage\n");
+		exit(-1);
+	}
+	list->count++;
+}
+
+/* This function tells whether a file name ends in .c or .h.
+/* It returns 1 if so, 0 otherwise.
+*/
+int
+isSourceFileName(char *name)
+{
+	int len = strlen(name);
+
+	return (len > 2 && name[len - 2] == '.' &&
+			(name[len - 1] == 'c' || name[len - 1] == 'h'));
+}
+
+/* This function collects the source files at or under a path.
+/* A directory is walked recursively and every .c and .h file in it is
+/* added to the list.  Symbolic links inside the tree are not followed.
+/* A file named by the caller (named is 1) is added whatever its name.
+/* It returns nothing.
+*/
+void
+collectSourceFiles(char *path, FILE_LIST *list, int named)
+{
+	struct stat info;
+	struct dirent *entry;
+	DIR *dir;
+	char *child;
+
+	if ((named ? stat(path, &info) : lstat(path, &info)) != 0) {
+		printf("Can't find source path: %s\n", path);
+		return;
+	}
+
+	if (S_ISREG(info.st_mode)) {
+		if (named || isSourceFileName(path)) {
+			addFileName(list, path);
+			list->bytes += info.st_size;
+		}
+		return;
+	}
+
+	if (!S_ISDIR(info.st_mode) || (dir = opendir(path)) == NULL)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		if ((child = (char *) malloc(strlen(path) + strlen(entry->d_name) + 2)) == NULL) {
+			printf("Error: Unable to allocate file list storage\n");
+			exit(-1);
+		}
+		sprintf(child, "%s/%s", path, entry->d_name);
+		collectSourceFiles(child, list, FALSE);
+		free(child);
+	}
+	closedir(dir);
+}
+
+/* This function claims the next file from the worker's own range.
+/* When the range is used up it tries to steal from the other workers.
+/* It returns the index of the claimed file, or -1 when none are left.
+*/
+int
+claimFile(INDEX_WORKER *worker)
+{
+	unsigned long long range, next, limit;
+
+	range = atomic_load(&worker->range);
+
+	for (;;) {
+		next  = range >> RANGE_SHIFT;
+		limit = range & 0xFFFFFFFFULL;
+
+		if (next >= limit)
+			break;
+
+		/** A thief may have shortened the range; if so, try again...
+		 **/
+		if (atomic_compare_exchange_weak(&worker->range, &range,
+										 ((next + 1) << RANGE_SHIFT) | limit))
+			return (int) next;
+	}
+	return stealFiles(worker);
+}
+
+/* This function steals the back half of another worker's remaining
+/* files.  The first stolen file is returned to the caller and the rest
+/* become the thief's own range.
+/* 
+/* Files are never added to a range once work has started, so finding
+/* every other range empty means the work is done.
+/* It returns the index of a stolen file, or -1 when none are left.
+*/
+int
+stealFiles(INDEX_WORKER *thief)
+{
+	INDEX_POOL *pool = thief->pool;
+	INDEX_WORKER *victim;
+	unsigned long long range, next, limit, split;
+	int i;
+
+	for (i = 1; i < pool->nworkers; i++) {
+		victim = &pool->workers[(thief->id + i) % pool->nworkers];
+		range = atomic_load(&victim->range);
+
+		for (;;) {
+			next  = range >> RANGE_SHIFT;
+			limit = range & 0xFFFFFFFFULL;
+
+			if (next >= limit)
+				break;		/* Nothing to steal here, try the next one */
+
+			split = limit - (limit - next + 1) / 2;
+			if (atomic_compare_exchange_weak(&victim->range, &range,
+											 (next << RANGE_SHIFT) | split)) {
+				atomic_store(&thief->range, ((split + 1) << RANGE_SHIFT) | limit);
+				return (int) split;
+			}
+		}
+	}
+	return -1;
+}
+
+/* This function is the lexer's visitor for indexWorker().  It counts
+/* the identifier and, if it is a user identifier the worker hasn't
+/* seen before, adds it to the worker's own table.  With -fold, an
+/* identifier that isn't UTF-8 is only counted as such.
+/* It expects arg to point to the worker.
+*/
+void
+indexToken(const char *token, int len, void *arg)
+{
+	INDEX_WORKER *worker = (INDEX_WORKER *) arg;
+	char word_buffer[MAXARRAY];
+	char *word = word_buffer;
+
+	if (worker->lex.check_utf8 && !validUtf8(token, len)) {
+		worker->lex.counts.invalid_utf8++;
+		return;
+	}
+
+	if (isReservedToken(&worker->lex, token, len)) {
+		worker->lex.counts.reserved_words++;
+		return;
+	}
+	worker->lex.counts.user_identifiers++;
+
+	/** Very long identifiers don't fit the usual buffer...
+	 **/
+	if (len >= MAXARRAY && (word = (char *) malloc(len + 1)) == NULL) {
+		printf("Error: Unable to allocate line text storage\n");
+		exit(-1);
+	}
+	copyKey(&worker->table, word, token, len);
+
+	if (!findHashEntry(&worker->table, word))
+		addHashEntry(&worker->table, makenode(&worker->table.arena, word));
+
+	if (word != word_buffer)
+		free(word);
+}
+
+/* This function is the body of each indexing thread.  It claims files
+/* one at a time, reads and tokenizes each one, and adds what it finds
+/* to the worker's own table and counts.
+/* It expects arg to point to the worker, and returns NULL.
+*/
+void *
+indexWorker(void *arg)
+{
+	INDEX_WORKER *worker = (INDEX_WORKER *) arg;
+	char *filename;
+	char *buf;
+	long len;
+	int file;
+
+	while ((file = claimFile(worker)) >= 0) {
+		filename = worker->pool->files->names[file];
+
+		if ((buf = readWholeFile(filename, &len)) == NULL) {
+			printf("Can't read source file: %s\n", filename);
+			continue;
+		}
+
+		worker->lex.check_utf8 = worker->table.fold_case && !validUtf8(buf, len);
+		lexSourceBuffer(buf, len, indexToken, worker);
+
+		worker->lex.counts.files++;
+		worker->lex.counts.bytes += len;
+		free(buf);
+	}
+	return NULL;
+}
+
+/* This function compares the text of two nodes for qsort().
+*/
+int
+compareNodeText(const void *a, const void *b)
+{
+	return strcmp((*(NODE_PTR *) a)->line_text, (*(NODE_PTR *) b)->line_text);
+}
+
+/* This function merges the workers' tables into one table.
+/* 
+/* The nodes from every worker are sorted by text and added in that
+/* order, so the merged table comes out the same no matter how the
+/* files were shared out.  A word seen by several workers is added once.
+/* The merged table takes over the workers' arenas, so freeing it
+/* releases every copy.
+/* 
+/* It expects the pool, a table to initialize, with buckets for about
+/* twice the distinct words, and the hash function to use.
+/* It returns the number of distinct words added.
+*/
+unsigned long
+mergeWorkerTables(INDEX_POOL *pool, HASH_TAB *merged, int hash_fn)
+{
+	NODE_PTR *nodes, node_ptr;
+	unsigned long total = 0, distinct = 0, n = 0, i;
+	int w, b;
+
+	for (w = 0; w < pool->nworkers; w++)
+		for (b = 0; b <= pool->workers[w].table.size - 1; b++)
+			for (node_ptr = pool->workers[w].table.bucket[b]; node_ptr != NULL;
+				 node_ptr = node_ptr->next_ptr)
+				total++;
+
+	if (total == 0) {
+		initHashTable(merged, HASHSIZE, hash_fn);
+		return 0;
+	}
+
+	if ((nodes = (NODE_PTR *) malloc(total * sizeof(NODE_PTR))) == NULL) {
+		printf("Error: Unable to allocate merge storage\n");
+		exit(-1);
+	}
+
+	for (w = 0; w < pool->nworkers; w++)
+		for (b = 0; b <= pool->workers[w].table.size - 1; b++)
+			for (node_ptr = pool->workers[w].table.bucket[b]; node_ptr != NULL;
+				 node_ptr = node_ptr->next_ptr)
+				nodes[n++] = node_ptr;
+
+	qsort(nodes, total, sizeof(NODE_PTR), compareNodeText);
+
+	/** Drop the words seen by more than one worker first, so the table
+	 ** is sized by the distinct words, whatever the number of workers...
+	 **/
+	for (i = 0; i < total; i++)
+		if (distinct == 0 || strcmp(nodes[i]->line_text, nodes[distinct - 1]->line_text) != 0)
+			nodes[distinct++] = nodes[i];
+
+	initHashTable(merged, distinct < HASHSIZE / 2 ? HASHSIZE :
+				  nextPrime(distinct <= MAXHASHSIZE / 2 ? 2 * distinct : MAXHASHSIZE), hash_fn);
+	for (i = 0; i < distinct; i++) {
+		nodes[i]->next_ptr = NULL;
+		addHashEntry(merged, nodes[i]);
+	}
+
+	/** The merged table now owns the nodes, so it takes their storage...
+	 **/
+	for (w = 0; w < pool->nworkers; w++)
+		arenaAdopt(&merged->arena, &pool->workers[w].table.arena);
+
+	free(nodes);
+	return distinct;
+} /* End mergeWorkerTables. */
+
+/* This function tokenizes every source file at or under the named
+/* paths on a pool of threads, merges the identifiers they find into
+/* one table, writes the table to the output file with
+/* printHashEntries(), and prints the totals.
+/* 
+/* It expects the number of paths, the paths, the table of reserved
+/* words, the number of threads to use, and the name of a statistics
+/* report to write for the merged table, or NULL for none.
+*/
+void
+indexSourceTree(int npaths, char **paths, HASH_TAB *hash_tab, int nthreads,
+				char *stats_filename)
+{
+	FILE_LIST files = { NULL, 0, 0, 0 };
+	INDEX_POOL pool;
+	INDEX_WORKER *worker;
+	LEX_COUNTS totals;
+	HASH_TAB merged;
+	unsigned long distinct, first, last;
+	uint64_t expected;
+	double start, lexed, merged_at;
+	int i, table_size;
+
+	initCharClasses();
+	if (hash_tab->fold_case)
+		allowUtf8Identifiers();
+
+	for (i = 0; i < npaths; i++)
+		collectSourceFiles(paths[i], &files, TRUE);
+
+	if (files.count == 0) {
+		printf("No source files found\n");
+		return;
+	}
+
+	/** No point in more threads than files...
+	 **/
+	if (nthreads > files.count)
+		nthreads = files.count;
+
+	pool.files = &files;
+	pool.nworkers = nthreads;
+	if ((pool.workers = (INDEX_WORKER *) calloc(nthreads, sizeof(INDEX_WORKER))) == NULL) {
+		printf("Error: Unable to allocate worker storage\n");
+		exit(-1);
+	}
+
+	/** Every worker searches the reserved table, so it can't count
+	 ** those searches without a lock...
+	 **/
+	hash_tab->stats.enabled = FALSE;
+
+	/** Size each worker's table for the identifiers of its share of the
+	 ** bytes, since a table too small for them turns every add into a
+	 ** walk down a long chain...
+	 **/
+	expected = files.bytes / INDEX_BYTESPERWORD / nthreads;
+	table_size = hash_tab->size;
+	if (2 * expected > (uint64_t) table_size)
+		table_size = nextPrime(expected <= MAXHASHSIZE / 2 ? 2 * expected : MAXHASHSIZE);
+
+	/** Give each worker an even share of the files to start with...
+	 **/
+	start = elapsedSeconds();
+	for (i = 0; i < nthreads; i++) {
+		worker = &pool.workers[i];
+		worker->id = i;
+		worker->pool = &pool;
+		worker->lex.reserved = hash_tab;
+		worker->lex.longest_reserved = longestHashEntry(hash_tab);
+		initHashTable(&worker->table, table_size, hash_tab->hash_fn);
+		worker->table.fold_case = hash_tab->fold_case;
+
+		first = (unsigned long) files.count * i / nthreads;
+		last  = (unsigned long) files.count * (i + 1) / nthreads;
+		atomic_init(&worker->range, ((unsigned long long) first << RANGE_SHIFT) | last);
+	}
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&pool.workers[i].thread, NULL, indexWorker,
+						   &pool.workers[i]) != 0) {
+			printf("Error: Unable to start indexing thread\n");
+			exit(-1);
+		}
+
+	memset(&totals, 0, sizeof(totals));
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(pool.workers[i].thread, NULL);
+		totals.files            += pool.workers[i].lex.counts.files;
+		totals.bytes            += pool.workers[i].lex.counts.bytes;
+		totals.reserved_words   += pool.workers[i].lex.counts.reserved_words;
+		totals.user_identifiers += pool.workers[i].lex.counts.user_identifiers;
+		totals.invalid_utf8     += pool.workers[i].lex.counts.invalid_utf8;
+	}
+	lexed = elapsedSeconds();
+
+	distinct = mergeWorkerTables(&pool, &merged, hash_tab->hash_fn);
+	merged.fold_case = hash_tab->fold_case;
+	merged_at = elapsedSeconds();
+
+	printHashEntries(&merged);
+
+	if (stats_filename != NULL) {
+		for (i = 0; i < nthreads; i++)
+			mergeHashStats(&merged.stats, &pool.workers[i].table.stats);
+		printHashStats(&merged, stats_filename);
+	}
+
+	printf("Threads         \t= %10d\n", nthreads);
+	printf("Files indexed   \t= %10lu\n", totals.files);
+	printf("Bytes indexed   \t= %10lu\n", totals.bytes);
+	printf("Reserved words  \t= %10lu\n", totals.reserved_words);
+	printf("User identifiers\t= %10lu\n", totals.user_identifiers);
+	if (hash_tab->fold_case)
+		printf("Invalid UTF-8   \t= %10lu\n", totals.invalid_utf8);
+	printf("Distinct user identifiers = %lu\n", distinct);
+	printf("Tokenize time   \t= %10.3f s (%.1f MB/s)\n", lexed - start,
+		   totals.bytes / (lexed - start) / 1e6);
+	printf("Merge time      \t= %10.3f s\n", merged_at - lexed);
+
+	freeHashTable(&merged);
+	free(pool.workers);
+	for (i = 0; i < files.count; i++)
+		free(files.names[i]);
+	free(files.names);
+} /* End indexSourceTree. */
+
+/*********************************************************
+ **                                                     **
+ **                   Table Snapshots                   **
+ **                                                     **
+ *********************************************************/
+
+/* This function checksums a block of memory, eight bytes at a time,
+/* with the FNV-1a mixing step.  Any trailing bytes are mixed in one
+/* at a time.
+/* It returns the checksum.
+*/
+uint64_t
+snapshotChecksum(const char *p, size_t len)
+{
+	uint64_t sum = 14695981039346656037ULL;	/* FNV offset basis */
+	uint64_t word;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&word, p, 8);
+		sum = (sum ^ word) * 1099511628211ULL;	/* FNV prime */
+	}
+	for (; len > 0; p++, len--)
+		sum = (sum ^ (unsigned char) *p) * 1099511628211ULL;
+
+	return sum;
+}
+
+/* This function writes a hash table to a snapshot file.
+/* 
+/* The buckets are written as offsets of chain heads, then the nodes of
+/* every chain, one chain after another, then the text of every node in
+/* the same order.  The file is written under a temporary name, mapped
+/* back to compute the checksum, and renamed over the snapshot file.
+/* 
+/* It expects the address of the table and the name of the snapshot.
+/* If the file can't be written it prints an appropriate message and
+/* exits from the program.
+*/
+void
+saveHashSnapshot(HASH_TAB *hash_tab, char *snapshot_filename)
+{
+	SNAPSHOT_HEADER header;
+	SNAPSHOT_NODE snode;
+	NODE_PTR node_ptr;
+	uint64_t offset, text_offset, nwords = 0, text_bytes = 0;
+	char *temp_filename;
+	char *map;
+	FILE *fptr;
+	int i;
+
+	/** Count the words and their text to lay out the file...
+	 **/
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+			nwords++;
+			text_bytes += strlen(node_ptr->line_text) + 1;
+		}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version       = SNAPSHOT_VERSION;
+	header.byte_order    = SNAPSHOT_BYTEORDER;
+	header.hash_size     = hash_tab->size;
+	header.hash_fn       = hash_tab->hash_fn;
+	header.nwords        = nwords;
+	header.bucket_offset = sizeof(SNAPSHOT_HEADER);
+	header.node_offset   = header.bucket_offset + hash_tab->size * sizeof(uint64_t);
+	header.text_offset   = header.node_offset + nwords * sizeof(SNAPSHOT_NODE);
+	header.file_size     = header.text_offset + text_bytes;
+
+	if ((temp_filename = (char *) malloc(strlen(snapshot_filename) + 5)) == NULL) {
+		printf("Error: Unable to allocate snapshot storage\n");
+		exit(-1);
+	}
+	sprintf(temp_filename, "%s.tmp", snapshot_filename);
+
+	if ((fptr = fopen(temp_filename, "wb")) == NULL) {
+		printf("Can't open snapshot file: %s\n", temp_filename);
+		exit(-1);
+	}
+
+	fwrite(&header, sizeof(header), 1, fptr);
+
+	/** Buckets: each chain's nodes are written together, in order...
+	 **/
+	offset = header.node_offset;
+	for (i = 0; i <= hash_tab->size - 1; i++) {
+		uint64_t head = 0;
+
+		if (hash_tab->bucket[i] != NULL)
+			head = offset;
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			offset += sizeof(SNAPSHOT_NODE);
+		fwrite(&head, sizeof(head), 1, fptr);
+	}
+
+	/** Nodes: the next node in a chain is the one written after it...
+	 **/
+	offset = header.node_offset;
+	text_offset = header.text_offset;
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+			offset += sizeof(SNAPSHOT_NODE);
+			snode.text = text_offset;
+			snode.next = (node_ptr->next_ptr != NULL) ? offset : 0;
+			text_offset += strlen(node_ptr->line_text) + 1;
+			fwrite(&snode, sizeof(snode), 1, fptr);
+		}
+
+	/** Text, in the same order as the nodes...
+	 **/
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			fwrite(node_ptr->line_text, strlen(node_ptr->line_text) + 1, 1, fptr);
+
+	if (fclose(fptr) != 0) {
+		printf("Can't write snapshot file: %s\n", temp_filename);
+		exit(-1);
+	}
+
+	/** Map the file back to checksum it and fill in the header...
+	 **/
+	if ((i = open(temp_filename, O_RDWR)) < 0 ||
+		(map = mmap(NULL, header.file_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED, i, 0)) == MAP_FAILED) {
+		printf("Can't map snapshot file: %s\n", temp_filename);
+		exit(-1);
+	}
+	close(i);
+
+	((SNAPSHOT_HEADER *) map)->checksum =
+		snapshotChecksum(map + sizeof(SNAPSHOT_HEADER),
+						 header.file_size - sizeof(SNAPSHOT_HEADER));
+	munmap(map, header.file_size);
+
+	if (rename(temp_filename, snapshot_filename) != 0) {
+		printf("Can't replace snapshot file: %s\n", snapshot_filename);
+		exit(-1);
+	}
+	free(temp_filename);
+
+	printf("Saved %lu words to %s (%lu bytes)\n", (unsigned long) nwords,
+		   snapshot_filename, (unsigned long) header.file_size);
+} /* End saveHashSnapshot. */
+
+/* This function maps a snapshot file read-only and checks its header:
+/* the magic string, version, byte order, table size and layout must all
+/* match what this program writes, and the text must end in a null so
+/* no word runs off the end.  The checksum is checked only when verify
+/* is 1; sequentialSearchSnapshot() checks each offset it follows.
+/* 
+/* It expects the name of the snapshot and a SNAPSHOT to fill in.
+/* It returns 1 on success.  Otherwise it prints the reason and
+/* returns 0.
+*/
+int
+openHashSnapshot(char *snapshot_filename, SNAPSHOT *snapshot, int verify)
+{
+	const SNAPSHOT_HEADER *header;
+	struct stat info;
+	void *map;
+	int fd;
+
+	if ((fd = open(snapshot_filename, O_RDONLY)) < 0) {
+		printf("Can't find snapshot file: %s\n", snapshot_filename);
+		return 0;
+	}
+
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(SNAPSHOT_HEADER)) {
+		printf("Not a snapshot file: %s\n", snapshot_filename);
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		printf("Can't map snapshot file: %s\n", snapshot_filename);
+		return 0;
+	}
+
+	snapshot->base   = (const char *) map;
+	snapshot->size   = info.st_size;
+	snapshot->header = header = (const SNAPSHOT_HEADER *) map;
+	snapshot->bucket = (const uint64_t *) (snapshot->base + header->bucket_offset);
+
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+		header->byte_order != SNAPSHOT_BYTEORDER) {
+		printf("Not a snapshot file: %s\n", snapshot_filename);
+	} else if (header->version != SNAPSHOT_VERSION) {
+		printf("Snapshot %s was written by a different version (%u)\n",
+			   snapshot_filename, header->version);
+	} else if (header->hash_size < 1 || header->hash_size > MAXHASHSIZE ||
+			   header->hash_fn >= HASH_FUNCTIONS ||
+			   header->file_size != (uint64_t) info.st_size ||
+			   header->nwords > header->file_size / sizeof(SNAPSHOT_NODE) ||
+			   header->bucket_offset != sizeof(SNAPSHOT_HEADER) ||
+			   header->node_offset != header->bucket_offset + header->hash_size * sizeof(uint64_t) ||
+			   header->text_offset != header->node_offset + header->nwords * sizeof(SNAPSHOT_NODE) ||
+			   header->text_offset > header->file_size ||
+			   (header->file_size > header->text_offset &&
+				snapshot->base[header->file_size - 1] != '\0')) {
+		printf("Snapshot %s is truncated or damaged\n", snapshot_filename);
+	} else if (verify &&
+			   header->checksum != snapshotChecksum(snapshot->base + sizeof(SNAPSHOT_HEADER),
+													 snapshot->size - sizeof(SNAPSHOT_HEADER))) {
+		printf("Snapshot %s fails its checksum\n", snapshot_filename);
+	} else
+		return 1;
+
+	closeHashSnapshot(snapshot);
+	return 0;
+} /* End openHashSnapshot. */
+
+/* This function unmaps a snapshot file.
+*/
+void
+closeHashSnapshot(SNAPSHOT *snapshot)
+{
+	munmap((void *) snapshot->base, snapshot->size);
+	snapshot->base = NULL;
+}
+
+/* This function finds a string in a mapped snapshot, in the same way
+/* findHashEntry() does in a table: the expected bucket and its chain
+/* first, then the rehashed buckets in probing order.
+/* It returns 1 if the string is found, 0 otherwise.
+*/
+int
+findSnapshotEntry(SNAPSHOT *snapshot, char *key)
+{
+	int size = snapshot->header->hash_size;
+	int h = hashKey(key, snapshot->header->hash_fn, size);
+	int probes = 0;
+
+	if (snapshot->bucket[h] == 0)
+		return 0;
+
+	if (sequentialSearchSnapshot(snapshot, snapshot->bucket[h], key))
+		return 1;
+
+	while (probes != PROBE_LIMIT(size)) {
+		h = hashKeyQuad(h, size);
+		probes++;
+
+		if (snapshot->bucket[h] == 0)
+			return 0;
+
+		if (sequentialSearchSnapshot(snapshot, snapshot->bucket[h], key))
+			return 1;
+	}
+	return 0;
+}
+
+/* This function walks the snapshot chain starting at the node at
+/* offset, searching for the string.
+/* 
+/* Only the header is checked when the file is opened, so every offset
+/* is checked before it is followed: a node must be one of the nodes,
+/* after the one before it in the chain (as saveHashSnapshot() writes
+/* them, so a chain can't loop), and its word must be in the text.
+/* It returns 1 if the string is found, 0 otherwise.  If an offset is
+/* out of range it prints an appropriate message and exits from the
+/* program.
+*/
+int
+sequentialSearchSnapshot(SNAPSHOT *snapshot, uint64_t offset, char *search_item)
+{
+	const SNAPSHOT_HEADER *header = snapshot->header;
+	const SNAPSHOT_NODE *snode;
+	uint64_t previous = 0;
+
+	while (offset != 0) {
+		if (offset <= previous || offset < header->node_offset ||
+			offset >= header->text_offset ||
+			(offset - header->node_offset) % sizeof(SNAPSHOT_NODE) != 0) {
+			printf("Snapshot is truncated or damaged: node at %lu\n", (unsigned long) offset);
+			exit(-1);
+		}
+		snode = (const SNAPSHOT_NODE *) (snapshot->base + offset);
+
+		if (snode->text < header->text_offset || snode->text >= header->file_size) {
+			printf("Snapshot is truncated or damaged: word at %lu\n", (unsigned long) snode->text);
+			exit(-1);
+		}
+
+		if (strcmp(snapshot->base + snode->text, search_item) == 0)
+			return 1;
+
+		previous = offset;
+		offset = snode->next;
+	}
+	return 0;
+}
+
+/* This function:
+/* -Prompts the user for search criteria
+/* -Searches for the specified string in the mapped snapshot.
+/* -Prints the results to the screen.
+/* 
+/* It returns nothing.
+*/
+void
+querySnapshot(SNAPSHOT *snapshot)
+{
+	char search_item[MAXARRAY]; 
+	int i = 0;
+	
+	printf("Enter a search item:\n");
+	if (scanf("%79s", search_item) != 1)
+		return;
+	printf("\n");
+
+	i = findSnapshotEntry(snapshot, search_item);
+
+	printf("Found %d occurance(s) of %s.\n\n", i, search_item);
+}
+
+/*********************************************************
+ **                                                     **
+ **                    Batch Queries                    **
+ **                                                     **
+ *********************************************************/
+
+/* This function hashes each key of a batch and prefetches what looking
+/* it up will touch first: its bucket, then the node the bucket points
+/* at.  Either a table or a snapshot is passed; the other is NULL.
+/* It returns nothing.
+*/
+void
+prefetchBatch(HASH_TAB *hash_tab, SNAPSHOT *snapshot, char **keys, int count)
+{
+	int hash[BATCH_SIZE];
+	NODE_PTR node_ptr;
+	int i;
+
+	/** Nothing of an external table's words is in memory to fetch...
+	 **/
+	if (hash_tab != NULL && hash_tab->disk != NULL)
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (hash_tab != NULL)
+			hash[i] = hashKey(keys[i], hash_tab->hash_fn, hash_tab->size);
+		else
+			hash[i] = hashKey(keys[i], snapshot->header->hash_fn, snapshot->header->hash_size);
+
+		if (hash_tab != NULL)
+			__builtin_prefetch(&hash_tab->bucket[hash[i]]);
+		else
+			__builtin_prefetch(&snapshot->bucket[hash[i]]);
+	}
+
+	/** By now the first buckets have arrived; start on the nodes...
+	 **/
+	for (i = 0; i < count; i++) {
+		if (hash_tab != NULL) {
+			if ((node_ptr = hash_tab->bucket[hash[i]]) != NULL) {
+				__builtin_prefetch(node_ptr);
+				__builtin_prefetch(node_ptr->line_text);
+			}
+		} else if (snapshot->bucket[hash[i]] != 0)
+			__builtin_prefetch(snapshot->base + snapshot->bucket[hash[i]]);
+	}
+}
+
+/* This function looks up each key of a batch and appends a result line
+/* for it to the output buffer at *used, echoing the query as it was
+/* read from texts (keys may be folded copies of it).  The buffer is
+/* written to standard output whenever the next line won't fit.
+/* It returns nothing.
+*/
+void
+answerBatch(HASH_TAB *hash_tab, SNAPSHOT *snapshot, char **keys, char **texts,
+			int count, char *out, size_t out_size, size_t *used, BATCH_COUNTS *counts)
+{
+	size_t len;
+	int found;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (hash_tab != NULL)
+			found = findHashEntry(hash_tab, keys[i]);
+		else
+			found = findSnapshotEntry(snapshot, keys[i]);
+
+		len = strlen(texts[i]);
+		if (*used + len + 3 > out_size) {
+			fwrite(out, 1, *used, stdout);
+			*used = 0;
+		}
+		out[(*used)++] = found ? '1' : '0';
+		out[(*used)++] = '\t';
+		memcpy(out + *used, texts[i], len);
+		*used += len;
+		out[(*used)++] = '\n';
+
+		counts->queries++;
+		counts->hits += found;
+	}
+}
+
+/* This function answers the search items in a file, one per line, or
+/* on standard input if no file is named.
+/* 
+/* Input is read in BATCH_BUFSIZE blocks; each line is null terminated
+/* where it lies and BATCH_SIZE of them are looked up at a time.  A line
+/* cut off by the end of a block is moved to the front of the buffer
+/* before the next read, and the buffer grows if a single line won't fit.
+/* A table that ignores case is searched for a folded copy of each line,
+/* kept at the same offset in a second buffer, so the line is echoed as
+/* it was read.
+/* 
+/* It expects either a table or a snapshot (the other NULL) and the name
+/* of the query file or NULL.  Results go to standard output, and the
+/* number of queries, hits and the query rate to standard error.
+*/
+void
+runBatchQueries(HASH_TAB *hash_tab, SNAPSHOT *snapshot, char *query_filename)
+{
+	BATCH_COUNTS counts = { 0, 0 };
+	char *keys[BATCH_SIZE], *texts[BATCH_SIZE];
+	char *in, *out, *folded = NULL, *line, *eol, *end;
+	size_t in_size = BATCH_BUFSIZE, out_size = BATCH_BUFSIZE + 3;
+	size_t carried = 0, used = 0;
+	ssize_t got;
+	double start, seconds;
+	int nkeys = 0, done = FALSE;
+	int fd = 0;
+
+	if (query_filename != NULL && strcmp(query_filename, "-") != 0 &&
+		(fd = open(query_filename, O_RDONLY)) < 0) {
+		printf("Can't find query file: %s\n", query_filename);
+		exit(-1);
+	}
+
+	/** The output buffer must hold the longest line, plus the result
+	 ** and tab in front and newline after; it grows with the input...
+	 **/
+	if ((in = (char *) malloc(in_size + 1)) == NULL ||
+		(out = (char *) malloc(out_size)) == NULL ||
+		(hash_tab != NULL && hash_tab->fold_case &&
+		 (folded = (char *) malloc(in_size + 1)) == NULL)) {
+		printf("Error: Unable to allocate query buffers\n");
+		exit(-1);
+	}
+
+	start = elapsedSeconds();
+	while (!done) {
+		if ((got = read(fd, in + carried, in_size - carried)) <= 0) {
+			done = TRUE;
+			got = 0;
+			if (carried > 0)
+				in[carried++] = '\n';	/* Last line had no newline */
+		}
+		end = in + carried + got;
+
+		for (line = in; (eol = memchr(line, '\n', end - line)) != NULL; line = eol + 1) {
+			*eol = '\0';
+			if (eol > line && eol[-1] == '\r')
+				eol[-1] = '\0';
+			if (*line == '\0')
+				continue;
+
+			texts[nkeys] = keys[nkeys] = line;
+			if (folded != NULL) {
+				keys[nkeys] = folded + (line - in);
+				copyKey(hash_tab, keys[nkeys], line, strlen(line));
+			}
+			if (++nkeys == BATCH_SIZE) {
+				prefetchBatch(hash_tab, snapshot, keys, nkeys);
+				answerBatch(hash_tab, snapshot, keys, texts, nkeys, out, out_size, &used, &counts);
+				nkeys = 0;
+			}
+		}
+
+		/** Answer what's left before the buffer is reused...
+		 **/
+		if (nkeys > 0) {
+			prefetchBatch(hash_tab, snapshot, keys, nkeys);
+			answerBatch(hash_tab, snapshot, keys, texts, nkeys, out, out_size, &used, &counts);
+			nkeys = 0;
+		}
+
+		/** Carry the unfinished line over, growing the buffer if that
+		 ** line already fills it...
+		 **/
+		carried = end - line;
+		memmove(in, line, carried);
+		if (carried == in_size) {
+			fwrite(out, 1, used, stdout);
+			used = 0;
+			in_size *= 2;
+			out_size = in_size + 3;
+			if ((in = (char *) realloc(in, in_size + 1)) == NULL ||
+				(out = (char *) realloc(out, out_size)) == NULL ||
+				(folded != NULL && (folded = (char *) realloc(folded, in_size + 1)) == NULL)) {
+				printf("Error: Unable to allocate query buffers\n");
+				exit(-1);
+			}
+		}
+	}
+	fwrite(out, 1, used, stdout);
+	fflush(stdout);
+	seconds = elapsedSeconds() - start;
+
+	fprintf(stderr, "Queries         \t= %10lu\n", counts.queries);
+	fprintf(stderr, "Found           \t= %10lu\n", counts.hits);
+	fprintf(stderr, "Not found       \t= %10lu\n", counts.queries - counts.hits);
+	if (seconds > 0.0)
+		fprintf(stderr, "Query rate      \t= %10.0f queries/s\n", counts.queries / seconds);
+
+	if (fd != 0)
+		close(fd);
+	free(in);
+	free(out);
+	free(folded);
+} /* End runBatchQueries. */
+
+/*********************************************************
+ **                                                     **
+ **                  Concurrent Table                   **
+ **                                                     **
+ *********************************************************/
+
+/* This function allocates the buckets of a concurrent table with the
+/* given size and hash function, initializes them to NULL, and sets up
+/* the lock and arena of each stripe.
+/* It returns nothing.
+*/
+void
+initConcHashTable(CONC_HASH_TAB *conc_tab, int size, int hash_fn)
+{
+	int i;
+
+	if ((conc_tab->bucket = (_Atomic(NODE_PTR) *) malloc(size * sizeof(*conc_tab->bucket))) == NULL) {
+		printf("Error: Unable to allocate bucket storage\n");
+		exit(-1);
+	}
+	conc_tab->size = size;
+	conc_tab->hash_fn = hash_fn;
+
+	for (i = 0; i <= size - 1; i++)
+		atomic_init(&conc_tab->bucket[i], NULL);
+
+	for (i = 0; i < CONC_STRIPES; i++) {
+		pthread_mutex_init(&conc_tab->stripe[i].lock, NULL);
+		conc_tab->stripe[i].arena.head  = NULL;
+		conc_tab->stripe[i].arena.bytes = 0;
+	}
+}
+
+/* This function releases every node of a concurrent table, one arena
+/* per stripe.  No other thread may be using the table.
+*/
+void
+freeConcHashTable(CONC_HASH_TAB *conc_tab)
+{
+	int i;
+
+	for (i = 0; i < CONC_STRIPES; i++) {
+		arenaFree(&conc_tab->stripe[i].arena);
+		pthread_mutex_destroy(&conc_tab->stripe[i].lock);
+	}
+	free(conc_tab->bucket);
+	conc_tab->bucket = NULL;
+}
+
+/* This function finds a string in a concurrent table the same way
+/* findHashEntry() does: the expected bucket and its chain, then the
+/* rehashed buckets in probing order, stopping at an empty one.
+/* 
+/* Each bucket is read once with an acquire load, which makes the node
+/* it points to, and the chain behind that node, safe to read.  No lock
+/* is taken.  A word being added while the search runs may or may not
+/* be found.
+/* It returns 1 if the string is found, 0 otherwise.
+*/
+int
+findConcHashEntry(CONC_HASH_TAB *conc_tab, char *key)
+{
+	NODE_PTR node_ptr;
+	int h = hashKey(key, conc_tab->hash_fn, conc_tab->size);
+	int probes = 0;
+
+	node_ptr = atomic_load_explicit(&conc_tab->bucket[h], memory_order_acquire);
+	if (node_ptr == NULL)
+		return 0;
+
+	if (sequentialSearch(node_ptr, key) == 1)
+		return 1;
+
+	while (probes != PROBE_LIMIT(conc_tab->size)) {
+		h = hashKeyQuad(h, conc_tab->size);
+		probes++;
+
+		node_ptr = atomic_load_explicit(&conc_tab->bucket[h], memory_order_acquire);
+		if (node_ptr == NULL)
+			return 0;
+
+		if (sequentialSearch(node_ptr, key) == 1)
+			return 1;
+	}
+	return 0;
+}
+
+/* This function adds a string to a concurrent table unless it is
+/* already there, placing it the way addHashEntry() would: in its
+/* expected bucket if empty, else in the first empty bucket in probing
+/* order, else at the front of the expected bucket's chain.
+/* 
+/* The stripe lock keeps two threads from adding the same word.  Words
+/* of other stripes can claim the same empty buckets at the same time,
+/* so every bucket is claimed with a compare-and-swap; losing one just
+/* means probing on.  The release ordering of the swap publishes the
+/* finished node to searching threads.
+/* It returns 1 if the string was added, 0 if it was already there.
+*/
+int
+addConcHashEntry(CONC_HASH_TAB *conc_tab, char *key)
+{
+	CONC_STRIPE *stripe;
+	NODE_PTR node_ptr, expected;
+	int h = hashKey(key, conc_tab->hash_fn, conc_tab->size);
+	int home = h;
+	int probes = 0;
+
+	stripe = &conc_tab->stripe[home % CONC_STRIPES];
+	pthread_mutex_lock(&stripe->lock);
+
+	if (findConcHashEntry(conc_tab, key)) {
+		pthread_mutex_unlock(&stripe->lock);
+		return 0;
+	}
+
+	node_ptr = makenode(&stripe->arena, key);
+
+	/** Claim the expected bucket or the first empty one after it...
+	 **/
+	for (;;) {
+		expected = NULL;
+		if (atomic_compare_exchange_strong_explicit(&conc_tab->bucket[h], &expected,
+													node_ptr, memory_order_release,
+													memory_order_relaxed)) {
+			pthread_mutex_unlock(&stripe->lock);
+			return 1;
+		}
+
+		if (probes == PROBE_LIMIT(conc_tab->size))
+			break;
+		h = hashKeyQuad(h, conc_tab->size);
+		probes++;
+	}
+
+	/** Probing failed; chain the node onto the expected bucket...
+	 **/
+	expected = atomic_load_explicit(&conc_tab->bucket[home], memory_order_relaxed);
+	do {
+		node_ptr->next_ptr = expected;
+	} while (!atomic_compare_exchange_weak_explicit(&conc_tab->bucket[home], &expected,
+												   node_ptr, memory_order_release,
+												   memory_order_relaxed));
+
+	pthread_mutex_unlock(&stripe->lock);
+	return 1;
+} /* End addConcHashEntry. */
+
+/* This function steps a xorshift random number generator.  Each
+/* benchmark thread keeps its own state, so nothing is shared.
+/* It returns the next number.
+*/
+uint64_t
+nextRandom(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return *state = x;
+}
+
+/* This function is the body of each concurrent benchmark thread.  It
+/* performs CBENCH_OPS operations, CBENCH_WRITE_PERCENT percent of them
+/* adding a word from the shared pool and the rest searching for a word
+/* that is present, or absent, in about equal numbers.
+/* It expects arg to point to the thread's state, and returns NULL.
+*/
+void *
+concBenchWorker(void *arg)
+{
+	CBENCH_THREAD *bench = (CBENCH_THREAD *) arg;
+	CBENCH_WORDS *words = bench->words;
+	uint64_t r;
+	long n;
+
+	for (n = 0; n < CBENCH_OPS; n++) {
+		r = nextRandom(&bench->seed);
+
+		if (r % 100 < CBENCH_WRITE_PERCENT) {
+			addConcHashEntry(words->table, words->pool[(r >> 8) % CBENCH_POOLSIZE]);
+			bench->writes++;
+		} else if ((r >> 8) & 1) {
+			bench->hits += findConcHashEntry(words->table,
+											 words->present[(r >> 9) % words->npresent]);
+			bench->reads++;
+		} else {
+			bench->hits += findConcHashEntry(words->table,
+											 words->absent[(r >> 9) % CBENCH_POOLSIZE]);
+			bench->reads++;
+		}
+	}
+	return NULL;
+}
+
+/* This function measures a concurrent table under a mix of searches
+/* and adds, for 1, 2, 4, ... threads and then max_threads.  Each run
+/* starts from a fresh table holding the words of hash_tab, and prints
+/* the total and per-thread search rate.
+/* It returns nothing.
+*/
+void
+runConcBenchmark(HASH_TAB *hash_tab, int max_threads)
+{
+	CONC_HASH_TAB *conc_tab;
+	CBENCH_WORDS words;
+	CBENCH_THREAD *bench;
+	NODE_PTR node_ptr;
+	unsigned long reads, writes;
+	double start, seconds;
+	int nthreads, i, n = 0;
+
+	/** Gather the present words and make up the pool and absent ones...
+	 **/
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			n++;
+
+	words.npresent = n;
+	words.present = (char **) malloc((n + 1) * sizeof(char *));
+	words.pool    = (char **) malloc(CBENCH_POOLSIZE * sizeof(char *));
+	words.absent  = (char **) malloc(CBENCH_POOLSIZE * sizeof(char *));
+	conc_tab      = (CONC_HASH_TAB *) aligned_alloc(CACHE_LINESIZE, sizeof(CONC_HASH_TAB));
+	bench         = (CBENCH_THREAD *) calloc(max_threads, sizeof(CBENCH_THREAD));
+	if (!words.present || !words.pool || !words.absent || !conc_tab || !bench) {
+		printf("Error: Unable to allocate benchmark storage\n");
+		exit(-1);
+	}
+
+	n = 0;
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			words.present[n++] = node_ptr->line_text;
+	if (n == 0)
+		words.present[words.npresent++] = "";	/* Never found */
+
+	for (i = 0; i < CBENCH_POOLSIZE; i++) {
+		char word[MAXARRAY];
+
+		sprintf(word, "pool_%d", i);
+		words.pool[i] = stringDup(word);
+		sprintf(word, "absent_%d", i);
+		words.absent[i] = stringDup(word);
+	}
+
+	printf("Threads\t      Searches/s\tSearches/s/thread\tAdds\n");
+
+	for (nthreads = 1; ; nthreads = (nthreads * 2 < max_threads) ? nthreads * 2 : max_threads) {
+		initConcHashTable(conc_tab, hash_tab->size, hash_tab->hash_fn);
+		for (i = 0; i < words.npresent; i++)
+			addConcHashEntry(conc_tab, words.present[i]);
+		words.table = conc_tab;
+
+		start = elapsedSeconds();
+		for (i = 0; i < nthreads; i++) {
+			memset(&bench[i], 0, sizeof(CBENCH_THREAD));
+			bench[i].words = &words;
+			bench[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+			if (pthread_create(&bench[i].thread, NULL, concBenchWorker, &bench[i]) != 0) {
+				printf("Error: Unable to start benchmark thread\n");
+				exit(-1);
+			}
+		}
+
+		reads = writes = 0;
+		for (i = 0; i < nthreads; i++) {
+			pthread_join(bench[i].thread, NULL);
+			reads  += bench[i].reads;
+			writes += bench[i].writes;
+		}
+		seconds = elapsedSeconds() - start;
+
+		printf("%7d\t%16.0f\t%17.0f\t%lu\n", nthreads, reads / seconds,
+			   reads / seconds / nthreads, writes);
+
+		freeConcHashTable(conc_tab);
+
+		if (nthreads == max_threads)
+			break;
+	}
+
+	for (i = 0; i < CBENCH_POOLSIZE; i++) {
+		free(words.pool[i]);
+		free(words.absent[i]);
+	}
+	free(words.present);
+	free(words.pool);
+	free(words.absent);
+	free(conc_tab);
+	free(bench);
+} /* End runConcBenchmark. */
+
+/*********************************************************
+ **                                                     **
+ **                  Table Size Sweep                   **
+ **                                                     **
+ *********************************************************/
+
+/* This function reads a word list, one word per line, into memory in
+/* the order of the file, the way processInputFile() reads it.  Blank
+/* lines are skipped; duplicates are kept.  The file is read as a
+/* stream, since only the words are kept.
+/* If the file can't be read it prints an appropriate message and exits
+/* from the program.
+*/
+void
+readWordList(char *input_filename, FILE_LIST *words)
+{
+	INPUT_MAP input;
+	const char *line;
+	size_t len;
+	char *word;
+
+	if (!openInputStream(input_filename, &input)) {
+		printf("Can't find input file: %s\n", input_filename);
+		exit(-1);
+	}
+
+	while (nextLine(&input, &line, &len)) {
+		if (len == 0)
+			continue;
+
+		if ((word = (char *) malloc(len + 1)) == NULL) {
+			printf("Error: Unable to allocate word list storage\n");
+			exit(-1);
+		}
+		memcpy(word, line, len);
+		word[len] = '\0';
+		addFileName(words, word);
+		free(word);
+	}
+	closeInputMap(&input);
+}
+
+/* This function builds a table of the size and hash function named in
+/* result from the words, as processInputFile() would, and fills in the
+/* rest of result: the collisions and probing the words met on the way
+/* in, the memory the table takes, and the time a successful search
+/* takes on average.
+/* It returns nothing.
+*/
+void
+sweepTable(FILE_LIST *words, SWEEP_RESULT *result)
+{
+	HASH_TAB hash_tab;
+	NODE_PTR node_ptr;
+	unsigned long len, found = 0;
+	double start;
+	int rounds, i, n;
+
+	initHashTable(&hash_tab, result->size, result->hash_fn);
+	for (n = 0; n < words->count; n++)
+		if (!findHashEntry(&hash_tab, words->names[n]))
+			addHashEntry(&hash_tab, makenode(&hash_tab.arena, words->names[n]));
+
+	result->collisions = hash_tab.stats.probed_adds + hash_tab.stats.chained_adds;
+	result->bytes = hash_tab.size * sizeof(NODE_PTR) + hash_tab.arena.bytes;
+
+	result->longest = 0;
+	for (i = 0; i <= hash_tab.size - 1; i++) {
+		len = 0;
+		for (node_ptr = hash_tab.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			len++;
+		if (len > result->longest)
+			result->longest = len;
+	}
+
+	/** One counted pass for the probe lengths, then timed passes with
+	 ** the counting off...
+	 **/
+	memset(&hash_tab.stats, 0, sizeof(hash_tab.stats));
+	hash_tab.stats.enabled = TRUE;
+	for (n = 0; n < words->count; n++)
+		findHashEntry(&hash_tab, words->names[n]);
+	result->max_probes = hash_tab.stats.max_hit_probes;
+	hash_tab.stats.enabled = FALSE;
+
+	rounds = SWEEP_FINDS / words->count + 1;
+	start = elapsedSeconds();
+	for (i = 0; i < rounds; i++)
+		for (n = 0; n < words->count; n++)
+			found += findHashEntry(&hash_tab, words->names[n]);
+	result->ns_per_find = (elapsedSeconds() - start) * 1e9 / ((double) rounds * words->count);
+
+	if (found != (unsigned long) rounds * words->count)
+		printf("Error: %s table of %d buckets lost words\n",
+			   hash_names[result->hash_fn], result->size);
+
+	freeHashTable(&hash_tab);
+}
+
+/* This function is the body of each sweep thread.  It claims tables one
+/* at a time and builds and measures each.
+/* It expects arg to point to the shared jobs, and returns NULL.
+*/
+void *
+sweepWorker(void *arg)
+{
+	SWEEP_JOBS *jobs = (SWEEP_JOBS *) arg;
+	int job;
+
+	while ((job = atomic_fetch_add(&jobs->next, 1)) < jobs->njobs)
+		sweepTable(jobs->words, &jobs->results[job]);
+
+	return NULL;
+}
+
+/* This function builds a table from the word file for every size from
+/* min_size to max_size, in steps of step, with every hash function, or
+/* only hash_fn if it isn't -1.  The tables are built on nthreads
+/* threads.  For each it prints the collisions, the longest chain, the
+/* most buckets a search looked in, the memory used and the time per
+/* search.
+/* 
+/* It then recommends, for each hash function, the smallest size whose
+/* collisions are at most target, and the best of those overall.
+/* 
+/* A min_size of 0 stands for the number of words, and a max_size of 0
+/* for eight times that.
+*/
+void
+runSizeSweep(char *word_filename, int min_size, int max_size, int step, int hash_fn,
+			 unsigned long target, int nthreads)
+{
+	FILE_LIST words = { NULL, 0, 0, 0 };
+	SWEEP_JOBS jobs;
+	SWEEP_RESULT *result, *best = NULL;
+	SWEEP_RESULT *smallest[HASH_FUNCTIONS];
+	pthread_t *threads;
+	int first_fn, last_fn, sizes, fn, i;
+	double start;
+
+	readWordList(word_filename, &words);
+	if (words.count == 0) {
+		printf("No words in %s\n", word_filename);
+		return;
+	}
+
+	if (min_size <= 0)
+		min_size = words.count;
+	if (max_size <= 0)
+		max_size = (words.count <= MAXHASHSIZE / 8) ? words.count * 8 : MAXHASHSIZE;
+	if (max_size > MAXHASHSIZE)
+		max_size = MAXHASHSIZE;
+	if (step <= 0)
+		step = 1;
+	if (max_size < min_size) {
+		printf("No sizes from %d to %d\n", min_size, max_size);
+		return;
+	}
+
+	first_fn = (hash_fn < 0) ? 0 : hash_fn;
+	last_fn  = (hash_fn < 0) ? HASH_FUNCTIONS - 1 : hash_fn;
+	sizes = (max_size - min_size) / step + 1;
+
+	jobs.words = &words;
+	jobs.njobs = sizes * (last_fn - first_fn + 1);
+	atomic_init(&jobs.next, 0);
+	if ((jobs.results = (SWEEP_RESULT *) calloc(jobs.njobs, sizeof(SWEEP_RESULT))) == NULL) {
+		printf("Error: Unable to allocate sweep storage\n");
+		exit(-1);
+	}
+
+	for (fn = first_fn; fn <= last_fn; fn++)
+		for (i = 0; i < sizes; i++) {
+			result = &jobs.results[(fn - first_fn) * sizes + i];
+			result->size = min_size + i * step;
+			result->hash_fn = fn;
+		}
+
+	/** No point in more threads than tables...
+	 **/
+	if (nthreads > jobs.njobs)
+		nthreads = jobs.njobs;
+	if ((threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t))) == NULL) {
+		printf("Error: Unable to allocate sweep storage\n");
+		exit(-1);
+	}
+
+	start = elapsedSeconds();
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, sweepWorker, &jobs) != 0) {
+			printf("Error: Unable to start sweep thread\n");
+			exit(-1);
+		}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("%d words from %s, %d tables on %d threads in %.3f s\n\n", words.count,
+		   word_filename, jobs.njobs, nthreads, elapsedSeconds() - start);
+
+	printf("      Size\tHash    \tCollisions\tLongest\tProbes\t     Bytes\tns/find\n");
+	printf("==========\t========\t==========\t=======\t======\t==========\t=======\n");
+	for (i = 0; i < jobs.njobs; i++) {
+		result = &jobs.results[i];
+		printf("%10d\t%-8s\t%10lu\t%7lu\t%6lu\t%10lu\t%7.1f\n", result->size,
+			   hash_names[result->hash_fn], result->collisions, result->longest,
+			   result->max_probes, (unsigned long) result->bytes, result->ns_per_find);
+	}
+
+	/** The smallest size that meets the target, for each function...
+	 **/
+	printf("\nSmallest size with at most %lu collisions:\n", target);
+	for (fn = first_fn; fn <= last_fn; fn++) {
+		smallest[fn] = NULL;
+		for (i = 0; i < sizes && smallest[fn] == NULL; i++) {
+			result = &jobs.results[(fn - first_fn) * sizes + i];
+			if (result->collisions <= target)
+				smallest[fn] = result;
+		}
+
+		if (smallest[fn] == NULL) {
+			printf("   %-8s  none up to %d\n", hash_names[fn], max_size);
+			continue;
+		}
+		printf("   %-8s  %10d  (%.1f ns/find)\n", hash_names[fn], smallest[fn]->size,
+			   smallest[fn]->ns_per_find);
+
+		if (best == NULL || smallest[fn]->size < best->size ||
+			(smallest[fn]->size == best->size && smallest[fn]->ns_per_find < best->ns_per_find))
+			best = smallest[fn];
+	}
+
+	if (best != NULL)
+		printf("\nRecommended: -size %d -hash %s\n", best->size, hash_names[best->hash_fn]);
+	else
+		printf("\nNo size from %d to %d meets the target\n", min_size, max_size);
+
+	free(threads);
+	free(jobs.results);
+	for (i = 0; i < words.count; i++)
+		free(words.names[i]);
+	free(words.names);
+} /* End runSizeSweep. */
+
+/*********************************************************
+ **                                                     **
+ **                   Bloom Filters                     **
+ **                                                     **
+ *********************************************************/
+
+/* This function hashes a word to 64 bits for a Bloom filter: FNV-1a,
+/* with the bits mixed afterwards so that the high ones, which pick the
+/* block, depend on every character.
+*/
+uint64_t
+bloomHash(char *key)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for (; *key != '\0'; key++)
+		h = (h ^ (unsigned char) *key) * 1099511628211ULL;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* This function sizes a Bloom filter for nkeys words at a false-positive
+/* rate of fpr, allocates it and clears it.  A plain Bloom filter needs
+/* 1.44 log2(1/fpr) bits a word; keeping each word's bits in one block
+/* costs a little more, so a tenth is added.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+initBloomFilter(BLOOM_FILTER *bloom, unsigned long nkeys, double fpr)
+{
+	double bits_per_key;
+
+	if (fpr <= 0.0 || fpr >= 1.0)
+		fpr = 0.01;
+	if (nkeys == 0)
+		nkeys = 1;
+
+	bits_per_key = 1.1 * log2(1.0 / fpr) / M_LN2;
+
+	bloom->fpr = fpr;
+	bloom->nhashes = (int) (bits_per_key * M_LN2 + 0.5);
+	if (bloom->nhashes < 1)
+		bloom->nhashes = 1;
+	if (bloom->nhashes > BLOOM_MAXHASHES)
+		bloom->nhashes = BLOOM_MAXHASHES;
+
+	bloom->nblocks = (uint64_t) (nkeys * bits_per_key) / BLOOM_BLOCKBITS + 1;
+	bloom->block = (uint64_t *) aligned_alloc(CACHE_LINESIZE,
+											  bloom->nblocks * BLOOM_BLOCKWORDS * sizeof(uint64_t));
+	if (bloom->block == NULL) {
+		printf("Error: Unable to allocate filter storage\n");
+		exit(-1);
+	}
+	memset(bloom->block, 0, bloom->nblocks * BLOOM_BLOCKWORDS * sizeof(uint64_t));
+}
+
+/* This function releases the blocks of a Bloom filter.
+*/
+void
+freeBloomFilter(BLOOM_FILTER *bloom)
+{
+	free(bloom->block);
+	bloom->block = NULL;
+}
+
+/* This function stirs a Bloom filter hash (the splitmix64 finalizer).
+/* Successive bit positions within a block are cut from the results of
+/* stirring the hash plus successive multiples of a constant.  Stepping
+/* through the block by a fixed stride instead would let words share
+/* runs of bits and raise the false-positive rate several times over.
+*/
+uint64_t
+bloomMix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* This function sets a word's bits in a Bloom filter.  The high half
+/* of the hash picks the block; bloomMix() picks the bits within it.
+*/
+void
+bloomAdd(BLOOM_FILTER *bloom, char *key)
+{
+	uint64_t h = bloomHash(key);
+	uint64_t *block = bloom->block + ((h >> 32) * bloom->nblocks >> 32) * BLOOM_BLOCKWORDS;
+	uint64_t bits = 0;
+	unsigned bit;
+	int i;
+
+	for (i = 0; i < bloom->nhashes; i++) {
+		if (i % BLOOM_BITSPERMIX == 0)
+			bits = bloomMix(h += 0x9E3779B97F4A7C15ULL);
+		bit = bits % BLOOM_BLOCKBITS;
+		bits /= BLOOM_BLOCKBITS;
+		block[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+/* This function tells whether a word may be in a Bloom filter.
+/* It returns 0 if the word was certainly never added, and 1 if it may
+/* have been.
+*/
+int
+bloomMayContain(BLOOM_FILTER *bloom, char *key)
+{
+	uint64_t h = bloomHash(key);
+	uint64_t *block = bloom->block + ((h >> 32) * bloom->nblocks >> 32) * BLOOM_BLOCKWORDS;
+	uint64_t bits = 0;
+	unsigned bit;
+	int i;
+
+	for (i = 0; i < bloom->nhashes; i++) {
+		if (i % BLOOM_BITSPERMIX == 0)
+			bits = bloomMix(h += 0x9E3779B97F4A7C15ULL);
+		bit = bits % BLOOM_BLOCKBITS;
+		bits /= BLOOM_BLOCKBITS;
+		if ((block[bit / 64] & (1ULL << (bit % 64))) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+/* This function builds a Bloom filter over every word already in the
+/* table and hangs it on the table, replacing any filter it had.  From
+/* then on findHashEntry() asks the filter first and addHashEntry()
+/* keeps it up to date; words added later than this raise the rate of
+/* false positives past fpr, but never cause a word to be missed.
+/* It expects the address of the table and the false-positive rate.
+*/
+void
+buildHashFilter(HASH_TAB *hash_tab, double fpr)
+{
+	NODE_PTR node_ptr;
+	unsigned long nwords = 0;
+	int i;
+
+	if (hash_tab->bloom != NULL)
+		freeBloomFilter(hash_tab->bloom);
+	else if ((hash_tab->bloom = (BLOOM_FILTER *) malloc(sizeof(BLOOM_FILTER))) == NULL) {
+		printf("Error: Unable to allocate filter storage\n");
+		exit(-1);
+	}
+
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			nwords++;
+
+	initBloomFilter(hash_tab->bloom, nwords, fpr);
+
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			bloomAdd(hash_tab->bloom, node_ptr->line_text);
+}
+
+/* This function times a stream of FBENCH_QUERIES searches, of which
+/* FBENCH_HIT_PERCENT percent are for words in the table and the rest
+/* for words that aren't, first without a filter and then with filters
+/* at several false-positive rates.  For each it prints the filter's
+/* size, the search time, and the share of missing words the filter let
+/* through.  The table is left without a filter.
+*/
+void
+runFilterBenchmark(HASH_TAB *hash_tab)
+{
+	static double rates[] = { 0.0, 0.1, 0.01, 0.001, 0.0001 };
+	char **present, **absent, **queries;
+	NODE_PTR node_ptr;
+	unsigned long found, passed, nabsent;
+	uint64_t seed = 0x9E3779B97F4A7C15ULL, r;
+	double start, seconds;
+	int npresent = 0, i, n;
+
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			npresent++;
+
+	present = (char **) malloc((npresent + 1) * sizeof(char *));
+	absent  = (char **) malloc(FBENCH_MISSWORDS * sizeof(char *));
+	queries = (char **) malloc(FBENCH_QUERIES * sizeof(char *));
+	if (!present || !absent || !queries) {
+		printf("Error: Unable to allocate benchmark storage\n");
+		exit(-1);
+	}
+
+	n = 0;
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			present[n++] = node_ptr->line_text;
+	if (npresent == 0)
+		present[npresent++] = "";
+
+	for (i = 0; i < FBENCH_MISSWORDS; i++) {
+		char word[MAXARRAY];
+
+		sprintf(word, "token_%d", i);
+		absent[i] = stringDup(word);
+	}
+
+	/** Lay the stream out ahead of time, so only searching is timed...
+	 **/
+	for (i = 0; i < FBENCH_QUERIES; i++) {
+		r = nextRandom(&seed);
+		if (r % 100 < FBENCH_HIT_PERCENT)
+			queries[i] = present[(r >> 8) % npresent];
+		else
+			queries[i] = absent[(r >> 8) % FBENCH_MISSWORDS];
+	}
+
+	hash_tab->stats.enabled = FALSE;
+
+	printf("%d words, %d queries, %d%% of them for words in the table\n\n",
+		   npresent, FBENCH_QUERIES, FBENCH_HIT_PERCENT);
+	printf("Filter FPR\t   Bytes\tHashes\tns/query\tMisses let through\n");
+	printf("==========\t========\t======\t========\t==================\n");
+
+	for (n = 0; n < (int) (sizeof(rates) / sizeof(rates[0])); n++) {
+		if (rates[n] > 0.0)
+			buildHashFilter(hash_tab, rates[n]);
+
+		found = 0;
+		start = elapsedSeconds();
+		for (i = 0; i < FBENCH_QUERIES; i++)
+			found += findHashEntry(hash_tab, queries[i]);
+		seconds = elapsedSeconds() - start;
+
+		if (rates[n] == 0.0) {
+			printf("      none\t%8d\t     -\t%8.1f\t%17.2f%%\t(%lu found)\n", 0,
+				   seconds * 1e9 / FBENCH_QUERIES, 100.0, found);
+			continue;
+		}
+
+		passed = 0;
+		for (nabsent = 0; nabsent < FBENCH_MISSWORDS; nabsent++)
+			passed += bloomMayContain(hash_tab->bloom, absent[nabsent]);
+
+		printf("%10g\t%8lu\t%6d\t%8.1f\t%17.2f%%\t(%lu found)\n", rates[n],
+			   (unsigned long) (hash_tab->bloom->nblocks * BLOOM_BLOCKWORDS * sizeof(uint64_t)),
+			   hash_tab->bloom->nhashes, seconds * 1e9 / FBENCH_QUERIES,
+			   100.0 * passed / FBENCH_MISSWORDS, found);
+	}
+
+	/** Leave the table as it was found...
+	 **/
+	freeBloomFilter(hash_tab->bloom);
+	free(hash_tab->bloom);
+	hash_tab->bloom = NULL;
+	hash_tab->stats.enabled = TRUE;
+
+	for (i = 0; i < FBENCH_MISSWORDS; i++)
+		free(absent[i]);
+	free(present);
+	free(absent);
+	free(queries);
+} /* End runFilterBenchmark. */
+
+/*********************************************************
+ **                                                     **
+ **                    Bulk Loading                     **
+ **                                                     **
+ *********************************************************/
+
+/* This function finds the smallest prime at least as big as n, for
+/* sizing tables.  Trial division is plenty at table sizes.
+*/
+int
+nextPrime(int n)
+{
+	int d;
+
+	if (n <= 2)
+		return 2;
+
+	for (n |= 1; ; n += 2) {
+		for (d = 3; d <= n / d; d += 2)
+			if (n % d == 0)
+				break;
+		if (d > n / d)
+			return n;
+	}
+}
+
+/*********************************************************
+ **                                                     **
+ **                   Prefix Searches                   **
+ **                                                     **
+ *********************************************************/
+
+/* This function builds a prefix index over every word already in the
+/* table and hangs it on the table, replacing any it had.  From then on
+/* addHashEntry() keeps it in order.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+buildPrefixIndex(HASH_TAB *hash_tab)
+{
+	PREFIX_INDEX *prefix;
+	NODE_PTR node_ptr;
+	unsigned long n = 0;
+	int i;
+
+	if ((prefix = hash_tab->prefix) != NULL)
+		freePrefixIndex(prefix);
+	else if ((prefix = (PREFIX_INDEX *) malloc(sizeof(PREFIX_INDEX))) == NULL) {
+		printf("Error: Unable to allocate prefix index storage\n");
+		exit(-1);
+	}
+	hash_tab->prefix = prefix;
+
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			n++;
+
+	prefix->count = 0;
+	prefix->capacity = n ? n : 1;
+	if ((prefix->word = (NODE_PTR *) malloc(prefix->capacity * sizeof(NODE_PTR))) == NULL) {
+		printf("Error: Unable to allocate prefix index storage\n");
+		exit(-1);
+	}
+
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			prefix->word[prefix->count++] = node_ptr;
+
+	qsort(prefix->word, prefix->count, sizeof(NODE_PTR), compareNodeText);
+}
+
+/* This function releases the array of a prefix index.
+*/
+void
+freePrefixIndex(PREFIX_INDEX *prefix)
+{
+	free(prefix->word);
+	prefix->word = NULL;
+	prefix->count = prefix->capacity = 0;
+}
+
+/* This function adds a word to a prefix index, in its sorted place.
+/* Words after it move up one, so this suits words added now and then,
+/* not bulk loading; buildPrefixIndex() is for that.
+*/
+void
+addPrefixEntry(PREFIX_INDEX *prefix, NODE_PTR node_ptr)
+{
+	unsigned long at = prefixLowerBound(prefix, node_ptr->line_text);
+
+	if (prefix->count == prefix->capacity) {
+		prefix->capacity *= 2;
+		prefix->word = (NODE_PTR *) realloc(prefix->word, prefix->capacity * sizeof(NODE_PTR));
+		if (prefix->word == NULL) {
+			printf("Error: Unable to allocate prefix index storage\n");
+			exit(-1);
+		}
+	}
+
+	memmove(prefix->word + at + 1, prefix->word + at, (prefix->count - at) * sizeof(NODE_PTR));
+	prefix->word[at] = node_ptr;
+	prefix->count++;
+}
+
+/* This function takes a word out of a prefix index, closing the gap it
+/* leaves.  Nothing is done if the node isn't in the index.
+*/
+void
+removePrefixEntry(PREFIX_INDEX *prefix, NODE_PTR node_ptr)
+{
+	unsigned long at = prefixLowerBound(prefix, node_ptr->line_text);
+
+	while (at < prefix->count && prefix->word[at] != node_ptr &&
+		   strcmp(prefix->word[at]->line_text, node_ptr->line_text) == 0)
+		at++;
+	if (at == prefix->count || prefix->word[at] != node_ptr)
+		return;
+
+	memmove(prefix->word + at, prefix->word + at + 1,
+			(prefix->count - at - 1) * sizeof(NODE_PTR));
+	prefix->count--;
+}
+
+/* This function binary searches a prefix index for the first word not
+/* less than key.  Every word starting with key, if there are any, sits
+/* from there on.
+/* It returns the position, which is count if every word is less.
+*/
+unsigned long
+prefixLowerBound(PREFIX_INDEX *prefix, char *key)
+{
+	unsigned long low = 0, high = prefix->count, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (strcmp(prefix->word[mid]->line_text, key) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/* This function finds the words in the table that start with a prefix,
+/* in sorted order, using the table's prefix index.  The first k are
+/* put in matches, and the number there are in all in *total; a second
+/* binary search finds the end of the run, so counting costs no more
+/* than listing.
+/* It returns the number of words put in matches, or 0 if the table has
+/* no prefix index.
+*/
+int
+findHashPrefix(HASH_TAB *hash_tab, char *key, NODE_PTR *matches, int k,
+			   unsigned long *total)
+{
+	PREFIX_INDEX *prefix = hash_tab->prefix;
+	unsigned long first, low, high, mid;
+	size_t len = strlen(key);
+	int n;
+
+	*total = 0;
+	if (prefix == NULL)
+		return 0;
+
+	first = prefixLowerBound(prefix, key);
+
+	/** The run ends at the first word that doesn't start with key...
+	 **/
+	low = first;
+	high = prefix->count;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (strncmp(prefix->word[mid]->line_text, key, len) == 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	*total = low - first;
+
+	for (n = 0; n < k && (unsigned long) n < *total; n++)
+		matches[n] = prefix->word[first + n];
+
+	return n;
+}
+
+/*********************************************************
+ **                                                     **
+ **                   Fuzzy Searches                    **
+ **                                                     **
+ *********************************************************/
+
+/* This function measures the edit (Damerau-Levenshtein) distance
+/* between two strings: the fewest characters inserted, deleted or
+/* replaced, or pairs of adjacent characters swapped, to turn one into
+/* the other.  Swaps count as one edit because they are the commonest
+/* typing slip ("retrun").  Unlike the cheaper restricted form, this
+/* distance obeys the triangle inequality, which the BK-tree relies on.
+/* 
+/* The table is kept with a border row and column of the largest
+/* possible distance, so that the swap lookback never needs a test.
+*/
+int
+editDistance(const char *a, const char *b)
+{
+	int short_table[(MAXARRAY + 2) * (MAXARRAY + 2)];
+	int last_row[256];		/* Last row each character was seen in */
+	int *table = short_table, *big_table = NULL, *prev, *cur;
+	int alen = strlen(a), blen = strlen(b);
+	int width = blen + 2, inf = alen + blen;
+	int i, j, i1, j1, last_col, swap, d;
+
+#define DIST(i, j)  table[((i) + 1) * width + (j) + 1]
+
+	if (alen > MAXARRAY || blen > MAXARRAY) {
+		if ((big_table = (int *) malloc((size_t) (alen + 2) * width * sizeof(int))) == NULL) {
+			printf("Error: Unable to allocate edit distance storage\n");
+			exit(-1);
+		}
+		table = big_table;
+	}
+
+	memset(last_row, 0, sizeof(last_row));
+	DIST(-1, -1) = inf;
+	for (i = 0; i <= alen; i++) {
+		DIST(i, -1) = inf;
+		DIST(i, 0) = i;
+	}
+	for (j = 0; j <= blen; j++) {
+		DIST(-1, j) = inf;
+		DIST(0, j) = j;
+	}
+
+	for (i = 1; i <= alen; i++) {
+		prev = &DIST(i - 1, 0);
+		cur  = &DIST(i, 0);
+		last_col = 0;
+		for (j = 1; j <= blen; j++) {
+			i1 = last_row[(unsigned char) b[j - 1]];
+			j1 = last_col;
+			if (a[i - 1] == b[j - 1]) {
+				d = prev[j - 1];									/* Match */
+				last_col = j;
+			} else {
+				d = prev[j - 1] + 1;								/* Replace */
+				if (cur[j - 1] + 1 < d)
+					d = cur[j - 1] + 1;								/* Insert */
+				if (prev[j] + 1 < d)
+					d = prev[j] + 1;								/* Delete */
+			}
+			swap = DIST(i1 - 1, j1 - 1) + (i - i1) + (j - j1) - 1;
+			cur[j] = (swap < d) ? swap : d;							/* Swap */
+		}
+		last_row[(unsigned char) a[i - 1]] = i;
+	}
+
+	d = DIST(alen, blen);
+#undef DIST
+
+	free(big_table);
+	return d;
+}
+
+/* This function builds a BK-tree over every word already in the table
+/* and hangs it on the table, replacing any it had.  From then on
+/* addHashEntry() adds new words to it.
+/* It expects the address of the table and the distance the query
+/* prompt should allow.
+*/
+void
+buildFuzzyIndex(HASH_TAB *hash_tab, int max_distance)
+{
+	FUZZY_INDEX *fuzzy;
+	NODE_PTR node_ptr;
+	int i;
+
+	if ((fuzzy = hash_tab->fuzzy) != NULL)
+		arenaFree(&fuzzy->arena);
+	else if ((fuzzy = (FUZZY_INDEX *) malloc(sizeof(FUZZY_INDEX))) == NULL) {
+		printf("Error: Unable to allocate fuzzy index storage\n");
+		exit(-1);
+	}
+	hash_tab->fuzzy = fuzzy;
+
+	fuzzy->root = NULL;
+	fuzzy->arena.head  = NULL;
+	fuzzy->arena.bytes = 0;
+	fuzzy->count = 0;
+	fuzzy->max_distance = max_distance;
+
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			addFuzzyEntry(fuzzy, node_ptr);
+}
+
+/* This function adds a word to a BK-tree.  Starting at the root, it
+/* measures the word's distance from each node's word and goes down to
+/* the child at that distance, until there is no such child; the word
+/* becomes that child.  A word already in the tree is not added again.
+*/
+void
+addFuzzyEntry(FUZZY_INDEX *fuzzy, NODE_PTR node_ptr)
+{
+	BK_NODE *bk, *child, *new_bk;
+	int d;
+
+	if ((new_bk = (BK_NODE *) arenaAlloc(&fuzzy->arena, sizeof(BK_NODE))) == NULL) {
+		printf("Error: Unable to allocate fuzzy index storage\n");
+		exit(-1);
+	}
+	new_bk->word = node_ptr;
+	new_bk->child = NULL;
+	new_bk->sibling = NULL;
+	new_bk->distance = 0;
+
+	if ((bk = fuzzy->root) == NULL) {
+		fuzzy->root = new_bk;
+		fuzzy->count++;
+		return;
+	}
+
+	for (;;) {
+		if ((d = editDistance(node_ptr->line_text, bk->word->line_text)) == 0)
+			return;
+
+		for (child = bk->child; child != NULL && child->distance != d; child = child->sibling)
+			;
+		if (child == NULL)
+			break;
+		bk = child;
+	}
+
+	new_bk->distance = d;
+	new_bk->sibling = bk->child;
+	bk->child = new_bk;
+	fuzzy->count++;
+}
+
+/* This function compares two fuzzy matches for qsort(): nearest first,
+/* then in alphabetical order.
+*/
+int
+compareFuzzyMatch(const void *a, const void *b)
+{
+	const FUZZY_MATCH *x = (const FUZZY_MATCH *) a;
+	const FUZZY_MATCH *y = (const FUZZY_MATCH *) b;
+
+	if (x->distance != y->distance)
+		return x->distance - y->distance;
+	return strcmp(x->word->line_text, y->word->line_text);
+}
+
+/* This function finds the words in the table within max_distance edits
+/* of key, using the table's fuzzy index.  The nearest max_matches are
+/* put in matches, nearest first, and the number found in all in *total.
+/* 
+/* The tree is walked from the root with a stack.  A node at distance d
+/* from key can only have descendants within max_distance of key along
+/* the children whose distance lies in d - max_distance through
+/* d + max_distance, so only those are pushed.
+/* 
+/* It returns the number of words put in matches, or 0 if the table has
+/* no fuzzy index.
+*/
+int
+findHashFuzzy(HASH_TAB *hash_tab, char *key, int max_distance, FUZZY_MATCH *matches,
+			  int max_matches, unsigned long *total)
+{
+	FUZZY_INDEX *fuzzy = hash_tab->fuzzy;
+	BK_NODE **stack = NULL, *bk, *child;
+	FUZZY_MATCH *found = NULL;
+	unsigned long nstack = 0, stack_size = 0, nfound = 0, found_size = 0;
+	int d, n;
+
+	*total = 0;
+	if (fuzzy == NULL || fuzzy->root == NULL)
+		return 0;
+
+	stack_size = 64;
+	if ((stack = (BK_NODE **) malloc(stack_size * sizeof(BK_NODE *))) == NULL) {
+		printf("Error: Unable to allocate fuzzy search storage\n");
+		exit(-1);
+	}
+	stack[nstack++] = fuzzy->root;
+
+	while (nstack > 0) {
+		bk = stack[--nstack];
+		d = editDistance(key, bk->word->line_text);
+
+		/** A deleted word stays in the tree to hold its children; it
+		 ** just isn't a match any more...
+		 **/
+		if (d <= max_distance &&
+			(hash_tab->stats.deletes == 0 ||
+			 findHashNode(hash_tab, bk->word->line_text) == bk->word)) {
+			if (nfound == found_size) {
+				found_size = found_size ? found_size * 2 : 16;
+				if ((found = (FUZZY_MATCH *) realloc(found, found_size * sizeof(FUZZY_MATCH))) == NULL) {
+					printf("Error: Unable to allocate fuzzy search storage\n");
+					exit(-1);
+				}
+			}
+			found[nfound].word = bk->word;
+			found[nfound].distance = d;
+			nfound++;
+		}
+
+		for (child = bk->child; child != NULL; child = child->sibling) {
+			if (child->distance < d - max_distance || child->distance > d + max_distance)
+				continue;
+
+			if (nstack == stack_size) {
+				stack_size *= 2;
+				if ((stack = (BK_NODE **) realloc(stack, stack_size * sizeof(BK_NODE *))) == NULL) {
+					printf("Error: Unable to allocate fuzzy search storage\n");
+					exit(-1);
+				}
+			}
+			stack[nstack++] = child;
+		}
+	}
+
+	qsort(found, nfound, sizeof(FUZZY_MATCH), compareFuzzyMatch);
+	for (n = 0; n < max_matches && (unsigned long) n < nfound; n++)
+		matches[n] = found[n];
+	*total = nfound;
+
+	free(stack);
+	free(found);
+	return n;
+}
+
+/*********************************************************
+ **                                                     **
+ **                  Keyword Scanning                   **
+ **                                                     **
+ *********************************************************/
+
+/* This function builds an Aho-Corasick automaton over every word in a
+/* table.  The words go into a trie first, whose missing transitions
+/* are then filled in breadth first from each state's failure state, so
+/* that the finished table never needs the failure links again.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+buildScanAutomaton(HASH_TAB *hash_tab, AC_AUTOMATON *ac)
+{
+	NODE_PTR node_ptr;
+	uint32_t *fail, *queue, head = 0, tail = 0;
+	uint32_t state, next, t;
+	unsigned long max_states = 1;
+	size_t rows;
+	const unsigned char *p;
+	int i, c, n;
+
+	memset(ac->class_of, 0, sizeof(ac->class_of));
+	ac->nclasses = 1;
+	ac->longest = 0;
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+			for (p = (const unsigned char *) node_ptr->line_text; *p != '\0'; p++) {
+				if (ac->class_of[*p] == 0)
+					ac->class_of[*p] = ac->nclasses++;
+				max_states++;
+			}
+			if ((size_t) (p - (const unsigned char *) node_ptr->line_text) > ac->longest)
+				ac->longest = p - (const unsigned char *) node_ptr->line_text;
+		}
+	n = ac->nclasses;
+
+	if ((unsigned long long) max_states * n >= AC_MATCH) {
+		printf("Error: Too many words to scan for\n");
+		exit(-1);
+	}
+	rows = (size_t) max_states * n;
+	if ((ac->delta = (uint32_t *) calloc(rows, sizeof(uint32_t))) == NULL ||
+		(ac->word = (NODE_PTR *) calloc(max_states, sizeof(NODE_PTR))) == NULL ||
+		(ac->link = (uint32_t *) calloc(max_states, sizeof(uint32_t))) == NULL ||
+		(fail = (uint32_t *) malloc(max_states * sizeof(uint32_t))) == NULL ||
+		(queue = (uint32_t *) malloc(max_states * sizeof(uint32_t))) == NULL) {
+		printf("Error: Unable to allocate scanning automaton storage\n");
+		exit(-1);
+	}
+
+	/** Build the trie.  Transitions hold row offsets, and 0 (the root)
+	 ** means no child, since the root is nobody's child...
+	 **/
+	ac->nstates = 1;
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+			if (node_ptr->line_text[0] == '\0')
+				continue;
+			state = 0;
+			for (p = (const unsigned char *) node_ptr->line_text; *p != '\0'; p++) {
+				if (ac->delta[state + ac->class_of[*p]] == 0)
+					ac->delta[state + ac->class_of[*p]] = ac->nstates++ * n;
+				state = ac->delta[state + ac->class_of[*p]];
+			}
+			ac->word[state / n] = node_ptr;
+		}
+
+	/** Fill in the rest breadth first.  A state's failure state is
+	 ** shallower, so its row is already complete when it is copied
+	 ** from...
+	 **/
+	for (c = 0; c < n; c++)
+		if ((next = ac->delta[c]) != 0) {
+			fail[next / n] = 0;
+			queue[tail++] = next;
+		}
+	while (head < tail) {
+		state = queue[head++];
+		for (c = 0; c < n; c++) {
+			next = ac->delta[state + c];
+			if (next == 0) {
+				ac->delta[state + c] = ac->delta[fail[state / n] + c];
+				continue;
+			}
+			t = fail[next / n] = ac->delta[fail[state / n] + c];
+			ac->link[next / n] = (ac->word[t / n] != NULL) ? t / n : ac->link[t / n];
+			queue[tail++] = next;
+		}
+	}
+
+	/** Flag the transitions into states where some word ends...
+	 **/
+	for (rows = 0; rows < (size_t) ac->nstates * n; rows++) {
+		t = ac->delta[rows] / n;
+		if (ac->word[t] != NULL || ac->link[t] != 0)
+			ac->delta[rows] |= AC_MATCH;
+	}
+
+	free(fail);
+	free(queue);
+}
+
+/* This function releases the tables of an Aho-Corasick automaton.
+*/
+void
+freeScanAutomaton(AC_AUTOMATON *ac)
+{
+	free(ac->delta);
+	free(ac->word);
+	free(ac->link);
+	ac->delta = NULL;
+	ac->word  = NULL;
+	ac->link  = NULL;
+}
+
+/* This function reports the words ending at offset i of a buffer,
+/* where the automaton has just entered state, longest first, calling
+/* visit with the word and the offset it starts at for each.  A word
+/* counts as whole unless an identifier character both ends it and comes
+/* right after it, or both starts it and comes right before it, so "int"
+/* is not found in "print" but "->" is found in "p->next".
+/* char_class[] must be set up by initCharClasses() first.
+/* It returns the number of words reported.
+*/
+unsigned long
+scanMatches(AC_AUTOMATON *ac, const unsigned char *text, size_t len, uint32_t state,
+			size_t i, MATCH_VISITOR visit, void *arg)
+{
+	unsigned long matches = 0;
+	NODE_PTR word;
+	size_t start;
+	uint32_t s;
+
+	for (s = state / ac->nclasses; s != 0; s = ac->link[s]) {
+		if ((word = ac->word[s]) == NULL)
+			continue;
+		start = i + 1 - strlen(word->line_text);
+		if (start > 0 && (char_class[text[start - 1]] & CC_IDENT) &&
+			(char_class[text[start]] & CC_IDENT))
+			continue;
+		if (i + 1 < len && (char_class[text[i + 1]] & CC_IDENT) &&
+			(char_class[text[i]] & CC_IDENT))
+			continue;
+		visit(word, start, arg);
+		matches++;
+	}
+	return matches;
+}
+
+/* This function finds every whole-word occurrence of every word of an
+/* automaton in a buffer, calling visit for each in order of where they
+/* end, as scanMatches() describes.
+/* 
+/* The buffer is taken in blocks of AC_LANES lanes, walked side by side.
+/* The first lane carries on from where the last block ended; the others
+/* start from the root a word's length early, which brings them to the
+/* state a single walk would be in by the time their own text begins.
+/* Flagged states are noted per lane and reported lane by lane once the
+/* block is done, so the matches come out in order.  Buffers too short
+/* for that to pay are walked in one lane.
+/* It returns the number of matches.
+*/
+unsigned long
+scanBuffer(AC_AUTOMATON *ac, const char *buf, size_t len, MATCH_VISITOR visit, void *arg)
+{
+	const uint32_t *delta = ac->delta;
+	const unsigned char *class_of = ac->class_of;
+	const unsigned char *text = (const unsigned char *) buf;
+	const unsigned char *lane_text[AC_LANES];
+	const unsigned char *q;
+	uint32_t state = 0, next, lane_state[AC_LANES];
+	uint32_t s0, s1, s2, s3, n0, n1, n2, n3;
+	AC_HIT *hits, *lane_hits[AC_LANES];
+	size_t nhits[AC_LANES], lane_len, block, base, j, p, warm;
+	unsigned long matches = 0;
+	int k;
+
+	if (ac->nstates <= 1)
+		return 0;
+	warm = ac->longest - 1;
+
+	if ((hits = (AC_HIT *) malloc(AC_LANES * (AC_LANESIZE + AC_LANES) * sizeof(AC_HIT))) == NULL) {
+		printf("Error: Unable to allocate scan storage\n");
+		exit(-1);
+	}
+	for (k = 0; k < AC_LANES; k++)
+		lane_hits[k] = hits + k * (AC_LANESIZE + AC_LANES);
+
+	for (base = 0; base < len; base += block) {
+		block = len - base;
+		if (block > AC_LANES * AC_LANESIZE)
+			block = AC_LANES * AC_LANESIZE;
+		lane_len = block / AC_LANES;
+
+		/** Walk a short block in one lane...
+		 **/
+		if (lane_len <= 4 * warm || lane_len < 64) {
+			for (p = base; p < base + block; p++) {
+				next = delta[state + class_of[text[p]]];
+				state = next & ~AC_MATCH;
+				if (next & AC_MATCH)
+					matches += scanMatches(ac, text, len, state, p, visit, arg);
+			}
+			continue;
+		}
+
+		/** Bring each lane but the first up to speed...
+		 **/
+		for (k = 0; k < AC_LANES; k++) {
+			lane_text[k] = text + base + k * lane_len;
+			lane_state[k] = state;
+			nhits[k] = 0;
+			if (k == 0)
+				continue;
+			lane_state[k] = 0;
+			for (q = lane_text[k] - warm; q < lane_text[k]; q++)
+				lane_state[k] = delta[lane_state[k] + class_of[*q]] & ~AC_MATCH;
+		}
+
+		/** Walk the lanes side by side, the last one on to the end of
+		 ** the block.  The states are kept in locals so they can stay in
+		 ** registers...
+		 **/
+		s0 = lane_state[0];
+		s1 = lane_state[1];
+		s2 = lane_state[2];
+		s3 = lane_state[3];
+		for (j = 0; j < lane_len; j++) {
+			n0 = delta[s0 + class_of[lane_text[0][j]]];
+			n1 = delta[s1 + class_of[lane_text[1][j]]];
+			n2 = delta[s2 + class_of[lane_text[2][j]]];
+			n3 = delta[s3 + class_of[lane_text[3][j]]];
+			s0 = n0 & ~AC_MATCH;
+			s1 = n1 & ~AC_MATCH;
+			s2 = n2 & ~AC_MATCH;
+			s3 = n3 & ~AC_MATCH;
+			if (!((n0 | n1 | n2 | n3) & AC_MATCH))
+				continue;
+
+			lane_state[0] = n0;
+			lane_state[1] = n1;
+			lane_state[2] = n2;
+			lane_state[3] = n3;
+			for (k = 0; k < AC_LANES; k++)
+				if (lane_state[k] & AC_MATCH) {
+					lane_hits[k][nhits[k]].state = lane_state[k] & ~AC_MATCH;
+					lane_hits[k][nhits[k]].pos = j;
+					nhits[k]++;
+				}
+		}
+		lane_state[AC_LANES - 1] = s3;
+
+		for (k = AC_LANES - 1; j < block - k * lane_len; j++) {
+			next = delta[lane_state[k] + class_of[lane_text[k][j]]];
+			lane_state[k] = next & ~AC_MATCH;
+			if (next & AC_MATCH) {
+				lane_hits[k][nhits[k]].state = lane_state[k];
+				lane_hits[k][nhits[k]].pos = j;
+				nhits[k]++;
+			}
+		}
+		state = lane_state[AC_LANES - 1];
+
+		for (k = 0; k < AC_LANES; k++)
+			for (j = 0; j < nhits[k]; j++)
+				matches += scanMatches(ac, text, len, lane_hits[k][j].state,
+									   base + k * lane_len + lane_hits[k][j].pos, visit, arg);
+	}
+
+	free(hits);
+	return matches;
+}
+
+/* This function writes a scan match as "offset\tword", with "file:" in
+/* front when several files are scanned, to the output buffer, emptying
+/* it onto standard output when it fills.
+*/
+void
+printScanMatch(NODE_PTR word, size_t offset, void *arg)
+{
+	SCAN_OUTPUT *out = (SCAN_OUTPUT *) arg;
+	size_t need = strlen(word->line_text) + 32;
+
+	if (out->filename != NULL)
+		need += strlen(out->filename);
+	if (out->used + need > BATCH_BUFSIZE) {
+		fwrite(out->buf, 1, out->used, stdout);
+		out->used = 0;
+	}
+
+	if (need > BATCH_BUFSIZE) {
+		if (out->filename != NULL)
+			printf("%s:", out->filename);
+		printf("%lu\t%s\n", (unsigned long) offset, word->line_text);
+	} else if (out->filename != NULL)
+		out->used += sprintf(out->buf + out->used, "%s:%lu\t%s\n", out->filename,
+							 (unsigned long) offset, word->line_text);
+	else
+		out->used += sprintf(out->buf + out->used, "%lu\t%s\n",
+							 (unsigned long) offset, word->line_text);
+	out->matches++;
+}
+
+/* This function scans the named text files, or standard input if none
+/* are named, for every whole word in the table and writes where each
+/* was found to standard output.  A summary, with the scanning rate, goes
+/* to standard error.
+*/
+void
+runScan(HASH_TAB *hash_tab, int nfiles, char **filenames)
+{
+	AC_AUTOMATON ac;
+	SCAN_OUTPUT out;
+	INPUT_MAP input;
+	unsigned long bytes = 0;
+	double start, scan_seconds = 0.0;
+	char *stdin_name = "/dev/stdin";
+	int i;
+
+	initCharClasses();
+
+	start = elapsedSeconds();
+	buildScanAutomaton(hash_tab, &ac);
+	fprintf(stderr, "Built %u states over %d byte classes in %.3f ms\n",
+			ac.nstates, ac.nclasses, (elapsedSeconds() - start) * 1e3);
+
+	out.used = 0;
+	out.matches = 0;
+	if ((out.buf = (char *) malloc(BATCH_BUFSIZE)) == NULL) {
+		printf("Error: Unable to allocate scan output buffer\n");
+		exit(-1);
+	}
+
+	if (nfiles == 0) {
+		nfiles = 1;
+		filenames = &stdin_name;
+	}
+	for (i = 0; i < nfiles; i++) {
+		if (!openInputMap(filenames[i], &input)) {
+			printf("Can't read text file: %s\n", filenames[i]);
+			continue;
+		}
+		out.filename = (nfiles > 1) ? filenames[i] : NULL;
+
+		start = elapsedSeconds();
+		scanBuffer(&ac, input.base, input.size, printScanMatch, &out);
+		scan_seconds += elapsedSeconds() - start;
+
+		bytes += input.size;
+		closeInputMap(&input);
+	}
+	fwrite(out.buf, 1, out.used, stdout);
+	fflush(stdout);
+
+	fprintf(stderr, "Bytes scanned   \t= %10lu\n", bytes);
+	fprintf(stderr, "Matches         \t= %10lu\n", out.matches);
+	if (scan_seconds > 0.0)
+		fprintf(stderr, "Scan throughput \t= %10.1f MB/s\n", bytes / scan_seconds / 1e6);
+
+	free(out.buf);
+	freeScanAutomaton(&ac);
+} /* End runScan. */
+
+/*********************************************************
+ **                                                     **
+ **                   Word Frequency                    **
+ **                                                     **
+ *********************************************************/
+
+/* This function finds the node holding a string in a table, looking in
+/* the same buckets, in the same order, as findHashEntry(), but without
+/* the filter or the statistics.
+/* It returns the node, or NULL if the string isn't in the table.
+*/
+NODE_PTR
+findHashNode(HASH_TAB *hash_tab, char *key)
+{
+	NODE_PTR node_ptr;
+	int h, i;
+
+	h = hashKey(key, hash_tab->hash_fn, hash_tab->size);
+	for (i = 0; ; i++) {
+		if ((node_ptr = hash_tab->bucket[h]) == NULL)
+			return NULL;
+		for (; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			if (strcmp(node_ptr->line_text, key) == 0)
+				return node_ptr;
+		if (i == PROBE_LIMIT(hash_tab->size))
+			return NULL;
+		h = hashKeyQuad(h, hash_tab->size);
+	}
+}
+
+/* This function allocates an empty top-k heap with room for capacity
+/* words, and an index of at least twice as many slots.  If memory runs
+/* out, it prints an appropriate message and exits from the program.
+*/
+void
+initTopHeap(TOP_HEAP *heap, int capacity)
+{
+	int i;
+
+	heap->n = 0;
+	heap->capacity = capacity;
+	heap->text_bytes = 0;
+	for (heap->nslots = 16; heap->nslots < 2 * capacity; heap->nslots *= 2)
+		;
+
+	if ((heap->item = (TOP_ITEM *) malloc(capacity * sizeof(TOP_ITEM))) == NULL ||
+		(heap->slot = (int *) malloc(heap->nslots * sizeof(int))) == NULL) {
+		printf("Error: Unable to allocate top-k heap storage\n");
+		exit(-1);
+	}
+	for (i = 0; i < heap->nslots; i++)
+		heap->slot[i] = -1;
+}
+
+/* This function releases a top-k heap, its index and its words.
+*/
+void
+freeTopHeap(TOP_HEAP *heap)
+{
+	int i;
+
+	for (i = 0; i < heap->n; i++)
+		free(heap->item[i].word);
+	free(heap->item);
+	free(heap->slot);
+	heap->item = NULL;
+	heap->slot = NULL;
+	heap->n = 0;
+}
+
+/* This function looks a word up in a top-k heap's index, given the
+/* word's hash, by linear probing.
+/* It returns the word's place in the heap, or -1 if it isn't there.
+*/
+int
+findTopItem(TOP_HEAP *heap, char *word, uint64_t hash)
+{
+	int mask = heap->nslots - 1;
+	int s;
+
+	for (s = hash & mask; heap->slot[s] >= 0; s = (s + 1) & mask)
+		if (heap->item[heap->slot[s]].hash == hash &&
+			strcmp(heap->item[heap->slot[s]].word, word) == 0)
+			return heap->slot[s];
+	return -1;
+}
+
+/* This function swaps two items of a top-k heap and points their index
+/* entries at their new places.
+*/
+void
+swapTopItems(TOP_HEAP *heap, int a, int b)
+{
+	TOP_ITEM t = heap->item[a];
+
+	heap->item[a] = heap->item[b];
+	heap->item[b] = t;
+	heap->slot[heap->item[a].slot] = a;
+	heap->slot[heap->item[b].slot] = b;
+}
+
+/* This function moves a top-k heap item whose count has grown down the
+/* heap until no child has a smaller count.
+*/
+void
+siftTopItemDown(TOP_HEAP *heap, int i)
+{
+	int child;
+
+	while ((child = 2 * i + 1) < heap->n) {
+		if (child + 1 < heap->n && heap->item[child + 1].count < heap->item[child].count)
+			child++;
+		if (heap->item[i].count <= heap->item[child].count)
+			return;
+		swapTopItems(heap, i, child);
+		i = child;
+	}
+}
+
+/* This function moves a newly added top-k heap item up the heap until
+/* its parent's count is no bigger.
+*/
+void
+siftTopItemUp(TOP_HEAP *heap, int i)
+{
+	while (i > 0 && heap->item[(i - 1) / 2].count > heap->item[i].count) {
+		swapTopItems(heap, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+/* This function drops the index entry of the word at place i of a
+/* top-k heap.  The entries after it in the same run are shifted back
+/* over the gap where their probes allow, so no search is cut short.
+*/
+void
+unindexTopItem(TOP_HEAP *heap, int i)
+{
+	int mask = heap->nslots - 1;
+	int gap = heap->item[i].slot, s, home;
+
+	for (s = (gap + 1) & mask; heap->slot[s] >= 0; s = (s + 1) & mask) {
+		home = heap->item[heap->slot[s]].hash & mask;
+		if (((s - home) & mask) < ((s - gap) & mask))
+			continue;					/* Its probes start after the gap */
+		heap->slot[gap] = heap->slot[s];
+		heap->item[heap->slot[gap]].slot = gap;
+		gap = s;
+	}
+	heap->slot[gap] = -1;
+}
+
+/* This function adds a word to a top-k heap with a count and the most
+/* the count may be over.  If the heap is full, the word takes the place
+/* of the one with the least count.  The word is copied.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+addTopItem(TOP_HEAP *heap, char *word, uint64_t hash, unsigned long count,
+		   unsigned long error)
+{
+	TOP_ITEM *item;
+	int mask = heap->nslots - 1;
+	int i, s;
+
+	if (heap->n < heap->capacity)
+		i = heap->n++;
+	else {
+		i = 0;
+		unindexTopItem(heap, 0);
+		heap->text_bytes -= strlen(heap->item[0].word) + 1;
+		free(heap->item[0].word);
+	}
+
+	item = &heap->item[i];
+	if ((item->word = stringDup(word)) == NULL) {
+		printf("Error: Unable to allocate top-k heap storage\n");
+		exit(-1);
+	}
+	heap->text_bytes += strlen(word) + 1;
+	item->hash  = hash;
+	item->count = count;
+	item->error = error;
+
+	for (s = hash & mask; heap->slot[s] >= 0; s = (s + 1) & mask)
+		;
+	heap->slot[s] = i;
+	item->slot = s;
+
+	if (i == 0)
+		siftTopItemDown(heap, 0);
+	else
+		siftTopItemUp(heap, i);
+}
+
+/* This function sizes a Count-Min sketch.  No count is over by more
+/* than e / width times the number of words, but for a chance that each
+/* row cuts by a factor of e; so the sketch gets the fewest rows that
+/* bring that chance within delta, and rows wide enough for epsilon if
+/* it is given, or else as wide as a number of bytes allows.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+initCountMin(COUNT_MIN *sketch, size_t bytes, double epsilon, double delta)
+{
+	double chance = 1.0;
+
+	for (sketch->depth = 0; chance > delta; sketch->depth++)
+		chance /= 2.718281828;
+
+	if (epsilon > 0.0)
+		sketch->width = (int) (2.718281828 / epsilon) + 1;
+	else
+		sketch->width = bytes / (sketch->depth * sizeof(uint32_t));
+	if (sketch->width < 1)
+		sketch->width = 1;
+
+	if ((sketch->counter = (uint32_t *) calloc((size_t) sketch->depth * sketch->width,
+											   sizeof(uint32_t))) == NULL) {
+		printf("Error: Unable to allocate Count-Min sketch storage\n");
+		exit(-1);
+	}
+}
+
+/* This function counts a word in a Count-Min sketch, given the word's
+/* hash.  The counter in each row comes from the two halves of a mixed
+/* hash.  Only the counters at the least value are raised (conservative
+/* update), which keeps every count's bound but makes counts closer.
+/* It returns the word's count so far.
+*/
+unsigned long
+countMinAdd(COUNT_MIN *sketch, uint64_t hash)
+{
+	uint64_t h2 = bloomMix(hash) | 1;
+	uint32_t *counter[64];
+	uint32_t least = UINT32_MAX;
+	int d;
+
+	for (d = 0; d < sketch->depth; d++) {
+		counter[d] = &sketch->counter[(size_t) d * sketch->width +
+									  (hash + d * h2) % sketch->width];
+		if (*counter[d] < least)
+			least = *counter[d];
+	}
+	if (least < UINT32_MAX)
+		least++;
+	for (d = 0; d < sketch->depth; d++)
+		if (*counter[d] < least)
+			*counter[d] = least;
+
+	return least;
+}
+
+/* This function splits text into words, taking every run of letters,
+/* digits and underscores as one, and hands each to the visitor.
+/* char_class[] must be set up by initCharClasses() first.
+/* The word passed to the visitor is NOT null terminated.
+*/
+void
+splitWords(const char *buf, size_t len, TOKEN_VISITOR visit, void *arg)
+{
+	const char *p = buf;
+	const char *end = buf + len;
+	int n;
+
+	while (p < end) {
+		if (!(char_class[(unsigned char) *p] & CC_IDENT)) {
+			p++;
+			continue;
+		}
+		n = identSpan(p, end);
+		(*visit)(p, n, arg);
+		p += n;
+	}
+}
+
+/* This function counts one word for -top, in whichever way the counter
+/* was set up to:
+/* - Exactly, in a table node of its own.
+/* - With a Count-Min sketch, whose count for the word goes into the heap
+/*   if the word is already there or beats the heap's least count.
+/* - With Space-Saving, whose heap holds every counter: a word without
+/*   one takes the least counter over, counting on from its count, which
+/*   becomes the most the word's count may be over.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+countToken(const char *token, int len, void *arg)
+{
+	TOP_COUNTER *top = (TOP_COUNTER *) arg;
+	TOP_HEAP *heap = &top->heap;
+	NODE_PTR node_ptr;
+	unsigned long count;
+	uint64_t hash;
+	int i;
+
+	if ((size_t) len >= top->key_size) {
+		top->key_size = 2 * len + 1;
+		if ((top->key = (char *) realloc(top->key, top->key_size)) == NULL) {
+			printf("Error: Unable to allocate word storage\n");
+			exit(-1);
+		}
+	}
+	memcpy(top->key, token, len);
+	top->key[len] = '\0';
+	top->tokens++;
+
+	if (top->estimator == TOP_EXACT) {
+		if ((node_ptr = findHashNode(&top->table, top->key)) != NULL)
+			node_ptr->count++;
+		else
+			addHashEntry(&top->table, makenode(&top->table.arena, top->key));
+		return;
+	}
+
+	hash = bloomHash(top->key);
+	i = findTopItem(heap, top->key, hash);
+
+	if (top->estimator == TOP_COUNTMIN) {
+		count = countMinAdd(&top->sketch, hash);
+		if (i >= 0) {
+			heap->item[i].count = count;
+			siftTopItemDown(heap, i);
+		} else if (heap->n < heap->capacity || count > heap->item[0].count)
+			addTopItem(heap, top->key, hash, count, 0);
+		return;
+	}
+
+	if (i >= 0) {
+		heap->item[i].count++;
+		siftTopItemDown(heap, i);
+	} else if (heap->n < heap->capacity)
+		addTopItem(heap, top->key, hash, 1, 0);
+	else
+		addTopItem(heap, top->key, hash, heap->item[0].count + 1, heap->item[0].count);
+}
+
+/* This function compares two heap items for qsort(): biggest count
+/* first, then in alphabetical order.
+*/
+int
+compareTopItem(const void *a, const void *b)
+{
+	const TOP_ITEM *x = (const TOP_ITEM *) a;
+	const TOP_ITEM *y = (const TOP_ITEM *) b;
+
+	if (x->count != y->count)
+		return (x->count < y->count) ? 1 : -1;
+	return strcmp(x->word, y->word);
+}
+
+/* This function lists the k most frequent words of the named text
+/* files, or of standard input if none are named, counted as the
+/* estimator says.  The sketch and the counters are sized by epsilon if
+/* it is given, or else to fit in budget bytes.  The exact table has
+/* hash_size buckets, or TOP_TABLESIZE if hash_size is 0.
+/* A summary, with the memory used and how far over any count may be,
+/* comes first; then the words, most frequent first, with their counts.
+*/
+void
+runTopTokens(int nfiles, char **filenames, int k, int estimator, size_t budget,
+			 double epsilon, int hash_size, int hash_fn)
+{
+	TOP_COUNTER top;
+	TOP_HEAP *heap = &top.heap;
+	INPUT_MAP input;
+	NODE_PTR node_ptr;
+	unsigned long distinct = 0, bound = 0;
+	size_t item_bytes, bytes = 0;
+	double start, seconds, slack = 0.0;
+	char *stdin_name = "/dev/stdin";
+	int i, counters;
+
+	initCharClasses();
+
+	top.estimator = estimator;
+	top.key = NULL;
+	top.key_size = 0;
+	top.tokens = 0;
+	top.sketch.counter = NULL;
+
+	/** Share the budget out, or size to epsilon...
+	 **/
+	item_bytes = sizeof(TOP_ITEM) + 2 * sizeof(int) + TOP_WORDBYTES;
+	if (estimator != TOP_EXACT && epsilon == 0.0 && budget < 2 * k * item_bytes) {
+		printf("Error: A budget of %lu bytes is too small for the top %d words\n",
+			   (unsigned long) budget, k);
+		exit(-1);
+	}
+
+	if (estimator == TOP_EXACT) {
+		initHashTable(&top.table, hash_size ? hash_size : TOP_TABLESIZE, hash_fn);
+		initTopHeap(heap, k);
+	} else if (estimator == TOP_COUNTMIN) {
+		initTopHeap(heap, k);
+		initCountMin(&top.sketch, budget - k * item_bytes, epsilon, TOP_DELTA);
+		bytes = (size_t) top.sketch.depth * top.sketch.width * sizeof(uint32_t);
+		slack = 2.718281828 / top.sketch.width;
+	} else {
+		if (epsilon > 0.0)
+			counters = (int) (1.0 / epsilon) + 1;
+		else
+			counters = budget / item_bytes;
+		initTopHeap(heap, counters > k ? counters : k);
+		slack = 1.0 / heap->capacity;
+	}
+
+	/** Count the words of every file...
+	 **/
+	if (nfiles == 0) {
+		nfiles = 1;
+		filenames = &stdin_name;
+	}
+	start = elapsedSeconds();
+	for (i = 0; i < nfiles; i++) {
+		if (!openInputMap(filenames[i], &input)) {
+			printf("Can't read text file: %s\n", filenames[i]);
+			continue;
+		}
+		splitWords(input.base, input.size, countToken, &top);
+		closeInputMap(&input);
+	}
+
+	/** An exact count still has to pick the leaders out...
+	 **/
+	if (estimator == TOP_EXACT)
+		for (i = 0; i <= top.table.size - 1; i++)
+			for (node_ptr = top.table.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+				distinct++;
+				if (heap->n < heap->capacity || node_ptr->count > heap->item[0].count)
+					addTopItem(heap, node_ptr->line_text, bloomHash(node_ptr->line_text),
+							   node_ptr->count, 0);
+			}
+	seconds = elapsedSeconds() - start;
+
+	if (estimator == TOP_EXACT)
+		bytes = top.table.arena.bytes + top.table.size * sizeof(NODE_PTR);
+	else
+		bytes += heap->capacity * sizeof(TOP_ITEM) + heap->nslots * sizeof(int) +
+				 heap->text_bytes;
+	bound = (unsigned long) (slack * top.tokens);
+
+	printf("Estimator       \t= %10s\n", estimator_names[estimator]);
+	printf("Words counted   \t= %10lu\n", top.tokens);
+	if (estimator == TOP_EXACT)
+		printf("Distinct words  \t= %10lu\n", distinct);
+	printf("Memory used     \t= %10lu bytes\n", (unsigned long) bytes);
+	if (estimator == TOP_COUNTMIN) {
+		printf("Sketch          \t= %10d rows of %d counters\n", top.sketch.depth,
+			   top.sketch.width);
+		printf("Counts over by  \t= %10lu at most (e/width of the words), but for a\n", bound);
+		printf("                \t  %.2g chance\n", TOP_DELTA);
+	} else if (estimator == TOP_SPACESAVING) {
+		printf("Counters        \t= %10d\n", heap->capacity);
+		printf("Counts over by  \t= %10lu at most (words/counters); each word's\n", bound);
+		printf("                \t  own bound follows its count\n");
+	}
+	if (seconds > 0.0)
+		printf("Count rate      \t= %10.0f words/s\n", top.tokens / seconds);
+	printf("\n");
+
+	qsort(heap->item, heap->n, sizeof(TOP_ITEM), compareTopItem);
+	for (i = 0; i < k && i < heap->n; i++)
+		if (estimator == TOP_SPACESAVING)
+			printf("%10lu\t%s\t(+%lu)\n", heap->item[i].count, heap->item[i].word,
+				   heap->item[i].error);
+		else
+			printf("%10lu\t%s\n", heap->item[i].count, heap->item[i].word);
+
+	free(top.key);
+	if (estimator == TOP_EXACT)
+		freeHashTable(&top.table);
+	free(top.sketch.counter);
+	freeTopHeap(heap);
+} /* End runTopTokens. */
+
+/*********************************************************
+ **                                                     **
+ **                Cross-Reference Index                **
+ **                                                     **
+ *********************************************************/
+
+/* This function writes a number in as few bytes as it takes, seven bits
+/* to a byte, low bits first, with the top bit set on every byte but the
+/* last.
+/* It returns the number of bytes written, at most ten.
+*/
+int
+putVarint(unsigned char *p, uint64_t value)
+{
+	int n = 0;
+
+	while (value >= 0x80) {
+		p[n++] = (unsigned char) (value | 0x80);
+		value >>= 7;
+	}
+	p[n++] = (unsigned char) value;
+	return n;
+}
+
+/* This function reads a number written by putVarint() and moves *p past
+/* it.
+/* It returns the number.
+*/
+uint64_t
+getVarint(const unsigned char **p)
+{
+	const unsigned char *q = *p;
+	uint64_t value = 0;
+	int shift = 0;
+
+	while (*q & 0x80) {
+		value |= (uint64_t) (*q++ & 0x7F) << shift;
+		shift += 7;
+	}
+	value |= (uint64_t) *q++ << shift;
+	*p = q;
+	return value;
+}
+
+/* This function adds a place to a term's posting list, unless the term
+/* was already seen on that line.  Places must come in order.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+addXrefPlace(XREF_TERM *term, uint32_t file, uint32_t line)
+{
+	if (term->node.count > 0 && file == term->last_file && line == term->last_line)
+		return;
+
+	if (term->used + 10 > term->capacity) {
+		term->capacity = term->capacity ? 2 * term->capacity : 16;
+		if ((term->postings = (unsigned char *) realloc(term->postings,
+														term->capacity)) == NULL) {
+			printf("Error: Unable to allocate posting list storage\n");
+			exit(-1);
+		}
+	}
+
+	term->used += putVarint(term->postings + term->used, file - term->last_file);
+	term->used += putVarint(term->postings + term->used,
+							(file == term->last_file) ? line - term->last_line : line);
+	term->last_file = file;
+	term->last_line = line;
+	term->node.count++;
+}
+
+/* This function makes a new term, with no places yet, in the table of
+/* a cross-reference build.  If memory runs out, it prints an
+/* appropriate message and exits from the program.
+/* It returns the term.
+*/
+XREF_TERM *
+newXrefTerm(HASH_TAB *terms, const char *word, int len)
+{
+	XREF_TERM *term;
+
+	if ((term = (XREF_TERM *) arenaAlloc(&terms->arena, sizeof(XREF_TERM) + len + 1)) == NULL) {
+		printf("Error: Unable to allocate linked node storage\n");
+		exit(-1);
+	}
+	term->node.line_text = (char *) (term + 1);
+	term->node.next_ptr = NULL;
+	term->node.count = 0;
+	memcpy(term->node.line_text, word, len);
+	term->node.line_text[len] = '\0';
+	term->postings = NULL;
+	term->used = term->capacity = 0;
+	term->last_file = term->last_line = 0;
+	addHashEntry(terms, &term->node);
+
+	return term;
+}
+
+/* This function is the lexer's visitor for buildXref().  It works out
+/* the identifier's line from the newlines since the last one, and adds
+/* the place to the identifier's term, making the term if it is new.
+/* It expects arg to point to the build.
+*/
+void
+xrefToken(const char *token, int len, void *arg)
+{
+	XREF_BUILD *build = (XREF_BUILD *) arg;
+	XREF_TERM *term;
+	char word_buffer[MAXARRAY];
+	char *word = word_buffer;
+
+	build->line += countLines(build->last_pos, token);
+	build->last_pos = token;
+
+	/** Very long identifiers don't fit the usual buffer...
+	 **/
+	if (len >= MAXARRAY && (word = (char *) malloc(len + 1)) == NULL) {
+		printf("Error: Unable to allocate line text storage\n");
+		exit(-1);
+	}
+	memcpy(word, token, len);
+	word[len] = '\0';
+
+	if ((term = (XREF_TERM *) findHashNode(&build->terms, word)) == NULL)
+		term = newXrefTerm(&build->terms, word, len);
+
+	addXrefPlace(term, build->file, build->line);
+	build->places++;
+
+	if (word != word_buffer)
+		free(word);
+}
+
+/* This function fills in a manifest entry with the size and time of a
+/* file.  The content hash is left at 0.
+/* It returns 1, or 0 if the file can't be found.
+*/
+int
+statXrefFile(char *filename, XREF_FILE_ENTRY *entry)
+{
+	struct stat info;
+
+	memset(entry, 0, sizeof(*entry));
+	if (stat(filename, &info) != 0)
+		return 0;
+
+	entry->size  = info.st_size;
+	entry->mtime = (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+	return 1;
+}
+
+/* This function tokenizes one source file into a cross-reference build
+/* as file number file, and fills in the file's manifest entry.  The
+/* size and time are taken before the file is read, so a change made
+/* while it is being read is seen by the next refresh.
+/* It returns 1, or 0 (saying so) if the file can't be read, in which
+/* case the entry is left matching nothing, so a refresh tries again.
+*/
+int
+xrefFile(XREF_BUILD *build, char *filename, uint32_t file, XREF_FILE_ENTRY *entry)
+{
+	char *buf;
+	long len;
+
+	if (!statXrefFile(filename, entry) || (buf = readWholeFile(filename, &len)) == NULL) {
+		printf("Can't read source file: %s\n", filename);
+		entry->mtime = -1;
+		return 0;
+	}
+
+	entry->hash = snapshotChecksum(buf, len);
+	build->file = file;
+	build->line = 1;
+	build->last_pos = buf;
+	lexSourceBuffer(buf, len, xrefToken, build);
+	build->bytes += len;
+	free(buf);
+
+	return 1;
+}
+
+/* This function writes the terms of a cross-reference build, and the
+/* manifest of the files they came from, to an index file.  Terms with
+/* no places are left out.
+/*
+/* The terms are added in sorted order to a table sized to fit them,
+/* which is written out the way a snapshot is: buckets, then the term
+/* records chain by chain, then the manifest, the skip entries, the
+/* posting lists and the text, each in the same order.  The file is
+/* written under a temporary name, mapped back to compute the checksum,
+/* and renamed over the index file.
+/*
+/* The terms' chains and posting lists are used up; only the build's
+/* table itself is left for the caller to free.  The header written is
+/* copied to *header.
+/* It returns the number of places written.  If the file can't be
+/* written it prints an appropriate message and exits from the program.
+*/
+uint64_t
+writeXref(char *index_filename, HASH_TAB *terms, FILE_LIST *files,
+		  XREF_FILE_ENTRY *manifest, XREF_HEADER *header)
+{
+	XREF_RECORD record;
+	XREF_SKIP_ENTRY skip;
+	XREF_TERM *term;
+	HASH_TAB disk;
+	NODE_PTR *nodes, node_ptr;
+	const unsigned char *p;
+	uint64_t offset, skip_offset, posting_offset, text_offset;
+	uint64_t nterms = 0, nskips = 0, nplaces = 0, posting_bytes = 0, text_bytes = 0;
+	uint32_t file, line, j;
+	char *temp_filename, *map;
+	FILE *fptr;
+	int i;
+
+	/** Move the terms that have places, in order, into a table of
+	 ** their own size...
+	 **/
+	for (i = 0; i <= terms->size - 1; i++)
+		for (node_ptr = terms->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			nterms++;
+	if ((nodes = (NODE_PTR *) malloc((nterms + 1) * sizeof(NODE_PTR))) == NULL) {
+		printf("Error: Unable to allocate cross-reference storage\n");
+		exit(-1);
+	}
+	nterms = 0;
+	for (i = 0; i <= terms->size - 1; i++)
+		for (node_ptr = terms->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			if (node_ptr->count > 0)
+				nodes[nterms++] = node_ptr;
+	qsort(nodes, nterms, sizeof(NODE_PTR), compareNodeText);
+
+	initHashTable(&disk, nextPrime(nterms <= MAXHASHSIZE / 2 ? 2 * nterms + 1 : MAXHASHSIZE),
+				  HASH_FNV1A);
+	for (j = 0; j < nterms; j++) {
+		term = (XREF_TERM *) nodes[j];
+		nodes[j]->next_ptr = NULL;
+		addHashEntry(&disk, nodes[j]);
+		nplaces += nodes[j]->count;
+		nskips += nodes[j]->count / XREF_SKIP;
+		posting_bytes += term->used;
+		text_bytes += strlen(nodes[j]->line_text) + 1;
+	}
+	for (i = 0; i < files->count; i++)
+		text_bytes += strlen(files->names[i]) + 1;
+
+	/** Lay out the file...
+	 **/
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, XREF_MAGIC, sizeof(header->magic));
+	header->version        = XREF_VERSION;
+	header->byte_order     = SNAPSHOT_BYTEORDER;
+	header->hash_size      = disk.size;
+	header->hash_fn        = disk.hash_fn;
+	header->nterms         = nterms;
+	header->nfiles         = files->count;
+	header->bucket_offset  = sizeof(XREF_HEADER);
+	header->term_offset    = header->bucket_offset + disk.size * sizeof(uint64_t);
+	header->file_offset    = header->term_offset + nterms * sizeof(XREF_RECORD);
+	header->skip_offset    = header->file_offset + files->count * sizeof(XREF_FILE_ENTRY);
+	header->posting_offset = header->skip_offset + nskips * sizeof(XREF_SKIP_ENTRY);
+	header->text_offset    = header->posting_offset + posting_bytes;
+	header->file_size      = header->text_offset + text_bytes;
+
+	if ((temp_filename = (char *) malloc(strlen(index_filename) + 5)) == NULL) {
+		printf("Error: Unable to allocate cross-reference storage\n");
+		exit(-1);
+	}
+	sprintf(temp_filename, "%s.tmp", index_filename);
+
+	if ((fptr = fopen(temp_filename, "wb")) == NULL) {
+		printf("Can't open index file: %s\n", temp_filename);
+		exit(-1);
+	}
+
+	fwrite(header, sizeof(*header), 1, fptr);
+
+	/** Buckets: each chain's records are written together, in order...
+	 **/
+	offset = header->term_offset;
+	for (i = 0; i <= disk.size - 1; i++) {
+		uint64_t head = 0;
+
+		if (disk.bucket[i] != NULL)
+			head = offset;
+		for (node_ptr = disk.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			offset += sizeof(XREF_RECORD);
+		fwrite(&head, sizeof(head), 1, fptr);
+	}
+
+	/** Term records: the next record in a chain is the one written
+	 ** after it...
+	 **/
+	offset = header->term_offset;
+	skip_offset = header->skip_offset;
+	posting_offset = header->posting_offset;
+	text_offset = header->text_offset;
+	for (i = 0; i <= disk.size - 1; i++)
+		for (node_ptr = disk.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+			term = (XREF_TERM *) node_ptr;
+			offset += sizeof(XREF_RECORD);
+			record.text     = text_offset;
+			record.next     = (node_ptr->next_ptr != NULL) ? offset : 0;
+			record.postings = posting_offset;
+			record.skips    = skip_offset;
+			record.count    = node_ptr->count;
+			record.nskips   = node_ptr->count / XREF_SKIP;
+			fwrite(&record, sizeof(record), 1, fptr);
+
+			text_offset += strlen(node_ptr->line_text) + 1;
+			posting_offset += term->used;
+			skip_offset += record.nskips * sizeof(XREF_SKIP_ENTRY);
+		}
+
+	/** The manifest; file names go after the terms' text...
+	 **/
+	for (i = 0; i < files->count; i++) {
+		manifest[i].name = text_offset;
+		fwrite(&manifest[i], sizeof(XREF_FILE_ENTRY), 1, fptr);
+		text_offset += strlen(files->names[i]) + 1;
+	}
+
+	/** Skip entries: the place ending every XREF_SKIP places, found by
+	 ** decoding the lists...
+	 **/
+	for (i = 0; i <= disk.size - 1; i++)
+		for (node_ptr = disk.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+			term = (XREF_TERM *) node_ptr;
+			p = term->postings;
+			file = line = 0;
+			for (j = 1; j <= node_ptr->count; j++) {
+				offset = getVarint(&p);
+				file += offset;
+				line = offset ? getVarint(&p) : line + getVarint(&p);
+				if (j % XREF_SKIP == 0) {
+					skip.file = file;
+					skip.line = line;
+					skip.offset = p - term->postings;
+					fwrite(&skip, sizeof(skip), 1, fptr);
+				}
+			}
+		}
+
+	/** Posting lists, then text, in the same order as the records...
+	 **/
+	for (i = 0; i <= disk.size - 1; i++)
+		for (node_ptr = disk.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			fwrite(((XREF_TERM *) node_ptr)->postings, ((XREF_TERM *) node_ptr)->used, 1, fptr);
+	for (i = 0; i <= disk.size - 1; i++)
+		for (node_ptr = disk.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			fwrite(node_ptr->line_text, strlen(node_ptr->line_text) + 1, 1, fptr);
+	for (i = 0; i < files->count; i++)
+		fwrite(files->names[i], strlen(files->names[i]) + 1, 1, fptr);
+
+	if (fclose(fptr) != 0) {
+		printf("Can't write index file: %s\n", temp_filename);
+		exit(-1);
+	}
+
+	/** Map the file back to checksum it and fill in the header...
+	 **/
+	if ((i = open(temp_filename, O_RDWR)) < 0 ||
+		(map = mmap(NULL, header->file_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED, i, 0)) == MAP_FAILED) {
+		printf("Can't map index file: %s\n", temp_filename);
+		exit(-1);
+	}
+	close(i);
+
+	header->checksum = ((XREF_HEADER *) map)->checksum =
+		snapshotChecksum(map + sizeof(XREF_HEADER), header->file_size - sizeof(XREF_HEADER));
+	munmap(map, header->file_size);
+
+	if (rename(temp_filename, index_filename) != 0) {
+		printf("Can't replace index file: %s\n", index_filename);
+		exit(-1);
+	}
+	free(temp_filename);
+
+	for (j = 0; j < nterms; j++)
+		free(((XREF_TERM *) nodes[j])->postings);
+	free(nodes);
+	freeHashTable(&disk);
+
+	return nplaces;
+} /* End writeXref. */
+
+/* This function tokenizes every source file at or under the named paths
+/* and writes where each identifier (reserved words too) appears to a
+/* cross-reference index file, with writeXref().
+/* If the file can't be written it prints an appropriate message and
+/* exits from the program.
+*/
+void
+buildXref(char *index_filename, int npaths, char **paths)
+{
+	FILE_LIST files = { NULL, 0, 0, 0 };
+	XREF_BUILD build;
+	XREF_HEADER header;
+	XREF_FILE_ENTRY *manifest;
+	uint64_t nplaces;
+	double start, lexed;
+	int i;
+
+	initCharClasses();
+
+	for (i = 0; i < npaths; i++)
+		collectSourceFiles(paths[i], &files, TRUE);
+
+	if (files.count == 0) {
+		printf("No source files found\n");
+		return;
+	}
+
+	if ((manifest = (XREF_FILE_ENTRY *) malloc(files.count * sizeof(XREF_FILE_ENTRY))) == NULL) {
+		printf("Error: Unable to allocate cross-reference storage\n");
+		exit(-1);
+	}
+
+	/** Gather the places of every identifier, file by file...
+	 **/
+	start = elapsedSeconds();
+	initHashTable(&build.terms, XREF_TABLESIZE, HASH_FNV1A);
+	build.places = build.bytes = 0;
+	for (i = 0; i < files.count; i++)
+		xrefFile(&build, files.names[i], i, &manifest[i]);
+	lexed = elapsedSeconds();
+
+	nplaces = writeXref(index_filename, &build.terms, &files, manifest, &header);
+
+	printf("Files indexed   \t= %10d\n", files.count);
+	printf("Bytes indexed   \t= %10lu\n", build.bytes);
+	printf("Terms           \t= %10lu\n", (unsigned long) header.nterms);
+	printf("Identifiers     \t= %10lu\n", build.places);
+	printf("Places          \t= %10lu (distinct term, file and line)\n",
+		   (unsigned long) nplaces);
+	printf("Posting bytes   \t= %10lu\n",
+		   (unsigned long) (header.text_offset - header.posting_offset));
+	printf("Index size      \t= %10lu bytes\n", (unsigned long) header.file_size);
+	printf("Tokenize time   \t= %10.3f s\n", lexed - start);
+	printf("Write time      \t= %10.3f s\n", elapsedSeconds() - lexed);
+
+	freeHashTable(&build.terms);
+	free(manifest);
+	for (i = 0; i < files.count; i++)
+		free(files.names[i]);
+	free(files.names);
+} /* End buildXref. */
+
+/* This function brings a cross-reference index up to date with the
+/* source files at or under the named paths, tokenizing only the files
+/* that changed since it was written.
+/*
+/* Each file is looked up by name in the index's manifest.  One whose
+/* size and time match is taken as unchanged without being read; one
+/* whose time alone differs is read, and kept if its content hash still
+/* matches.  Unchanged files keep their order, numbered past the files
+/* dropped, so every old posting list can be decoded and carried over
+/* in order, less the places in files that changed or went away.  The
+/* changed and new files are then tokenized as files numbered after
+/* all of those, so their places go on the ends of the lists.  Terms
+/* left with no places are dropped when the index is written.
+/* If there is no index to refresh, it builds one with buildXref().
+*/
+void
+refreshXref(char *index_filename, int npaths, char **paths)
+{
+	FILE_LIST files = { NULL, 0, 0, 0 };
+	FILE_LIST kept = { NULL, 0, 0, 0 };
+	XREF old;
+	XREF_BUILD build;
+	XREF_HEADER header;
+	XREF_TERM *term;
+	XREF_FILE_ENTRY *found, *manifest;
+	const XREF_FILE_ENTRY *entry;
+	const XREF_RECORD *record;
+	const unsigned char *p;
+	HASH_TAB names;
+	NODE_PTR node_ptr;
+	uint64_t nplaces, gap, t;
+	uint32_t file, line, j;
+	unsigned long nfiles, unchanged = 0, touched = 0, changed = 0, added = 0;
+	double start, checked, updated;
+	int *match, *renumber, *fresh, nfresh = 0, same;
+	char *buf;
+	long len;
+	int i, n;
+
+	if (!openXref(index_filename, &old, FALSE)) {
+		printf("Building %s from scratch\n", index_filename);
+		buildXref(index_filename, npaths, paths);
+		return;
+	}
+
+	initCharClasses();
+
+	for (i = 0; i < npaths; i++)
+		collectSourceFiles(paths[i], &files, TRUE);
+
+	if (files.count == 0) {
+		printf("No source files found\n");
+		closeXref(&old);
+		return;
+	}
+
+	/** Index the old manifest by file name...
+	 **/
+	start = elapsedSeconds();
+	nfiles = old.header->nfiles;
+	initHashTable(&names, nextPrime(nfiles <= MAXHASHSIZE / 2 ? 2 * nfiles + 1 : MAXHASHSIZE),
+				  HASH_FNV1A);
+	for (file = 0; file < nfiles; file++) {
+		node_ptr = makenode(&names.arena, (char *) old.base + old.file[file].name);
+		node_ptr->count = file;
+		addHashEntry(&names, node_ptr);
+	}
+
+	match = (int *) malloc((nfiles + 1) * sizeof(int));
+	renumber = (int *) malloc((nfiles + 1) * sizeof(int));
+	fresh = (int *) malloc(files.count * sizeof(int));
+	found = (XREF_FILE_ENTRY *) malloc(files.count * sizeof(XREF_FILE_ENTRY));
+	manifest = (XREF_FILE_ENTRY *) malloc(files.count * sizeof(XREF_FILE_ENTRY));
+	if (match == NULL || renumber == NULL || fresh == NULL || found == NULL ||
+		manifest == NULL) {
+		printf("Error: Unable to allocate cross-reference storage\n");
+		exit(-1);
+	}
+
+	/** Match each file found with the old one of its name, if any.
+	 ** match[] is the file that stays unchanged, -2 if it changed, or
+	 ** -1 if it wasn't found...
+	 **/
+	for (file = 0; file < nfiles; file++)
+		match[file] = -1;
+	for (i = 0; i < files.count; i++) {
+		node_ptr = findHashNode(&names, files.names[i]);
+		if (node_ptr == NULL || match[file = node_ptr->count] != -1) {
+			added++;
+			fresh[nfresh++] = i;
+			continue;
+		}
+
+		entry = &old.file[file];
+		statXrefFile(files.names[i], &found[i]);
+		same = (found[i].size == entry->size && found[i].mtime == entry->mtime);
+		if (!same && found[i].size == entry->size &&
+			(buf = readWholeFile(files.names[i], &len)) != NULL) {
+			same = (snapshotChecksum(buf, len) == entry->hash);
+			touched += same;
+			free(buf);
+		}
+
+		if (same) {
+			found[i].hash = entry->hash;
+			match[file] = i;
+			unchanged++;
+		} else {
+			match[file] = -2;
+			changed++;
+			fresh[nfresh++] = i;
+		}
+	}
+	checked = elapsedSeconds();
+
+	if (touched == 0 && changed == 0 && added == 0 && unchanged == nfiles) {
+		printf("Index %s is up to date (%lu files checked in %.3f s)\n",
+			   index_filename, nfiles, checked - start);
+	} else {
+		/** Number the unchanged files in their old order, then the rest...
+		 **/
+		n = 0;
+		for (file = 0; file < nfiles; file++)
+			if (match[file] >= 0) {
+				renumber[file] = n;
+				manifest[n] = found[match[file]];
+				addFileName(&kept, files.names[match[file]]);
+				n++;
+			} else
+				renumber[file] = -1;
+		for (i = 0; i < nfresh; i++)
+			addFileName(&kept, files.names[fresh[i]]);
+
+		/** Carry the old places over, renumbered, leaving out those in
+		 ** files that changed or went away...
+		 **/
+		initHashTable(&build.terms, XREF_TABLESIZE, HASH_FNV1A);
+		build.places = build.bytes = 0;
+		record = (const XREF_RECORD *) (old.base + old.header->term_offset);
+		for (t = 0; t < old.header->nterms; t++, record++) {
+			term = newXrefTerm(&build.terms, old.base + record->text,
+							   strlen(old.base + record->text));
+			p = (const unsigned char *) old.base + record->postings;
+			file = line = 0;
+			for (j = 0; j < record->count; j++) {
+				gap = getVarint(&p);
+				file += gap;
+				line = gap ? getVarint(&p) : line + getVarint(&p);
+				if (renumber[file] >= 0)
+					addXrefPlace(term, renumber[file], line);
+			}
+		}
+
+		/** ...and add those of the changed and new files...
+		 **/
+		for (i = 0; i < nfresh; i++)
+			xrefFile(&build, kept.names[n + i], n + i, &manifest[n + i]);
+		updated = elapsedSeconds();
+
+		nplaces = writeXref(index_filename, &build.terms, &kept, manifest, &header);
+
+		printf("Files unchanged \t= %10lu (%lu of them touched)\n", unchanged, touched);
+		printf("Files changed   \t= %10lu\n", changed);
+		printf("Files added     \t= %10lu\n", added);
+		printf("Files deleted   \t= %10lu\n", nfiles - unchanged - changed);
+		printf("Bytes indexed   \t= %10lu\n", build.bytes);
+		printf("Terms           \t= %10lu\n", (unsigned long) header.nterms);
+		printf("Places          \t= %10lu (distinct term, file and line)\n",
+			   (unsigned long) nplaces);
+		printf("Index size      \t= %10lu bytes\n", (unsigned long) header.file_size);
+		printf("Check time      \t= %10.3f s\n", checked - start);
+		printf("Update time     \t= %10.3f s\n", updated - checked);
+		printf("Write time      \t= %10.3f s\n", elapsedSeconds() - updated);
+
+		freeHashTable(&build.terms);
+		for (i = 0; i < kept.count; i++)
+			free(kept.names[i]);
+		free(kept.names);
+	}
+
+	closeXref(&old);
+	freeHashTable(&names);
+	free(match);
+	free(renumber);
+	free(fresh);
+	free(found);
+	free(manifest);
+	for (i = 0; i < files.count; i++)
+		free(files.names[i]);
+	free(files.names);
+} /* End refreshXref. */
+
+/* This function maps a cross-reference index read-only and checks its
+/* header, as openHashSnapshot() does for a snapshot.  The checksum is
+/* checked only when verify is 1.
+/* It returns 1 on success.  Otherwise it prints the reason and
+/* returns 0.
+*/
+int
+openXref(char *index_filename, XREF *xref, int verify)
+{
+	const XREF_HEADER *header;
+	struct stat info;
+	void *map;
+	int fd;
+
+	if ((fd = open(index_filename, O_RDONLY)) < 0) {
+		printf("Can't find index file: %s\n", index_filename);
+		return 0;
+	}
+
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(XREF_HEADER)) {
+		printf("Not an index file: %s\n", index_filename);
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		printf("Can't map index file: %s\n", index_filename);
+		return 0;
+	}
+
+	xref->base      = (const char *) map;
+	xref->size      = info.st_size;
+	xref->header    = header = (const XREF_HEADER *) map;
+	xref->bucket    = (const uint64_t *) (xref->base + header->bucket_offset);
+	xref->file      = (const XREF_FILE_ENTRY *) (xref->base + header->file_offset);
+
+	if (memcmp(header->magic, XREF_MAGIC, sizeof(header->magic)) != 0 ||
+		header->byte_order != SNAPSHOT_BYTEORDER) {
+		printf("Not an index file: %s\n", index_filename);
+	} else if (header->version != XREF_VERSION) {
+		printf("Index %s was written by a different version (%u)\n",
+			   index_filename, header->version);
+	} else if (header->hash_size < 1 || header->hash_size > MAXHASHSIZE ||
+			   header->hash_fn >= HASH_FUNCTIONS ||
+			   header->file_size != (uint64_t) info.st_size ||
+			   header->bucket_offset != sizeof(XREF_HEADER) ||
+			   header->term_offset != header->bucket_offset + header->hash_size * sizeof(uint64_t) ||
+			   header->file_offset != header->term_offset + header->nterms * sizeof(XREF_RECORD) ||
+			   header->skip_offset != header->file_offset + header->nfiles * sizeof(XREF_FILE_ENTRY) ||
+			   header->posting_offset < header->skip_offset ||
+			   header->text_offset < header->posting_offset ||
+			   header->text_offset > header->file_size) {
+		printf("Index %s is truncated or damaged\n", index_filename);
+	} else if (verify &&
+			   header->checksum != snapshotChecksum(xref->base + sizeof(XREF_HEADER),
+													 xref->size - sizeof(XREF_HEADER))) {
+		printf("Index %s fails its checksum\n", index_filename);
+	} else
+		return 1;
+
+	closeXref(xref);
+	return 0;
+} /* End openXref. */
+
+/* This function unmaps a cross-reference index.
+*/
+void
+closeXref(XREF *xref)
+{
+	munmap((void *) xref->base, xref->size);
+	xref->base = NULL;
+}
+
+/* This function finds a term in a cross-reference index, in the same
+/* way findSnapshotEntry() finds a word in a snapshot.
+/* It returns the term's record, or NULL if the term isn't there.
+*/
+const XREF_RECORD *
+findXrefTerm(XREF *xref, char *key)
+{
+	const XREF_RECORD *record;
+	int size = xref->header->hash_size;
+	int h = hashKey(key, xref->header->hash_fn, size);
+	int probes = 0;
+	uint64_t offset;
+
+	for (;;) {
+		if ((offset = xref->bucket[h]) == 0)
+			return NULL;
+		for (; offset != 0; offset = record->next) {
+			record = (const XREF_RECORD *) (xref->base + offset);
+			if (strcmp(xref->base + record->text, key) == 0)
+				return record;
+		}
+		if (probes++ == PROBE_LIMIT(size))
+			return NULL;
+		h = hashKeyQuad(h, size);
+	}
+}
+
+/* This function sets a cursor before the first place of a term's
+/* posting list.
+*/
+void
+openXrefCursor(XREF *xref, const XREF_RECORD *term, XREF_CURSOR *cursor)
+{
+	cursor->term     = term;
+	cursor->postings = (const unsigned char *) xref->base + term->postings;
+	cursor->p        = cursor->postings;
+	cursor->skip     = (const XREF_SKIP_ENTRY *) (xref->base + term->skips);
+	cursor->left     = term->count;
+	cursor->file     = 0;
+	cursor->line     = 0;
+}
+
+/* This function decodes the next place of a cursor's posting list.
+/* It returns 1, or 0 if the list is used up.
+*/
+int
+xrefCursorNext(XREF_CURSOR *cursor)
+{
+	uint32_t gap;
+
+	if (cursor->left == 0)
+		return 0;
+
+	gap = getVarint(&cursor->p);
+	cursor->file += gap;
+	if (gap != 0)
+		cursor->line = getVarint(&cursor->p);
+	else
+		cursor->line += getVarint(&cursor->p);
+	cursor->left--;
+	return 1;
+}
+
+/* This function moves a cursor on to the first place at or after a
+/* given place.  The skip entries past the cursor are searched for the
+/* last one before the place, galloping (1, 2, 4... entries ahead) and
+/* then halving, so a nearby place costs a compare or two and a distant
+/* one a logarithmic search.  Decoding resumes from that entry, so only
+/* the run holding the place is decoded.
+/* It returns 1, or 0 if no such place is left.
+*/
+int
+xrefCursorSeek(XREF_CURSOR *cursor, uint64_t target)
+{
+	const XREF_SKIP_ENTRY *skip = cursor->skip;
+	uint32_t decoded = cursor->term->count - cursor->left;
+	uint32_t nskips = cursor->term->nskips;
+	uint32_t lo, hi, mid, step;
+
+	if (decoded > 0 && XREF_PLACE(cursor->file, cursor->line) >= target)
+		return 1;
+
+	/** Find the first skip entry not before the place; the one before
+	 ** it, if it is still ahead of the cursor, is where to resume...
+	 **/
+	lo = decoded / XREF_SKIP;
+	hi = lo;
+	if (lo < nskips && XREF_PLACE(skip[lo].file, skip[lo].line) < target) {
+		for (step = 1; lo + step < nskips &&
+			 XREF_PLACE(skip[lo + step].file, skip[lo + step].line) < target; step *= 2)
+			;
+		hi = (lo + step < nskips) ? lo + step : nskips;
+		lo += step / 2 + 1;
+	}
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (XREF_PLACE(skip[mid].file, skip[mid].line) < target)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo > decoded / XREF_SKIP) {
+		cursor->p    = cursor->postings + skip[lo - 1].offset;
+		cursor->file = skip[lo - 1].file;
+		cursor->line = skip[lo - 1].line;
+		cursor->left = cursor->term->count - lo * XREF_SKIP;
+	}
+
+	while (xrefCursorNext(cursor))
+		if (XREF_PLACE(cursor->file, cursor->line) >= target)
+			return 1;
+	return 0;
+}
+
+/* This function compares two places for qsort().
+*/
+int
+comparePlace(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* This function finds the places a query matches.  A query is one or
+/* more groups of terms joined by |, and a group is one or more terms
+/* joined by &.  A group matches the lines holding all of its terms,
+/* found by leapfrogging cursors: each in turn seeks the latest place
+/* any of them is at, until they all agree.  The query matches the
+/* lines any of its groups match.
+/* It expects the address of a pointer to set to the places, in order,
+/* which the caller must free, and returns the number of places.
+*/
+unsigned long
+findXrefPlaces(XREF *xref, char *query, uint64_t **places)
+{
+	XREF_CURSOR cursor[XREF_MAXTERMS];
+	const XREF_RECORD *record;
+	uint64_t *found = NULL, target;
+	unsigned long nfound = 0, found_size = 0, i;
+	char *copy, *group, *term, *group_end, *term_end;
+	int nterms, n, agree, groups = 0, missing;
+
+	if ((copy = stringDup(query)) == NULL) {
+		printf("Error: Unable to allocate query storage\n");
+		exit(-1);
+	}
+
+	for (group = strtok_r(copy, "|", &group_end); group != NULL;
+		 group = strtok_r(NULL, "|", &group_end)) {
+		groups++;
+
+		/** Open a cursor on each term of the group...
+		 **/
+		nterms = 0;
+		missing = FALSE;
+		for (term = strtok_r(group, "& \t", &term_end); term != NULL;
+			 term = strtok_r(NULL, "& \t", &term_end)) {
+			if ((record = findXrefTerm(xref, term)) == NULL)
+				missing = TRUE;
+			else if (nterms < XREF_MAXTERMS)
+				openXrefCursor(xref, record, &cursor[nterms++]);
+		}
+		if (missing || nterms == 0)
+			continue;
+
+		/** Leapfrog until a cursor runs out...
+		 **/
+		if (!xrefCursorNext(&cursor[0]))
+			continue;
+		target = XREF_PLACE(cursor[0].file, cursor[0].line);
+		agree = 1;
+		for (n = 1 % nterms; ; n = (n + 1) % nterms) {
+			if (agree < nterms) {
+				if (!xrefCursorSeek(&cursor[n], target))
+					break;
+				if (XREF_PLACE(cursor[n].file, cursor[n].line) == target)
+					agree++;
+				else {
+					target = XREF_PLACE(cursor[n].file, cursor[n].line);
+					agree = 1;
+				}
+				if (agree < nterms)
+					continue;
+			}
+
+			/** Every cursor is at target...
+			 **/
+			if (nfound == found_size) {
+				found_size = found_size ? 2 * found_size : 1024;
+				if ((found = (uint64_t *) realloc(found, found_size * sizeof(uint64_t))) == NULL) {
+					printf("Error: Unable to allocate query storage\n");
+					exit(-1);
+				}
+			}
+			found[nfound++] = target;
+
+			if (!xrefCursorNext(&cursor[n]))
+				break;
+			target = XREF_PLACE(cursor[n].file, cursor[n].line);
+			agree = 1;
+		}
+	}
+
+	/** Several groups may have found the same lines...
+	 **/
+	if (groups > 1 && nfound > 0) {
+		qsort(found, nfound, sizeof(uint64_t), comparePlace);
+		for (n = 0, i = 1; i < nfound; i++)
+			if (found[i] != found[n])
+				found[++n] = found[i];
+		nfound = n + 1;
+	}
+
+	free(copy);
+	*places = found;
+	return nfound;
+} /* End findXrefPlaces. */
+
+/* This function answers cross-reference queries from an index file:
+/* those given, or else one per line of standard input, read with
+/* nextLine() so a query of any length stays whole.  Each place is
+/* written to standard output as "file:line"; the count and the time
+/* the query took go to standard error.
+*/
+void
+runXrefQueries(char *index_filename, int nqueries, char **queries, int verify)
+{
+	XREF xref;
+	uint64_t *places;
+	unsigned long nplaces, i;
+	double start;
+	INPUT_MAP input;
+	const char *text;
+	char *query, *line = NULL;
+	size_t len, line_size = 0;
+	int q;
+
+	start = elapsedSeconds();
+	if (!openXref(index_filename, &xref, verify))
+		exit(-1);
+	fprintf(stderr, "Mapped %lu terms in %lu files from %s in %.3f ms\n",
+			(unsigned long) xref.header->nterms, (unsigned long) xref.header->nfiles,
+			index_filename, (elapsedSeconds() - start) * 1e3);
+
+	if (nqueries == 0 && !openInputStream(NULL, &input)) {
+		printf("Error: Unable to allocate query buffers\n");
+		exit(-1);
+	}
+
+	for (q = 0; nqueries == 0 || q < nqueries; q++) {
+		if (nqueries == 0) {
+			if (!nextLine(&input, &text, &len))
+				break;
+			if (len == 0)
+				continue;
+			if (len + 1 > line_size) {
+				line_size = 2 * (len + 1);
+				if ((line = (char *) realloc(line, line_size)) == NULL) {
+					printf("Error: Unable to allocate query buffers\n");
+					exit(-1);
+				}
+			}
+			memcpy(line, text, len);
+			line[len] = '\0';
+			query = line;
+		} else
+			query = queries[q];
+
+		start = elapsedSeconds();
+		nplaces = findXrefPlaces(&xref, query, &places);
+		fprintf(stderr, "%lu place(s) for %s in %.3f ms\n", nplaces, query,
+				(elapsedSeconds() - start) * 1e3);
+
+		for (i = 0; i < nplaces; i++)
+			printf("%s:%u\n", xref.base + xref.file[places[i] >> 32].name,
+				   (unsigned int) (places[i] & 0xFFFFFFFF));
+		free(places);
+	}
+
+	if (nqueries == 0)
+		closeInputMap(&input);
+	free(line);
+	closeXref(&xref);
+} /* End runXrefQueries. */
+
+/*********************************************************
+ **                                                     **
+ **                    Lookup Server                    **
+ **                                                     **
+ *********************************************************/
+
+/* Set by stopServer() when the server is told to stop.
+ */
+static volatile sig_atomic_t server_stop = FALSE;
+
+/* This function is the server's handler for SIGINT and SIGTERM.  It
+/* asks the event loop to stop; epoll_wait() returns early when the
+/* signal arrives, so the loop sees the request straight away.
+*/
+void
+stopServer(int signal_number)
+{
+	(void) signal_number;
+	server_stop = TRUE;
+}
+
+/* This function makes a Unix domain socket for the server to listen
+/* on, replacing any file already at the path.
+/* It returns the socket.  If the socket can't be made it prints an
+/* appropriate message and exits from the program.
+*/
+int
+openServerSocket(char *socket_filename)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	if (strlen(socket_filename) >= sizeof(address.sun_path)) {
+		printf("Socket name is too long: %s\n", socket_filename);
+		exit(-1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_filename);
+
+	unlink(socket_filename);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0 ||
+		bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+		listen(fd, SOMAXCONN) != 0) {
+		printf("Can't listen on socket: %s\n", socket_filename);
+		exit(-1);
+	}
+
+	return fd;
+}
+
+/* This function connects to a server's Unix domain socket.
+/* It returns the connected socket, or -1 if there is no server there.
+*/
+int
+connectServer(char *socket_filename)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socket_filename, sizeof(address.sun_path) - 1);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* This function answers the complete requests waiting in a connection's
+/* input buffer, while there is room for their responses.  Keys are
+/* copied out of the frames and null terminated, then looked up
+/* BATCH_SIZE at a time after prefetchBatch(), as -batch does.
+/* Requests not answered yet stay at the front of the buffer.
+*/
+void
+answerRequests(HASH_TAB *hash_tab, SNAPSHOT *snapshot, SERVE_CONN *conn,
+			   BATCH_COUNTS *counts)
+{
+	static char scratch[SERVE_BUFSIZE + BATCH_SIZE];	/* Keys of one batch */
+	const unsigned char *p = (const unsigned char *) conn->in;
+	const unsigned char *end = p + conn->in_used;
+	char *keys[BATCH_SIZE], *key = scratch;
+	size_t len, room = SERVE_BUFSIZE - conn->out_used;
+	int nkeys = 0, found, i;
+
+	for (;;) {
+		if (end - p >= 2 && room > 0 &&
+			(size_t) (end - p) >= 2 + (len = p[0] | (p[1] << 8))) {
+			if (hash_tab != NULL)
+				copyKey(hash_tab, key, (const char *) p + 2, len);
+			else {
+				memcpy(key, p + 2, len);
+				key[len] = '\0';
+			}
+			keys[nkeys++] = key;
+			key += len + 1;
+			p += 2 + len;
+			room--;
+			if (nkeys < BATCH_SIZE)
+				continue;
+		}
+		if (nkeys == 0)
+			break;
+
+		prefetchBatch(hash_tab, snapshot, keys, nkeys);
+		for (i = 0; i < nkeys; i++) {
+			if (hash_tab != NULL)
+				found = findHashEntry(hash_tab, keys[i]);
+			else
+				found = findSnapshotEntry(snapshot, keys[i]);
+			conn->out[conn->out_used++] = found;
+			counts->hits += found;
+		}
+		counts->queries += nkeys;
+		conn->requests += nkeys;
+		nkeys = 0;
+		key = scratch;
+	}
+
+	conn->in_used = end - p;
+	memmove(conn->in, p, conn->in_used);
+}
+
+/* This function serves a connection that epoll reported ready: it reads
+/* what has come in if readable is 1, then answers and writes back until
+/* the requests run out or the socket won't take any more.  Responses
+/* left over are written when epoll says there is room.
+/* It returns 1, or 0 if the connection is finished with.
+*/
+int
+serveConnection(HASH_TAB *hash_tab, SNAPSHOT *snapshot, SERVE_CONN *conn,
+				BATCH_COUNTS *counts, int readable)
+{
+	ssize_t got;
+
+	if (readable) {
+		got = read(conn->fd, conn->in + conn->in_used, SERVE_BUFSIZE - conn->in_used);
+		if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR))
+			return 0;
+		if (got > 0)
+			conn->in_used += got;
+	}
+
+	for (;;) {
+		answerRequests(hash_tab, snapshot, conn, counts);
+		if (conn->out_used == 0)
+			return 1;
+
+		if ((got = write(conn->fd, conn->out, conn->out_used)) < 0)
+			return (errno == EAGAIN || errno == EINTR);
+		conn->out_used -= got;
+		memmove(conn->out, conn->out + got, conn->out_used);
+		if (conn->out_used > 0)
+			return 1;
+	}
+}
+
+/* This function answers lookups over a Unix domain socket until it is
+/* sent SIGINT or SIGTERM.
 /*
-/* This function calls hashKey(), sequentialSearch(), findRehashKey ().
+/* A request is a key's length in two bytes, low byte first, then the
+/* key; the response is one byte, 1 if the key is in the table and 0
+/* if not.  A client may send any number of requests without waiting,
+/* and responses come back in the order of the requests.
+/*
+/* One thread serves every connection from an epoll loop.  A connection
+/* is watched for input until its responses back up, then for room to
+/* write them instead, so a client that stops reading holds up only
+/* itself.
+/*
+/* It expects either a table or a snapshot (the other NULL) and the name
+/* of the socket, which is removed again when the server stops.
+*/
+void
+runServer(HASH_TAB *hash_tab, SNAPSHOT *snapshot, char *socket_filename)
+{
+	BATCH_COUNTS counts = { 0, 0 };
+	struct epoll_event event, events[SERVE_EVENTS];
+	struct sigaction action;
+	SERVE_CONN *conn;
+	unsigned long connections = 0;
+	double start;
+	int listen_fd, epoll_fd, fd, nevents, k;
+
+	listen_fd = openServerSocket(socket_filename);
+	if ((epoll_fd = epoll_create1(0)) < 0) {
+		printf("Error: Unable to create an epoll instance\n");
+		exit(-1);
+	}
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;				/* Marks the listening socket */
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+
+	/** Stop on SIGINT or SIGTERM, without restarting epoll_wait(), and
+	 ** let writes to clients that have gone fail instead of killing us...
+	 **/
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stopServer;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(stderr, "Serving lookups on %s\n", socket_filename);
+
+	start = elapsedSeconds();
+	while (!server_stop) {
+		if ((nevents = epoll_wait(epoll_fd, events, SERVE_EVENTS, -1)) < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("Error: epoll_wait failed\n");
+			break;
+		}
+
+		for (k = 0; k < nevents; k++) {
+			conn = (SERVE_CONN *) events[k].data.ptr;
+
+			/** Take on every connection that is waiting...
+			 **/
+			if (conn == NULL) {
+				while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+					fcntl(fd, F_SETFL, O_NONBLOCK);
+					if ((conn = (SERVE_CONN *) malloc(sizeof(SERVE_CONN))) == NULL) {
+						printf("Error: Unable to allocate connection storage\n");
+						exit(-1);
+					}
+					conn->fd = fd;
+					conn->in_used = conn->out_used = 0;
+					conn->writing = FALSE;
+					conn->requests = 0;
+					event.events = EPOLLIN;
+					event.data.ptr = conn;
+					epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+					connections++;
+				}
+				continue;
+			}
+
+			/** Serve the connection, then watch it for whatever it
+			 ** needs next...
+			 **/
+			if (!serveConnection(hash_tab, snapshot, conn, &counts,
+								 (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0)) {
+				close(conn->fd);
+				free(conn);
+			} else if (conn->writing != (conn->out_used > 0)) {
+				conn->writing = (conn->out_used > 0);
+				event.events = conn->writing ? EPOLLOUT : EPOLLIN;
+				event.data.ptr = conn;
+				epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+			}
+		}
+	}
+
+	close(epoll_fd);
+	close(listen_fd);
+	unlink(socket_filename);
+
+	fprintf(stderr, "Connections     \t= %10lu\n", connections);
+	fprintf(stderr, "Requests        \t= %10lu\n", counts.queries);
+	fprintf(stderr, "Hits            \t= %10lu\n", counts.hits);
+	fprintf(stderr, "Run time        \t= %10.3f s\n", elapsedSeconds() - start);
+} /* End runServer. */
+
+/* This function is the body of each load generator thread.  It keeps
+/* depth requests in flight on its own connection: it sends them in one
+/* write, then reads the responses, timing each from the write until it
+/* arrives, and starts over until the stop time.  The requests are for
+/* words picked at random from the word list, LOADGEN_BATCHES batches of
+/* them made up in advance so that making requests costs nothing.
+*/
+void *
+loadgenWorker(void *arg)
+{
+	LOADGEN_THREAD *self = (LOADGEN_THREAD *) arg;
+	size_t start[LOADGEN_BATCHES + 1], size = 0, used = 0, len;
+	unsigned char *request = NULL, *response;
+	unsigned long micros;
+	ssize_t got;
+	double sent, now;
+	char *word;
+	int fd, b, d, n;
+
+	/** Make up the requests...
+	 **/
+	for (b = 0; b < LOADGEN_BATCHES; b++) {
+		start[b] = used;
+		for (d = 0; d < self->depth; d++) {
+			word = self->words->names[nextRandom(&self->seed) % self->words->count];
+			if ((len = strlen(word)) > 0xFFFF)
+				len = 0xFFFF;
+			if (used + 2 + len > size) {
+				size = 2 * size + 2 + len;
+				if ((request = (unsigned char *) realloc(request, size)) == NULL) {
+					printf("Error: Unable to allocate request storage\n");
+					exit(-1);
+				}
+			}
+			request[used++] = len & 0xFF;
+			request[used++] = len >> 8;
+			memcpy(request + used, word, len);
+			used += len;
+		}
+	}
+	start[LOADGEN_BATCHES] = used;
+
+	if ((response = (unsigned char *) malloc(self->depth)) == NULL) {
+		printf("Error: Unable to allocate response storage\n");
+		exit(-1);
+	}
+
+	if ((fd = connectServer(self->socket_filename)) < 0) {
+		self->failed = TRUE;
+		free(request);
+		free(response);
+		return NULL;
+	}
+
+	/** Send a batch, take in its responses, and again...
+	 **/
+	for (b = 0; elapsedSeconds() < self->stop; b = (b + 1) % LOADGEN_BATCHES) {
+		sent = elapsedSeconds();
+		for (len = start[b]; len < start[b + 1]; len += got)
+			if ((got = write(fd, request + len, start[b + 1] - len)) <= 0)
+				break;
+
+		for (n = 0; n < self->depth; n += got) {
+			if ((got = read(fd, response + n, self->depth - n)) <= 0)
+				break;
+			now = elapsedSeconds();
+			micros = (unsigned long) ((now - sent) * 1e6);
+			self->latency[micros < LOADGEN_MAXLATENCY ? micros : LOADGEN_MAXLATENCY] += got;
+			for (d = n; d < n + got; d++)
+				self->hits += response[d];
+		}
+		if (n < self->depth) {
+			self->failed = TRUE;
+			break;
+		}
+		self->requests += self->depth;
+	}
+
+	close(fd);
+	free(request);
+	free(response);
+	return NULL;
+}
+
+/* This function finds the latency below which a share of the requests
+/* were answered, from a histogram of requests by microsecond.
+/* It returns the latency in microseconds.
+*/
+unsigned long
+latencyPercentile(unsigned long *latency, unsigned long requests, double share)
+{
+	unsigned long seen = 0, micros;
+
+	for (micros = 0; micros < LOADGEN_MAXLATENCY; micros++)
+		if ((seen += latency[micros]) >= share * requests)
+			break;
+
+	return micros;
+}
+
+/* This function drives a lookup server with requests for the words of a
+/* word list, from a number of connections with depth requests in flight
+/* on each, for a number of seconds, and reports the lookups per second
+/* and the latencies the requests saw.
+*/
+void
+runLoadGenerator(char *socket_filename, char *word_filename, int connections, int depth,
+				 int seconds)
+{
+	FILE_LIST words = { NULL, 0, 0, 0 };
+	LOADGEN_THREAD *threads;
+	unsigned long *latency, requests = 0, hits = 0, slowest = 0;
+	double start, elapsed;
+	int i, j;
+
+	readWordList(word_filename, &words);
+	if (words.count == 0) {
+		printf("No words in %s\n", word_filename);
+		return;
+	}
+
+	if ((threads = (LOADGEN_THREAD *) calloc(connections, sizeof(LOADGEN_THREAD))) == NULL ||
+		(latency = (unsigned long *) calloc(LOADGEN_MAXLATENCY + 1,
+											 sizeof(unsigned long))) == NULL) {
+		printf("Error: Unable to allocate load generator storage\n");
+		exit(-1);
+	}
+
+	start = elapsedSeconds();
+	for (i = 0; i < connections; i++) {
+		threads[i].socket_filename = socket_filename;
+		threads[i].words = &words;
+		threads[i].depth = depth;
+		threads[i].stop = start + seconds;
+		threads[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+		if ((threads[i].latency = (unsigned long *) calloc(LOADGEN_MAXLATENCY + 1,
+															 sizeof(unsigned long))) == NULL) {
+			printf("Error: Unable to allocate load generator storage\n");
+			exit(-1);
+		}
+		if (pthread_create(&threads[i].thread, NULL, loadgenWorker, &threads[i]) != 0) {
+			printf("Error: Unable to start load generator thread\n");
+			exit(-1);
+		}
+	}
+
+	for (i = 0; i < connections; i++) {
+		pthread_join(threads[i].thread, NULL);
+		if (threads[i].failed)
+			printf("Connection %d to %s failed\n", i + 1, socket_filename);
+		requests += threads[i].requests;
+		hits += threads[i].hits;
+		for (j = 0; j <= LOADGEN_MAXLATENCY; j++)
+			latency[j] += threads[i].latency[j];
+		free(threads[i].latency);
+	}
+	elapsed = elapsedSeconds() - start;
+
+	for (j = LOADGEN_MAXLATENCY; j > 0 && latency[j] == 0; j--)
+		;
+	slowest = j;
+
+	printf("Connections     \t= %10d\n", connections);
+	printf("Depth           \t= %10d (requests in flight per connection)\n", depth);
+	printf("Requests        \t= %10lu\n", requests);
+	printf("Hits            \t= %10lu\n", hits);
+	printf("Run time        \t= %10.3f s\n", elapsed);
+	printf("Lookups/second  \t= %10.0f\n", requests / elapsed);
+	if (requests > 0) {
+		printf("Latency p50     \t= %10lu us\n", latencyPercentile(latency, requests, 0.50));
+		printf("Latency p99     \t= %10lu us\n", latencyPercentile(latency, requests, 0.99));
+		printf("Latency p99.9   \t= %10lu us\n", latencyPercentile(latency, requests, 0.999));
+		printf("Latency max     \t= %10lu us%s\n", slowest,
+			   (slowest == LOADGEN_MAXLATENCY) ? " or more" : "");
+	}
+
+	free(latency);
+	free(threads);
+	for (i = 0; i < words.count; i++)
+		free(words.names[i]);
+	free(words.names);
+} /* End runLoadGenerator. */
+
+/*********************************************************
+ **                                                     **
+ **                   External Tables                   **
+ **                                                     **
+ *********************************************************/
+
+/* This function makes a working file of an external table at name,
+/* which must not already exist, and unlinks it as soon as it is open,
+/* so it goes away however the program ends.
+/* It returns the file's descriptor.  If name exists or can't be made,
+/* it prints an appropriate message and exits from the program.
+*/
+int
+createDiskFile(char *name)
+{
+	int fd;
+
+	if ((fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+		if (errno == EEXIST)
+			printf("Won't replace existing file: %s\n", name);
+		else
+			printf("Can't create file: %s\n", name);
+		exit(-1);
+	}
+	unlink(name);
+	return fd;
+}
+
+/* This function opens an external table for loading and hangs it on a
+/* table, so that addHashEntry() spills words to it.  The words are
+/* spread over enough partitions that, judging by the bytes expected to
+/* be spilled, each can be sorted within the budget on its own; half the
+/* budget is shared out as the partitions' write buffers, though none
+/* is made much bigger than its share of those bytes.  The table file
+/* and the partition files, named after it with ".0", ".1" and so on,
+/* are made through createDiskFile(), so they last only as long as the
+/* program and never take the place of a file already there.
+/* If the files can't be made or memory runs out, it prints an
+/* appropriate message and exits from the program.
+*/
+void
+initDiskTable(HASH_TAB *hash_tab, char *table_filename, size_t budget, uint64_t expected)
+{
+	DISK_TABLE *disk;
+	char *name;
+	uint64_t partitions;
+	int i;
+
+	if ((disk = (DISK_TABLE *) calloc(1, sizeof(DISK_TABLE))) == NULL ||
+		(name = (char *) malloc(strlen(table_filename) + 16)) == NULL) {
+		printf("Error: Unable to allocate external table storage\n");
+		exit(-1);
+	}
+
+	/** Sorting a partition takes its bytes and a pointer per word, and a
+	 ** pointer is smaller than a word's record header, so allow twice
+	 ** its bytes...
+	 **/
+	partitions = 2 * expected / budget + 1;
+	if (partitions > EXTERNAL_MAXPARTITIONS)
+		partitions = EXTERNAL_MAXPARTITIONS;
+	disk->npartitions = (int) partitions;
+	disk->partition_bufsize = budget / 2 / disk->npartitions;
+	if (disk->partition_bufsize > expected / disk->npartitions + EXTERNAL_PAGESIZE)
+		disk->partition_bufsize = expected / disk->npartitions + EXTERNAL_PAGESIZE;
+	if (disk->partition_bufsize < EXTERNAL_PAGESIZE)
+		disk->partition_bufsize = EXTERNAL_PAGESIZE;
+	disk->filename = stringDup(table_filename);
+
+	if ((disk->partition = (DISK_PARTITION *) calloc(disk->npartitions,
+													  sizeof(DISK_PARTITION))) == NULL ||
+		disk->filename == NULL) {
+		printf("Error: Unable to allocate external table storage\n");
+		exit(-1);
+	}
+
+	disk->fd = createDiskFile(table_filename);
+	for (i = 0; i < disk->npartitions; i++) {
+		sprintf(name, "%s.%d", table_filename, i);
+		disk->partition[i].fd = createDiskFile(name);
+		if ((disk->partition[i].buf = (char *) malloc(disk->partition_bufsize)) == NULL) {
+			printf("Error: Unable to allocate external table storage\n");
+			exit(-1);
+		}
+	}
+	free(name);
+
+	hash_tab->disk = disk;
+}
+
+/* This function writes out what a partition's buffer holds, at the end
+/* of the partition's file.
+/* If the file can't be written it prints an appropriate message and
+/* exits from the program.
+*/
+void
+flushDiskPartition(DISK_TABLE *disk, DISK_PARTITION *partition)
+{
+	size_t done;
+	ssize_t got;
+
+	for (done = 0; done < partition->used; done += got)
+		if ((got = write(partition->fd, partition->buf + done, partition->used - done)) <= 0) {
+			printf("Can't write partition file for: %s\n", disk->filename);
+			exit(-1);
+		}
+
+	partition->bytes += partition->used;
+	disk->spilled += partition->used;
+	partition->used = 0;
+}
+
+/* This function spills a word to the partition its hash falls in.  The
+/* partitions split the hashes into ranges in order, so the partitions,
+/* taken in turn, hold the words in hash order.
+*/
+void
+addDiskEntry(DISK_TABLE *disk, char *key)
+{
+	DISK_PARTITION *partition;
+	uint64_t hash = bloomHash(key);
+	uint32_t len = strlen(key);
+	size_t size = DISK_RECORDSIZE + len;
+
+	partition = &disk->partition[((hash >> 32) * disk->npartitions) >> 32];
+
+	if (partition->used + size > disk->partition_bufsize)
+		flushDiskPartition(disk, partition);
+
+	/** A word longer than the buffer goes straight out in pieces...
+	 **/
+	if (size > disk->partition_bufsize) {
+		memcpy(partition->buf, &hash, sizeof(hash));
+		memcpy(partition->buf + sizeof(hash), &len, sizeof(len));
+		partition->used = DISK_RECORDSIZE;
+		flushDiskPartition(disk, partition);
+		while (len > 0) {
+			size = (len < disk->partition_bufsize) ? len : disk->partition_bufsize;
+			memcpy(partition->buf, key, size);
+			partition->used = size;
+			flushDiskPartition(disk, partition);
+			key += size;
+			len -= size;
+		}
+	} else {
+		memcpy(partition->buf + partition->used, &hash, sizeof(hash));
+		memcpy(partition->buf + partition->used + sizeof(hash), &len, sizeof(len));
+		memcpy(partition->buf + partition->used + DISK_RECORDSIZE, key, len);
+		partition->used += size;
+	}
+
+	disk->added++;
+}
+
+/* This function compares two spilled words for qsort(), by hash, then
+/* length, then text, so that duplicates end up side by side.
+*/
+int
+compareDiskRecord(const void *a, const void *b)
+{
+	const char *x = *(const char **) a;
+	const char *y = *(const char **) b;
+	uint64_t hx, hy;
+	uint32_t lx, ly;
+
+	memcpy(&hx, x, sizeof(hx));
+	memcpy(&hy, y, sizeof(hy));
+	if (hx != hy)
+		return (hx < hy) ? -1 : 1;
+
+	memcpy(&lx, x + sizeof(hx), sizeof(lx));
+	memcpy(&ly, y + sizeof(hy), sizeof(ly));
+	if (lx != ly)
+		return (lx < ly) ? -1 : 1;
+
+	return memcmp(x + DISK_RECORDSIZE, y + DISK_RECORDSIZE, lx);
+}
+
+/* This function adds a finished page to the table file and the
+/* directory.
+/* If memory runs out or the file can't be written, it prints an
+/* appropriate message and exits from the program.
+*/
+void
+writeDiskPage(DISK_TABLE *disk, const char *page, size_t length, uint64_t *offset,
+			  unsigned long *capacity)
+{
+	size_t done;
+	ssize_t got;
+
+	if (disk->npages == *capacity) {
+		*capacity = *capacity ? 2 * *capacity : 1024;
+		if ((disk->page = (DISK_PAGE *) realloc(disk->page,
+												*capacity * sizeof(DISK_PAGE))) == NULL) {
+			printf("Error: Unable to allocate external table storage\n");
+			exit(-1);
+		}
+	}
+
+	memcpy(&disk->page[disk->npages].first_hash, page, sizeof(uint64_t));
+	disk->page[disk->npages].offset = *offset;
+	disk->page[disk->npages].length = length;
+	disk->npages++;
+
+	for (done = 0; done < length; done += got)
+		if ((got = write(disk->fd, page + done, length - done)) <= 0) {
+			printf("Can't write table file: %s\n", disk->filename);
+			exit(-1);
+		}
+	*offset += length;
+
+	if (length > disk->page_bufsize)
+		disk->page_bufsize = length;
+}
+
+/* This function finishes loading an external table.  Each partition in
+/* turn is read back, sorted by hash with its duplicates dropped, and
+/* written to the table file in pages of up to EXTERNAL_PAGESIZE bytes.
+/* A page only grows past that to hold a longer word, or more words of
+/* one hash, which are never split across pages.  The directory records
+/* where each page is and the least hash in it; the table file is of no
+/* use without it, which is why initDiskTable() made it a working file.
+/* The write buffers are released first, so the budget is free for the
+/* sorting.  If memory runs out or a file can't be used, it prints an
+/* appropriate message and exits from the program.
 */
-int 
-findHashEntry(HASH_TAB hash_tab, char *key)
-{ 
-	int i = 0;
-	NODE_PTR target_node_ptr;
-	
-	/**  Get converted or "hashed" key from hash function...
-	 **/
-	i = hashKey(key);
+void
+sealDiskTable(DISK_TABLE *disk)
+{
+	DISK_PARTITION *partition;
+	unsigned long capacity = 0, nrecords, r;
+	uint64_t offset = 0, hash, last_hash = 0;
+	char **record, *data, *page;
+	size_t used, size, page_used, page_size = EXTERNAL_PAGESIZE;
+	uint32_t len;
+	ssize_t got;
+	int i;
 
-	/**  Use hashed key as array index to get list pointer...
-	 **/
-	target_node_ptr = hash_tab[i]; 
+	for (i = 0; i < disk->npartitions; i++) {
+		flushDiskPartition(disk, &disk->partition[i]);
+		free(disk->partition[i].buf);
+		disk->partition[i].buf = NULL;
+	}
 
-	/** Check if bucket is NOT empty...
-     **/
-	if( target_node_ptr != NULL) {    
-		
-		/** Check if item matches the item in current bucket...  
+	if ((page = (char *) malloc(EXTERNAL_PAGESIZE)) == NULL) {
+		printf("Error: Unable to allocate external table storage\n");
+		exit(-1);
+	}
+
+	for (i = 0; i < disk->npartitions; i++) {
+		partition = &disk->partition[i];
+		size = partition->bytes;
+
+		/** Read the partition back whole...
 		 **/
-		if ( strcmp(target_node_ptr->line_text, key) == 0) 
-			return 1;  /* Return match indicator...*/
-		
-		/** Check to see if item was placed on list due to overflow
-		 ** condition...  
+		if ((data = (char *) malloc(size + 1)) == NULL) {
+			printf("Error: Unable to allocate external table storage\n");
+			exit(-1);
+		}
+		for (used = 0; used < size; used += got)
+			if ((got = pread(partition->fd, data + used, size - used, used)) <= 0) {
+				printf("Can't read partition file for: %s\n", disk->filename);
+				exit(-1);
+			}
+		close(partition->fd);
+
+		/** Find and sort its words...
 		 **/
-		if ( sequentialSearch(target_node_ptr, key) == 1)
-			return 1;	/* Return match indicator...*/
-		
-		else
-			return 0;	/* Return new item indicator... */
-	}
+		for (nrecords = 0, used = 0; used < size; nrecords++) {
+			memcpy(&len, data + used + sizeof(uint64_t), sizeof(len));
+			used += DISK_RECORDSIZE + len;
+		}
+		if ((record = (char **) malloc((nrecords + 1) * sizeof(char *))) == NULL) {
+			printf("Error: Unable to allocate external table storage\n");
+			exit(-1);
+		}
+		for (r = 0, used = 0; r < nrecords; r++) {
+			record[r] = data + used;
+			memcpy(&len, data + used + sizeof(uint64_t), sizeof(len));
+			used += DISK_RECORDSIZE + len;
+		}
+		qsort(record, nrecords, sizeof(char *), compareDiskRecord);
 
-	if (target_node_ptr == NULL) {
-		
-		/** Check to see if item was placed in rehashed bucket
-		 ** due to collision and the alternate item that mapped 
-		 ** to the key (and caused the collision) has since been deleted.
+		/** Fill pages with the distinct words in order...
 		 **/
-		if ( findRehashKey (i, hash_tab, key) == 1)
-			return 1;
+		page_used = 0;
+		for (r = 0; r < nrecords; r++) {
+			if (r > 0 && compareDiskRecord(&record[r - 1], &record[r]) == 0)
+				continue;
+			memcpy(&hash, record[r], sizeof(hash));
+			memcpy(&len, record[r] + sizeof(hash), sizeof(len));
+			size = DISK_RECORDSIZE + len;
 
-		else
-			return 0;	/* Return Empty bucket indicator... */
+			if (page_used > 0 && page_used + size > EXTERNAL_PAGESIZE && hash != last_hash) {
+				writeDiskPage(disk, page, page_used, &offset, &capacity);
+				page_used = 0;
+			}
+			if (page_used + size > page_size) {
+				page_size = page_used + size;
+				if ((page = (char *) realloc(page, page_size)) == NULL) {
+					printf("Error: Unable to allocate external table storage\n");
+					exit(-1);
+				}
+			}
+			memcpy(page + page_used, record[r], size);
+			page_used += size;
+			last_hash = hash;
+			disk->words++;
+		}
+		if (page_used > 0)
+			writeDiskPage(disk, page, page_used, &offset, &capacity);
+
+		free(record);
+		free(data);
 	}
-	
-	else return 0;
 
-} /* End findHashEntry. */
+	free(page);
+	free(disk->partition);
+	disk->partition = NULL;
+	disk->file_size = offset;
 
-/* The purpose of this function is to search a list for a target item.
-/* It searches the list until the end of the list is indicated by NULL.
-/* 
-/* It expects the calling function will pass it a pointer to the head 
-/* of the list and search item.
-/* 
-/* If successful, this function returns 1.
-/* 
-/* If the item is not found, this function returns 0.
-/*
-/* It has no side effects.
+	if ((disk->page_buf = (char *) malloc(disk->page_bufsize + 1)) == NULL) {
+		printf("Error: Unable to allocate external table storage\n");
+		exit(-1);
+	}
+}
+
+/* This function finds a word in a sealed external table.  The word's
+/* hash is looked for in the directory, which gives the one page that
+/* can hold the word; that page is read and searched in hash order.
+/* It returns 1 if the word is found, 0 otherwise.
 */
-int 
-sequentialSearch(NODE_PTR current_ptr, char *search_item)
+int
+findDiskEntry(DISK_TABLE *disk, char *key)
 {
-	while (current_ptr != NULL) {
-	
-		if ( strcmp(current_ptr->line_text, search_item) == 0)
-		return 1;
-		
-		current_ptr = current_ptr->next_ptr;
+	uint64_t hash = bloomHash(key), page_hash;
+	uint32_t len = strlen(key), page_len;
+	unsigned long lo = 0, hi = disk->npages, mid;
+	const DISK_PAGE *page;
+	size_t used, done;
+	ssize_t got;
+
+	/** Find the last page whose least hash is no more than the word's...
+	 **/
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (disk->page[mid].first_hash <= hash)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	if (lo == 0)
+		return 0;
+	page = &disk->page[lo - 1];
+
+	for (done = 0; done < page->length; done += got)
+		if ((got = pread(disk->fd, disk->page_buf + done, page->length - done,
+						 page->offset + done)) <= 0) {
+			printf("Can't read table file: %s\n", disk->filename);
+			exit(-1);
+		}
+
+	for (used = 0; used < page->length; used += DISK_RECORDSIZE + page_len) {
+		memcpy(&page_hash, disk->page_buf + used, sizeof(page_hash));
+		memcpy(&page_len, disk->page_buf + used + sizeof(page_hash), sizeof(page_len));
+		if (page_hash > hash)
+			break;
+		if (page_hash == hash && page_len == len &&
+			memcmp(disk->page_buf + used + DISK_RECORDSIZE, key, len) == 0)
+			return 1;
+	}
+
 	return 0;
 }
 
-/* This function hashes a character to string to an integer hash table
-/* index.
-/* It expects the caller pass it an ascii string and make the hash table
-/* size available by way of a macro.
-/* It adds the ascii integer equivalents to the last char in the string
-/* and adds it to the factor of the number of letters in the string + 8
-/* and the last character's ascii equivalent. 
-/* 
-/* It passes this key hashed as an index to the caller.
+/* This function releases an external table: its files and its
+/* directory.
 */
-int 
-hashKey(char *key)
-{ 
+void
+freeDiskTable(DISK_TABLE *disk)
+{
 	int i;
-	int value = 0;
-	char *hold_key = key;  
-	
-	i = strlen(key);
 
-	if (key != NULL) {
-		value =  (key[i-1]) + key[0] * (i + 8) ;   /* A little this and that. */
+	if (disk->partition != NULL) {
+		for (i = 0; i < disk->npartitions; i++) {
+			close(disk->partition[i].fd);
+			free(disk->partition[i].buf);
+		}
+		free(disk->partition);
 	}
+	close(disk->fd);
 
-	return abs(value % HASHSIZE);  /* To bound values within the array. */
-} /* End hash. */
+	free(disk->page);
+	free(disk->page_buf);
+	free(disk->filename);
+}
 
-/* This function recalculate the key quadratically.
-/* It expects the calling funciton will pass the hashed key (of type int)
-/* calculated on the first unsuccessful attempt to find an empty bucket. 
-/* 
-/* The function returns a new key so that the caller can use the key to
-/* make a step through the hash table quadratically.
-/*
-/* This function expects that the integer size of the hash table will be 
-/* available by way of a macro.
+/* This function builds a table of the words of an input file, one per
+/* line, on disk instead of in memory, keeping to a budget of RAM.  It
+/* does what processInputFile() does, through addHashEntry(), with the
+/* table's nodes made one at a time on the stack, since an external
+/* table keeps only their text.  Duplicates are counted, not listed,
+/* since they only come to light when the table is sealed.  A summary
+/* of the load is written to fptr.
+/* If the file can't be read it prints an appropriate message and exits
+/* from the program.
 */
-int hashKeyQuad(int i)
+void
+loadExternalTable(char *input_filename, HASH_TAB *hash_tab, char *table_filename,
+				  size_t budget, FILE *fptr)
 {
-	i = (i + (i * i)) % HASHSIZE;  /* Rehash based on original key */
-	
-	return i;
-}
+	INPUT_MAP input;
+	NODE_ENTRY node;
+	const char *line;
+	unsigned long nlines;
+	size_t len, word_size = MAXARRAY;
+	double start, loaded;
 
-/* This function initializes the buckets in the hashtable to NULL.
-/* It expects the calling function will pass the address array of pointers.
-/* 
-/* Nothing is returned.
-/*
-/* There are no side effects to calling this function.
+	if (!openInputMap(input_filename, &input)) {
+		printf("Can't find input file: %s\n", input_filename);
+		exit(-1);
+	}
+	nlines = countLines(input.base, input.base + input.size) + 1;
+
+	start = elapsedSeconds();
+	initHashTable(hash_tab, HASHSIZE, HASH_FNV1A);
+	initDiskTable(hash_tab, table_filename, budget,
+				  input.size + (uint64_t) nlines * DISK_RECORDSIZE);
+
+	if ((node.line_text = (char *) malloc(word_size)) == NULL) {
+		printf("Error: Unable to allocate line text storage\n");
+		exit(-1);
+	}
+	node.next_ptr = NULL;
+	node.count = 1;
+
+	while (nextLine(&input, &line, &len)) {
+		if (len == 0)
+			continue;
+
+		if (len + 1 > word_size) {
+			word_size = 2 * (len + 1);
+			if ((node.line_text = (char *) realloc(node.line_text, word_size)) == NULL) {
+				printf("Error: Unable to allocate line text storage\n");
+				exit(-1);
+			}
+		}
+		memcpy(node.line_text, line, len);
+		node.line_text[len] = '\0';
+		addHashEntry(hash_tab, &node);
+	}
+	closeInputMap(&input);
+	free(node.line_text);
+
+	loaded = elapsedSeconds();
+	sealDiskTable(hash_tab->disk);
+
+	fprintf(fptr, "Words read      \t= %10lu\n", hash_tab->disk->added);
+	fprintf(fptr, "Distinct words  \t= %10lu (%lu duplicates)\n", hash_tab->disk->words,
+			hash_tab->disk->added - hash_tab->disk->words);
+	fprintf(fptr, "Partitions      \t= %10d of up to %lu bytes buffered\n",
+			hash_tab->disk->npartitions, (unsigned long) hash_tab->disk->partition_bufsize);
+	fprintf(fptr, "Bytes spilled   \t= %10lu\n", (unsigned long) hash_tab->disk->spilled);
+	fprintf(fptr, "Pages           \t= %10lu\n", hash_tab->disk->npages);
+	fprintf(fptr, "Table file      \t= %10lu bytes\n", (unsigned long) hash_tab->disk->file_size);
+	fprintf(fptr, "Directory       \t= %10lu bytes\n",
+			hash_tab->disk->npages * (unsigned long) sizeof(DISK_PAGE));
+	fprintf(fptr, "Partition time  \t= %10.3f s\n", loaded - start);
+	fprintf(fptr, "Seal time       \t= %10.3f s\n", elapsedSeconds() - loaded);
+} /* End loadExternalTable. */
+
+/*********************************************************
+ **                                                     **
+ **                    Tail Pipeline                    **
+ **                                                     **
+ *********************************************************/
+
+/* This function takes a free chunk for the tail stage to fill, waiting
+/* while the queue is full, which holds the tail stage back until the
+/* count stage catches up.
+/* It returns the chunk, emptied.
 */
-void 
-initHashTable(HASH_TAB hash_tab)
-{ 
-	int i;
- 
-	for(i = 0; i <= HASHSIZE - 1; i++)     
-		hash_tab[i] = NULL;
+TAIL_CHUNK *
+takeTailChunk(TAIL_PIPE *tail)
+{
+	TAIL_CHUNK *chunk;
 
-} /* End initHashTable. */
+	pthread_mutex_lock(&tail->lock);
+	while (tail->count == TAIL_QUEUESIZE) {
+		tail->full_waits++;
+		pthread_cond_wait(&tail->not_full, &tail->lock);
+	}
+	chunk = &tail->chunk[(tail->head + tail->count) % TAIL_QUEUESIZE];
+	pthread_mutex_unlock(&tail->lock);
 
-/* Read the reserved words from the input file ( one word per line), make a node
-for the linked list, add the node to the linked list if the word has not been
-previously entered.  */
+	chunk->used = 0;
+	return chunk;
+}
 
-void 
-processInputFile(char *input_filename, HASH_TAB hash_tab )
+/* This function hands the chunk being filled to the count stage, or,
+/* if last is set, tells it that there are no more.
+*/
+void
+sendTailChunk(TAIL_PIPE *tail, int last)
 {
-	char file_buffer[MAXARRAY];
-	FILE *fptr;     /* Pointer to input file */ 
-	NODE_PTR node_ptr;
- 
-	/** Open input file. Test for good file name. 
-	 **/
-	if ((fptr = fopen(input_filename,"r")) == NULL) {
-		printf("Can't find input file: %s\n",input_filename);
-		exit(-1);    /* Stop processing. */ 
+	pthread_mutex_lock(&tail->lock);
+	if (tail->filling != NULL && tail->filling->used > 0)
+		tail->count++;
+	tail->filling = NULL;
+	if (last)
+		tail->done = TRUE;
+	pthread_cond_signal(&tail->not_empty);
+	pthread_mutex_unlock(&tail->lock);
+}
+
+/* This function adds a retained line to the chunk being filled,
+/* sending the chunk on first if the line won't fit.  A line longer
+/* than a chunk gets a chunk to itself, grown to hold it.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+sendTailLine(TAIL_PIPE *tail, const char *text, size_t len)
+{
+	TAIL_CHUNK *chunk;
+
+	if (tail->filling != NULL && tail->filling->used + len + 1 > tail->filling->size)
+		sendTailChunk(tail, FALSE);
+	if (tail->filling == NULL)
+		tail->filling = takeTailChunk(tail);
+	chunk = tail->filling;
+
+	if (len + 1 > chunk->size) {
+		if ((chunk->text = (char *) realloc(chunk->text, len + 1)) == NULL) {
+			printf("Error: Unable to allocate tail chunk storage\n");
+			exit(-1);
+		}
+		chunk->size = len + 1;
 	}
- 
-	/** Read lines from input file until end of file
-	 ** Limit line length to a specified size... 
-	 ** Store lines in an array... 
-	 **/
-	while( fgets(file_buffer, MAXARRAY , fptr) != NULL ) {
+	memcpy(chunk->text + chunk->used, text, len);
+	chunk->text[chunk->used + len] = '\n';
+	chunk->used += len + 1;
+	tail->lines_kept++;
+}
 
-		/**  Replace the the array's terminating <NL> with a null byte...
-		 **/
-		file_buffer[strlen(file_buffer) - 1] = '\0'; /* Replace cr with null */
-		
-		/** Call function to allocate memory and insert array into node...
-		 ** Assign pointer to the new node...
+/* Thread body: the tail stage.  It finds the last nlines lines of the
+/* input and sends them, oldest first, to the count stage.  A mapped
+/* file is searched for them backwards from its end, so the lines before
+/* are never read.  A stream is read through, keeping the lines in a
+/* ring that grows up to nlines and then drops the oldest line for each
+/* new one; the ring's buffers are reused, so once it is full reading
+/* takes no allocation.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void *
+tailStage(void *arg)
+{
+	TAIL_PIPE *tail = (TAIL_PIPE *) arg;
+	INPUT_MAP input = tail->input;
+	TAIL_LINE *ring = NULL, *slot;
+	unsigned long capacity = 0, n, first;
+	const char *line, *p, *start;
+	size_t len;
+
+	if (input.mapped) {
+		/** Step back a line at a time from the end, past the newline
+		 ** that ends the file, if it ends in one...
 		 **/
-		node_ptr = makenode (file_buffer);
-		
-		/** If a node with the same key either does NOT already exist
-		 ** --or does not match, drop our new node in...
+		p = input.base + input.size;
+		if (p > input.base && p[-1] == '\n')
+			p--;
+		for (n = 0, start = p; n < tail->nlines; n++) {
+			while (p > input.base && p[-1] != '\n')
+				p--;
+			start = p;
+			if (p == input.base)
+				break;
+			p--;
+		}
+		input.next = start - input.base;
+
+		while (nextLine(&input, &line, &len))
+			sendTailLine(tail, line, len);
+		tail->lines_read = tail->lines_kept;
+		tail->from_end = TRUE;
+	} else {
+		while (nextLine(&input, &line, &len)) {
+			if (tail->lines_read == capacity && capacity < tail->nlines) {
+				capacity = capacity ? 2 * capacity : TAIL_RINGSIZE;
+				if (capacity > tail->nlines)
+					capacity = tail->nlines;
+				if ((ring = (TAIL_LINE *) realloc(ring, capacity * sizeof(TAIL_LINE))) == NULL) {
+					printf("Error: Unable to allocate tail line storage\n");
+					exit(-1);
+				}
+				memset(ring + tail->lines_read, 0,
+					   (capacity - tail->lines_read) * sizeof(TAIL_LINE));
+			}
+
+			slot = &ring[tail->lines_read % capacity];
+			if (slot->text == NULL || len > slot->size) {
+				slot->size = (len > MAXARRAY) ? len : MAXARRAY;
+				free(slot->text);
+				if ((slot->text = (char *) malloc(slot->size)) == NULL) {
+					printf("Error: Unable to allocate tail line storage\n");
+					exit(-1);
+				}
+			}
+			memcpy(slot->text, line, len);
+			slot->len = len;
+			tail->lines_read++;
+		}
+
+		/** Send the ring on, oldest line first...
 		 **/
-		if (!findHashEntry(hash_tab, node_ptr->line_text)) {
-			addHashEntry(hash_tab, node_ptr); 
-		}	
-		else
-			printf("\"%s\" has already been entered into the hash table\n",
-		node_ptr->line_text); 
-	} /* End while. */
-} /* End  processInputFile. */
+		n = (tail->lines_read < capacity) ? tail->lines_read : capacity;
+		first = (tail->lines_read <= capacity) ? 0 : tail->lines_read % capacity;
+		for (; n > 0; n--, first = (first + 1) % capacity)
+			sendTailLine(tail, ring[first].text, ring[first].len);
 
-/* Add an entry to the hash table, if an entry already exists at that cell,
-   then insert the new node first in the list since all reserved words in
-   the input file are unique. */
+		for (n = 0; n < capacity; n++)
+			free(ring[n].text);
+		free(ring);
+	}
+	tail->failed = input.failed;
+	closeInputMap(&input);
 
-/* This function adds an entry into the chained hash table.
-/* 
-/* It EXPECTS the caller to pass to it:
-/*  - An array of pointers, or that is to say, a "hash table."
-/*  - A pointer to a new node containing arbitrary data.
-/* 
-/* The purpose of this function is to get an appropriate key and
-/* insert the node into a any one of the lists pointed too by the
-/* hash table.  
+	sendTailChunk(tail, TRUE);
+	return NULL;
+}
+
+/* This function counts one word of a retained line, if it is in the
+/* table, on the word's node.
 */
-void 
-addHashEntry(HASH_TAB hash_tab, NODE_PTR new_node_ptr)
+void
+countTailWord(const char *token, int len, void *arg)
 {
-	int h = 0; /* */
-	int r; /* Rehashed key */
-	char *key;
-	
-	NODE_PTR target_node_ptr;
+	TAIL_PIPE *tail = (TAIL_PIPE *) arg;
+	NODE_PTR node_ptr;
 
-	key = new_node_ptr->line_text;
-	
-	/**  Get converted or "hashed" key from hash function...
-	 **/
-	h = hashKey(key);
+	tail->words++;
+	if (len > tail->longest)
+		return;
 
-	/**  Use hashed key as array index to get intended list pointer...
-	 **/
-	target_node_ptr = hash_tab[h]; 
+	copyKey(tail->hash_tab, tail->key, token, len);
+	if ((node_ptr = findHashNode(tail->hash_tab, tail->key)) != NULL) {
+		if (node_ptr->count++ == 0)
+			tail->distinct++;
+		tail->found++;
+	}
+}
 
-	/** Bucket EMPTY...
-	 ** Assign the address of new node...
-     **/
-	if (target_node_ptr == NULL)     
-		hash_tab[h] = new_node_ptr;
-	
-	/** Bucket NOT empty...
-	 ** Rehash key...
-     **/
-	if (target_node_ptr != NULL) {
-		r = rehashKey(h, hash_tab);
-		
-		/** If rehashKey indicates assumed overflow conditions exist
-		 ** --add node to list using original key...
-		 **/
-		if (r == -1) {	
-			target_node_ptr = hash_tab[h];
-			new_node_ptr->next_ptr = target_node_ptr;
-			hash_tab[h] = new_node_ptr;
-		
-		/** If rehashKey returns a key, an empty bucket was found...
-		 ** Add node to the table using rehashed key...
-		 **/
-		} else    
-			hash_tab[r] = new_node_ptr;
+/* Thread body: the count stage.  It takes chunks of retained lines off
+/* the queue as the tail stage sends them, splits them into words and
+/* counts the words that are in the table, giving each chunk back once
+/* it is done with it.
+*/
+void *
+countStage(void *arg)
+{
+	TAIL_PIPE *tail = (TAIL_PIPE *) arg;
+	TAIL_CHUNK *chunk;
+
+	for (;;) {
+		pthread_mutex_lock(&tail->lock);
+		while (tail->count == 0 && !tail->done) {
+			tail->empty_waits++;
+			pthread_cond_wait(&tail->not_empty, &tail->lock);
+		}
+		if (tail->count == 0) {
+			pthread_mutex_unlock(&tail->lock);
+			return NULL;
+		}
+		chunk = &tail->chunk[tail->head];
+		pthread_mutex_unlock(&tail->lock);
+
+		splitWords(chunk->text, chunk->used, countTailWord, tail);
+
+		pthread_mutex_lock(&tail->lock);
+		tail->head = (tail->head + 1) % TAIL_QUEUESIZE;
+		tail->count--;
+		pthread_cond_signal(&tail->not_full);
+		pthread_mutex_unlock(&tail->lock);
 	}
+}
 
-} /* End addHashEntry. */
+/* This function compares two nodes for qsort(): biggest count first,
+/* then in alphabetical order.
+*/
+int
+compareNodeCount(const void *a, const void *b)
+{
+	NODE_PTR x = *(const NODE_PTR *) a;
+	NODE_PTR y = *(const NODE_PTR *) b;
 
-/* The purpose of this function to perform a quadratic search for an
-/* empty bucket until either the empty bucket is found or an overflow
-/* indication is detected.
-/*
-/* If an overflow indication is detected, this function will return 
-/* -1 back to the caller to indicate that the search for an empty
-/* bucket failed.
-/* 
-/* If the function finds an empty bucket, the key for that bucket is 
-/* return to the caller.
-/*  
-/* This function expects to be passed:
-/* - A empty, full, or partially full hash table.
-/* - Any key for that hash table.
+	if (x->count != y->count)
+		return (x->count < y->count) ? 1 : -1;
+	return strcmp(x->line_text, y->line_text);
+}
+
+/* This function counts the words of the table in the last nlines lines
+/* of a text file, or of standard input if filename is NULL, as tailx
+/* and then TokenExtractor would, but in one process: a tail stage finds
+/* the lines and a count stage counts the words, each on its own
+/* thread, with a queue of TAIL_QUEUESIZE chunks of lines between them.
+/* A full queue holds the tail stage back, so memory stays bounded
+/* whatever the count stage's pace, and nothing is written to disk.
+/* A summary comes first; then the words found, most frequent first,
+/* with their counts.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+runTailPipeline(HASH_TAB *hash_tab, char *filename, unsigned long nlines)
+{
+	TAIL_PIPE tail;
+	pthread_t tail_thread, count_thread;
+	NODE_PTR node_ptr, *found;
+	unsigned long n;
+	double start, seconds;
+	int i;
+
+	memset(&tail, 0, sizeof(tail));
+	if (!openInputStream(filename, &tail.input)) {
+		printf("Can't read text file: %s\n", filename);
+		return;
+	}
+
+	initCharClasses();
+	if (hash_tab->fold_case)
+		allowUtf8Identifiers();
+	pthread_mutex_init(&tail.lock, NULL);
+	pthread_cond_init(&tail.not_full, NULL);
+	pthread_cond_init(&tail.not_empty, NULL);
+	tail.nlines = nlines;
+	tail.hash_tab = hash_tab;
+	tail.longest = longestHashEntry(hash_tab);
+
+	if ((tail.key = (char *) malloc(tail.longest + 1)) == NULL) {
+		printf("Error: Unable to allocate tail chunk storage\n");
+		exit(-1);
+	}
+	for (i = 0; i < TAIL_QUEUESIZE; i++) {
+		tail.chunk[i].size = TAIL_CHUNKSIZE;
+		if ((tail.chunk[i].text = (char *) malloc(TAIL_CHUNKSIZE)) == NULL) {
+			printf("Error: Unable to allocate tail chunk storage\n");
+			exit(-1);
+		}
+	}
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			node_ptr->count = 0;
+
+	start = elapsedSeconds();
+	if (pthread_create(&count_thread, NULL, countStage, &tail) != 0 ||
+		pthread_create(&tail_thread, NULL, tailStage, &tail) != 0) {
+		printf("Error: Unable to start pipeline threads\n");
+		exit(-1);
+	}
+	pthread_join(tail_thread, NULL);
+	pthread_join(count_thread, NULL);
+	seconds = elapsedSeconds() - start;
+
+	if (tail.failed)
+		printf("Error: Reading %s stopped short\n", filename ? filename : "standard input");
+
+	printf("Lines read      \t= %10lu%s\n", tail.lines_read,
+		   tail.from_end ? " (from the end of the file)" : "");
+	printf("Lines kept      \t= %10lu\n", tail.lines_kept);
+	printf("Words counted   \t= %10lu\n", tail.words);
+	printf("Words found     \t= %10lu (%lu distinct)\n", tail.found, tail.distinct);
+	printf("Queue full      \t= %10lu times (tail stage waited)\n", tail.full_waits);
+	printf("Queue empty     \t= %10lu times (count stage waited)\n", tail.empty_waits);
+	printf("Run time        \t= %10.3f s\n\n", seconds);
+
+	/** List the words found, most frequent first...
+	 **/
+	if ((found = (NODE_PTR *) malloc((tail.distinct + 1) * sizeof(NODE_PTR))) == NULL) {
+		printf("Error: Unable to allocate tail chunk storage\n");
+		exit(-1);
+	}
+	n = 0;
+	for (i = 0; i <= hash_tab->size - 1; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			if (node_ptr->count > 0)
+				found[n++] = node_ptr;
+	qsort(found, n, sizeof(NODE_PTR), compareNodeCount);
+	for (i = 0; i < (int) n; i++)
+		printf("%10lu\t%s\n", found[i]->count, found[i]->line_text);
+
+	free(found);
+	free(tail.key);
+	for (i = 0; i < TAIL_QUEUESIZE; i++)
+		free(tail.chunk[i].text);
+	pthread_mutex_destroy(&tail.lock);
+	pthread_cond_destroy(&tail.not_full);
+	pthread_cond_destroy(&tail.not_empty);
+} /* End runTailPipeline. */
+
+/*********************************************************
+ **                                                     **
+ **                   Churn Benchmark                   **
+ **                                                     **
+ *********************************************************/
+
+/* This function searches for every word in the table and for as many
+/* that aren't, and prints a row of the churn benchmark: the buckets
+/* looked in per search, how many words sit in chains, how many were
+/* moved back by deletions since the last row, and the times taken.
 */
-int 
-rehashKey(int h, HASH_TAB hash_tab)
+void
+printChurnRound(HASH_TAB *hash_tab, int round, NODE_PTR *live, char **absent,
+				unsigned long n, double replace_seconds)
 {
-	NODE_PTR target_node_ptr;
+	HASH_STATS *stats = &hash_tab->stats;
+	NODE_PTR node_ptr;
+	unsigned long i, chained = 0, found = 0, moved = stats->moved_back;
+	double start, seconds;
 
-	int assume_over_flow = 0;
+	for (i = 0; i < (unsigned long) hash_tab->size; i++)
+		if ((node_ptr = hash_tab->bucket[i]) != NULL)
+			for (node_ptr = node_ptr->next_ptr; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+				chained++;
 
-	target_node_ptr = hash_tab[h];
+	memset(stats, 0, sizeof(HASH_STATS));
+	stats->enabled = TRUE;
 
-	while (target_node_ptr != NULL) {
-		if ( assume_over_flow == (HASHSIZE + 1) / 2) {
-			/** Indicate to caller probing failed to find empty bucket... 
-			 **/
-			return -1; 
-		}
-		
-		h = hashKeyQuad(h); /* Rehash based on original key */
-		assume_over_flow++;
-		target_node_ptr = hash_tab[h]; /* Get pointer at new key position */
-			
-	}
-	/** Return successful rehash to caller... 
-	 **/
-	return h;
+	start = elapsedSeconds();
+	for (i = 0; i < n; i++)
+		found += findHashEntry(hash_tab, live[i]->line_text);
+	for (i = 0; i < n; i++)
+		found += findHashEntry(hash_tab, absent[i]);
+	seconds = elapsedSeconds() - start;
+
+	printf("%5d\t%6.3f %4lu\t%6.3f %4lu\t%8lu\t%8lu\t%7.1f\t%10.1f%s\n", round,
+		   (double) stats->hit_probes / n, stats->max_hit_probes,
+		   (double) stats->miss_probes / n, stats->max_miss_probes, chained, moved,
+		   seconds * 1e9 / (2 * n), round ? replace_seconds * 1e9 / n : 0.0,
+		   found == n ? "" : "\t(lost words!)");
+
+	memset(stats, 0, sizeof(HASH_STATS));
+	stats->enabled = TRUE;
 }
 
-/* The purpose of this function is to use quadratic probing to backtrack 
-/* over the buckets to find a key not in the expected (hashed) position.
+/* This function measures whether searches slow down as words come and
+/* go.  For CHURN_ROUNDS rounds, it replaces as many words as the table
+/* holds, each time deleting a word picked at random and adding a new
+/* one, so the table stays the same size while every word is replaced
+/* about once a round.  Before the first round and after each, it prints
+/* the buckets looked in per successful and unsuccessful search, and the
+/* time per search and per replacement.  With deleteHashEntry() moving
+/* words back rather than leaving markers, the rows should stay flat.
 /*
+/* A deleted node is used again for the word that replaces it when the
+/* new word fits, so memory stays flat too; new words are all the same
+/* length, so every node is used again once it has held one.  The table
+/* must have no prefix or fuzzy index, which would still hold the nodes.
 */
-int 
-findRehashKey(int h, HASH_TAB hash_tab, char *search_item)
+void
+runChurnBenchmark(HASH_TAB *hash_tab)
 {
-	NODE_PTR target_node_ptr;
+	NODE_PTR node_ptr, *live;
+	char **absent, word[MAXARRAY];
+	unsigned long n = 0, i, k, next_word = 0;
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	double start;
+	int round;
 
-	int assume_all_buckets_searched = 0;
-	int match = 0;
+	for (i = 0; i < (unsigned long) hash_tab->size; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			n++;
+	if (n == 0) {
+		printf("Error: The table has no words to replace\n");
+		return;
+	}
+
+	live = (NODE_PTR *) malloc(n * sizeof(NODE_PTR));
+	absent = (char **) malloc(n * sizeof(char *));
+	if (live == NULL || absent == NULL) {
+		printf("Error: Unable to allocate benchmark storage\n");
+		exit(-1);
+	}
 
-	target_node_ptr = hash_tab[h];
+	n = 0;
+	for (i = 0; i < (unsigned long) hash_tab->size; i++)
+		for (node_ptr = hash_tab->bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr)
+			live[n++] = node_ptr;
+	for (i = 0; i < n; i++) {
+		sprintf(word, "absent_%lu", i);
+		if ((absent[i] = stringDup(word)) == NULL) {
+			printf("Error: Unable to allocate benchmark storage\n");
+			exit(-1);
+		}
+	}
 
-	while ( assume_all_buckets_searched != (HASHSIZE + 1) / 2) {
+	printf("%lu words in %d buckets (%s hash), %d rounds replacing %lu words each\n\n",
+		   n, hash_tab->size, hash_names[hash_tab->hash_fn], CHURN_ROUNDS, n);
+	printf("Round\tHit probes \tMiss probes\t Chained\tMoved back\tns/find\tns/replace\n");
+	printf("     \t  avg  max \t  avg  max \t        \t          \t       \t          \n");
+	printf("=====\t===========\t===========\t========\t========\t=======\t==========\n");
+	printChurnRound(hash_tab, 0, live, absent, n, 0.0);
 
-		while (target_node_ptr == NULL) {
-			h = hashKeyQuad(h);				/* Rehash based on original key */
-			assume_all_buckets_searched++;
-			target_node_ptr = hash_tab[h]; /* Get pointer at new key position */
-		
-			if ( assume_all_buckets_searched == (HASHSIZE + 1) / 2) {
-				/** Indicate to caller probing found no match... 
-				 **/
-				return 0; 
+	for (round = 1; round <= CHURN_ROUNDS; round++) {
+		start = elapsedSeconds();
+		for (k = 0; k < n; k++) {
+			i = nextRandom(&seed) % n;
+			node_ptr = deleteHashEntry(hash_tab, live[i]->line_text);
+
+			sprintf(word, "churn_%010lu", next_word++);
+			if (strlen(node_ptr->line_text) < strlen(word) &&
+				(node_ptr = makenode(&hash_tab->arena, word)) == NULL) {
+				printf("Error: Unable to allocate linked node storage\n");
+				exit(-1);
 			}
+			strcpy(node_ptr->line_text, word);
+			node_ptr->next_ptr = NULL;
+			addHashEntry(hash_tab, node_ptr);
+			live[i] = node_ptr;
 		}
-		
-		if (target_node_ptr->line_text == search_item) {
-			return 1; 
-		}	
-		
-		h = hashKeyQuad(h);				/* Rehash based on original key */
-		assume_all_buckets_searched++;
-		target_node_ptr = hash_tab[h]; /* Get pointer at new key position */		
+		printChurnRound(hash_tab, round, live, absent, n, elapsedSeconds() - start);
 	}
-	/** Search unsuccessful.  Indicate 'item not found' to caller... 
-	 **/
-	return 0;
+
+	for (i = 0; i < n; i++)
+		free(absent[i]);
+	free(absent);
+	free(live);
+} /* End runChurnBenchmark. */
+
+/*********************************************************
+ **                                                     **
+ **                   Microbenchmark                    **
+ **                                                     **
+ *********************************************************/
+
+/* This function opens a counter for each of the hardware events the
+/* microbenchmark reports, for this thread in user mode, stopped.  An
+/* event the kernel or the machine won't count gets no counter; nor
+/* does any where perf_event_open() isn't there to ask.
+/* It returns the number of events that can be counted.
+*/
+int
+openPerfCounters(PERF_COUNTERS *counters)
+{
+	int e, n = 0;
+#if defined(__NR_perf_event_open)
+	static const uint64_t events[PERF_EVENTS] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+	};
+	struct perf_event_attr attr;
+#endif
+
+	for (e = 0; e < PERF_EVENTS; e++) {
+		counters->fd[e] = -1;
+		counters->value[e] = 0;
+#if defined(__NR_perf_event_open)
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = events[e];
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		counters->fd[e] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		n += (counters->fd[e] >= 0);
+#endif
+	}
+	return n;
 }
 
-/* Makes a new node for the linked list and pass the pointer
-   back to caller.  If an error occurs during space allocation
-   print an appropriate message and exit from the program.
+/* This function starts the counters, or stops them if start is FALSE.
+/* Counts carry on from where they stopped until read.
+*/
+void
+switchPerfCounters(PERF_COUNTERS *counters, int start)
+{
+#if defined(__NR_perf_event_open)
+	int e;
 
-   It expects the caller pass it a character array that it
-   can store in the newly allocated node.
+	for (e = 0; e < PERF_EVENTS; e++)
+		if (counters->fd[e] >= 0)
+			ioctl(counters->fd[e], start ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+#endif
+}
 
-   If the char array is real data and there is enough memory for
-   the node, it initializes the next ptr to NULL and returns
-   a pointer to the node to the caller.
+/* This function reads what each counter has counted into value, and
+/* sets the counters back to zero.
+*/
+void
+readPerfCounters(PERF_COUNTERS *counters)
+{
+#if defined(__NR_perf_event_open)
+	int e;
 
-   This function has no side effects.
+	for (e = 0; e < PERF_EVENTS; e++)
+		if (counters->fd[e] >= 0) {
+			if (read(counters->fd[e], &counters->value[e], sizeof(uint64_t)) != sizeof(uint64_t))
+				counters->value[e] = 0;
+			ioctl(counters->fd[e], PERF_EVENT_IOC_RESET, 0);
+		}
+#endif
+}
+
+/* This function closes the counters.
 */
+void
+closePerfCounters(PERF_COUNTERS *counters)
+{
+	int e;
 
-NODE_PTR 
-makenode(char *w)
+	for (e = 0; e < PERF_EVENTS; e++)
+		if (counters->fd[e] >= 0)
+			close(counters->fd[e]);
+}
+
+/* This function sets a Zipfian generator up for ranks 0 to n-1, given
+/* zeta(n), the sum of 1/i^theta for i from 1 to n, which the caller
+/* keeps a running total of as n grows.
+*/
+void
+initZipf(ZIPF_GEN *zipf, unsigned long n, double theta, double zetan)
 {
-	
-	NODE_PTR ptr = NULL; 
-	
-	/** Get pointer to node and initialize terminal node...
-	 **/
-	if  ((ptr = node_alloc()) != NULL) { /* If memory exists. */
-        ptr->next_ptr = NULL;            /* Initialize next to NULL. */
-		
-		/** Copy item to node and sanity check...
-		 ** Check if string function returns valid argument...
-		 **/
-		if  ((ptr->line_text = stringDup(w)) == NULL) {
-              printf("Error: Unable to allocate line text storage\n");
-              exit(-1);        
-		}  
-	}  else {
-        printf("Error: Unable to allocate linked node storage\n");
-        exit(-1);  
-	}  
-	return ptr;  /* Which can't be NULL! */
-} /* End makenode. */
+	double zeta2 = 1.0 + pow(0.5, theta);
 
-/* Allocate memory for the node, cast pointer , return NULL if malloc fails. */
-NODE_PTR 
-node_alloc(void)
+	zipf->n = n;
+	zipf->theta = theta;
+	zipf->zetan = zetan;
+	zipf->alpha = 1.0 / (1.0 - theta);
+	zipf->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+}
+
+/* This function draws the next rank from a Zipfian generator; rank 0 is
+/* the most frequent.
+*/
+unsigned long
+nextZipf(ZIPF_GEN *zipf, uint64_t *seed)
 {
-  return (NODE_PTR) malloc(sizeof(NODE_ENTRY));
+	double u = (nextRandom(seed) >> 11) * (1.0 / 9007199254740992.0);
+	double uz = u * zipf->zetan;
+	unsigned long rank;
+
+	if (uz < 1.0)
+		return 0;
+	if (uz < 1.0 + pow(0.5, zipf->theta))
+		return 1;
 
+	rank = (unsigned long) (zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+	return rank < zipf->n ? rank : zipf->n - 1;
 }
 
-/* Copy the string w to a safe place in memory, return the location
-   pointer to caller.*/
-char *
-stringDup(char *w)
-{  
-	char *p;
+/* This function stirs the bits of a number, one to one, so that keys
+/* made from consecutive numbers look nothing alike.
+*/
+uint64_t
+microMix(uint64_t i)
+{
+	i ^= i >> 33;
+	i *= 0xff51afd7ed558ccdULL;
+	i ^= i >> 33;
+	i *= 0xc4ceb9fe1a85ec53ULL;
+	i ^= i >> 33;
+	return i;
+}
 
-	p = (char *)malloc(strlen(w) + 1); /* 1 added for null terminator. */
-  
-	if (p != NULL)      
-		strcpy(p, w);  
-	return p;
+/* This function makes the text of the microbenchmark's key number i:
+/* 'k' and up to sixteen hex digits, different for every i.  Keys 0 to
+/* n-1 go into a table of n; any other key is a miss.
+*/
+void
+microKey(uint64_t i, char *key)
+{
+	static const char digits[] = "0123456789abcdef";
+	int n = 0;
+
+	key[n++] = 'k';
+	i = microMix(i);
+	do {
+		key[n++] = digits[i & 15];
+		i >>= 4;
+	} while (i != 0);
+	key[n] = '\0';
 }
 
-/* This function prompts user for an input file 
-/* It expects a character array.
-/* It returns nothing. 
+/* This function fills in a row of results from the time and the events
+/* counted for ops operations, and reads the counters back to zero.
 */
-void 
-getInputFile(char *input_filename)
+void
+microRow(MICRO_RESULT *row, const char *dist, const char *op, unsigned long ops,
+		 double seconds, PERF_COUNTERS *counters)
 {
- 
-	printf("Please type the name of the file you want hashed!\n");
-	scanf("%s", input_filename);
+	int e;
 
-} /* End getInputFile. */
+	readPerfCounters(counters);
+	row->dist = dist;
+	row->op = op;
+	row->ops = ops;
+	row->ns_per_op = seconds * 1e9 / ops;
+	for (e = 0; e < PERF_EVENTS; e++)
+		row->per_op[e] = (counters->fd[e] >= 0) ? (double) counters->value[e] / ops : -1.0;
+}
 
-  
-/* Step through the hash table and display any cell's linked list 
-/* entries when the cell contains a nonNULL value. 
-/* 
-/* It expects the caller pass it the address of an array of pointers 
-/* to structures, i.e., a hash table.
-/* 
-/* It returns nothing.
-/* 
-/* It has no side effects.
+/* This function times MICRO_OPS searches for the keys laid out
+/* MICRO_KEYSIZE bytes apart in queries.
+/* It returns the number found.
 */
+unsigned long
+microFinds(HASH_TAB *hash_tab, char *queries, PERF_COUNTERS *counters, double *seconds)
+{
+	unsigned long found = 0, q;
+	double start;
 
-void 
-printHashEntries(HASH_TAB hash_tab)
-{ 
+	readPerfCounters(counters);
+	start = elapsedSeconds();
+	switchPerfCounters(counters, TRUE);
+	for (q = 0; q < MICRO_OPS; q++)
+		found += findHashEntry(hash_tab, queries + q * MICRO_KEYSIZE);
+	switchPerfCounters(counters, FALSE);
+	*seconds = elapsedSeconds() - start;
 
-	FILE *output_fptr;
-	int i = 0;
-	int first_while_string_count = 0;
-	NODE_PTR head_ptr;
-	
-	/** Open output file...
+	return found;
+}
+
+/* This function measures one table of n keys, about twice as many
+/* buckets as keys, and fills in six rows of results:
+/* - add: addHashEntry() on nodes made beforehand, in key order;
+/* - iterate: the walk over every bucket and chain printHashEntries()
+/*   makes, without the writing, per word visited;
+/* - find_hit and find_miss, for keys drawn uniformly and for keys drawn
+/*   from the Zipfian generator, whose ranks are scattered over the keys
+/*   so that the most searched-for aren't the first added.
+/* A small table is built, or walked, as many times over as it takes to
+/* make MICRO_OPS operations, and only the operations themselves are
+/* timed and counted.  Statistics are kept off throughout.
+/* If memory runs out, it prints an appropriate message and exits from
+/* the program.
+*/
+void
+microTable(unsigned long n, int hash_fn, ZIPF_GEN *zipf, char *queries,
+		   PERF_COUNTERS *counters, MICRO_RESULT *rows)
+{
+	static const char *dists[2] = { "uniform", "zipf" };
+	HASH_TAB hash_tab;
+	NODE_PTR *nodes, node_ptr;
+	char key[MICRO_KEYSIZE];
+	unsigned long i, q, rounds, round, visited, found;
+	uint64_t seed = 0x9E3779B97F4A7C15ULL, touched = 0;
+	double start, seconds;
+	int d;
+
+	initHashTable(&hash_tab, nextPrime(n <= MAXHASHSIZE / 2 ? 2 * n : MAXHASHSIZE), hash_fn);
+	hash_tab.stats.enabled = FALSE;
+	if ((nodes = (NODE_PTR *) malloc(n * sizeof(NODE_PTR))) == NULL ||
+		!arenaReserve(&hash_tab.arena, n * (sizeof(NODE_ENTRY) + MICRO_KEYSIZE))) {
+		printf("Error: Unable to allocate benchmark storage\n");
+		exit(-1);
+	}
+	for (i = 0; i < n; i++) {
+		microKey(i, key);
+		nodes[i] = makenode(&hash_tab.arena, key);
+	}
+
+	/** Add every key, emptying the table between rounds untimed...
 	 **/
-	if ((output_fptr = fopen("output.txt", "w")) == NULL) {
-		printf("Can't open output file\n"); 
+	rounds = MICRO_OPS / n + 1;
+	seconds = 0.0;
+	readPerfCounters(counters);
+	for (round = 0; round < rounds; round++) {
+		if (round > 0) {
+			memset(hash_tab.bucket, 0, hash_tab.size * sizeof(NODE_PTR));
+			for (i = 0; i < n; i++)
+				nodes[i]->next_ptr = NULL;
+		}
+		start = elapsedSeconds();
+		switchPerfCounters(counters, TRUE);
+		for (i = 0; i < n; i++)
+			addHashEntry(&hash_tab, nodes[i]);
+		switchPerfCounters(counters, FALSE);
+		seconds += elapsedSeconds() - start;
+	}
+	microRow(&rows[0], dists[0], "add", rounds * n, seconds, counters);
+
+	/** Walk the table as printHashEntries() does...
+	 **/
+	visited = 0;
+	start = elapsedSeconds();
+	switchPerfCounters(counters, TRUE);
+	for (round = 0; round < rounds; round++)
+		for (i = 0; i < (unsigned long) hash_tab.size; i++)
+			for (node_ptr = hash_tab.bucket[i]; node_ptr != NULL; node_ptr = node_ptr->next_ptr) {
+				touched += (unsigned char) node_ptr->line_text[0];
+				visited++;
+			}
+	switchPerfCounters(counters, FALSE);
+	seconds = elapsedSeconds() - start;
+	microRow(&rows[1], dists[0], "iterate", visited, seconds, counters);
+	if (visited != rounds * n || touched == 0)
+		printf("Error: Table of %lu keys lost words\n", n);
+
+	/** Search for keys that are there, then keys that aren't, drawn
+	 ** each way...
+	 **/
+	for (d = 0; d < 2; d++) {
+		for (q = 0; q < MICRO_OPS; q++) {
+			i = (d == 0) ? nextRandom(&seed) % n : microMix(nextZipf(zipf, &seed)) % n;
+			microKey(i, queries + q * MICRO_KEYSIZE);
+		}
+		found = microFinds(&hash_tab, queries, counters, &seconds);
+		microRow(&rows[2 + 2 * d], dists[d], "find_hit", MICRO_OPS, seconds, counters);
+		if (found != MICRO_OPS)
+			printf("Error: Table of %lu keys lost words\n", n);
+
+		for (q = 0; q < MICRO_OPS; q++) {
+			i = (d == 0) ? nextRandom(&seed) % n : microMix(nextZipf(zipf, &seed)) % n;
+			microKey(n + i, queries + q * MICRO_KEYSIZE);
+		}
+		found = microFinds(&hash_tab, queries, counters, &seconds);
+		microRow(&rows[3 + 2 * d], dists[d], "find_miss", MICRO_OPS, seconds, counters);
+		if (found != 0)
+			printf("Error: Table of %lu keys found keys it never had\n", n);
+	}
+
+	for (d = 0; d < MICRO_ROWS; d++) {
+		rows[d].keys = n;
+		rows[d].size = hash_tab.size;
+	}
+	free(nodes);
+	freeHashTable(&hash_tab);
+}
+
+/* This function writes a row of results to the screen and to the
+/* results file, as JSON or tab-separated values.  A count of events
+/* that couldn't be counted is left out (null, or "-").
+*/
+void
+printMicroRow(FILE *fptr, int json, int first, MICRO_RESULT *row)
+{
+	static const char *names[PERF_EVENTS] = {
+		"cycles_per_op", "cache_misses_per_op", "branch_misses_per_op"
+	};
+	int e;
+
+	printf("%12lu\t%10d\t%-7s\t%-9s\t%8.1f", row->keys, row->size, row->dist, row->op,
+		   row->ns_per_op);
+	for (e = 0; e < PERF_EVENTS; e++)
+		if (row->per_op[e] < 0.0)
+			printf("\t%10s", "-");
+		else
+			printf("\t%10.3f", row->per_op[e]);
+	printf("\n");
+	fflush(stdout);
+
+	if (json) {
+		fprintf(fptr, "%s    {\"keys\": %lu, \"buckets\": %d, \"dist\": \"%s\", \"op\": \"%s\", "
+				"\"ops\": %lu, \"ns_per_op\": %.3f", first ? "" : ",\n", row->keys,
+				row->size, row->dist, row->op, row->ops, row->ns_per_op);
+		for (e = 0; e < PERF_EVENTS; e++)
+			if (row->per_op[e] < 0.0)
+				fprintf(fptr, ", \"%s\": null", names[e]);
+			else
+				fprintf(fptr, ", \"%s\": %.4f", names[e], row->per_op[e]);
+		fprintf(fptr, "}");
+	} else {
+		fprintf(fptr, "%lu\t%d\t%s\t%s\t%lu\t%.3f", row->keys, row->size, row->dist,
+				row->op, row->ops, row->ns_per_op);
+		for (e = 0; e < PERF_EVENTS; e++)
+			if (row->per_op[e] < 0.0)
+				fprintf(fptr, "\t-");
+			else
+				fprintf(fptr, "\t%.4f", row->per_op[e]);
+		fprintf(fptr, "\n");
+	}
+	fflush(fptr);
+}
+
+/* This function measures the table's operations on generated keys, for
+/* tables of HASHSIZE keys and of every power of ten from there up to
+/* max_keys, and writes ns per operation, and cycles, cache misses and
+/* branch misses per operation where the kernel will count them, to the
+/* screen and to the named results file.  If the name ends in .json the
+/* file is a JSON object; otherwise it is tab-separated values with a
+/* header line.  Rows are written as each table is done, so a long run
+/* can be watched, or stopped, with what is done kept.
+/*
+/* A table of n keys takes about 60 bytes a key besides the 24 Mbytes
+/* of search keys, so 100 million keys want about 6 Gbytes.
+*/
+void
+runMicroBenchmark(char *results_filename, unsigned long max_keys, int hash_fn)
+{
+	MICRO_RESULT rows[MICRO_ROWS];
+	PERF_COUNTERS counters;
+	ZIPF_GEN zipf;
+	unsigned long n, zeta_n = 0, i;
+	double zetan = 0.0;
+	char *queries;
+	FILE *fptr;
+	size_t len;
+	int json, counted, first = TRUE, r;
+
+	len = strlen(results_filename);
+	json = (len > 5 && strcmp(results_filename + len - 5, ".json") == 0);
+
+	if ((fptr = fopen(results_filename, "w")) == NULL) {
+		printf("Can't open results file: %s\n", results_filename);
 		exit(1);
 	}
+	if ((queries = (char *) malloc((size_t) MICRO_OPS * MICRO_KEYSIZE)) == NULL) {
+		printf("Error: Unable to allocate benchmark storage\n");
+		exit(-1);
+	}
 
-	fprintf(output_fptr, "Table Index\tStored word(s)\n");
-	fprintf(output_fptr, "===========\t==============\n");
+	counted = openPerfCounters(&counters);
+	printf("%s hash, %d searches of each kind, Zipfian theta %.2f, %s\n\n",
+		   hash_names[hash_fn], MICRO_OPS, MICRO_THETA,
+		   counted == PERF_EVENTS ? "all events counted" :
+		   counted ? "some events not counted" : "no events counted");
+	printf("        Keys\t   Buckets\tDist   \tOp       \t   ns/op\t  cycles/op\tcmisses/op\tbmisses/op\n");
+	printf("============\t==========\t=======\t=========\t========\t==========\t==========\t==========\n");
 
-	for (i = 0; i <= (HASHSIZE - 1); i++) {
-		
-		head_ptr = hash_tab[i];
+	if (json)
+		fprintf(fptr, "{\n  \"hash_function\": \"%s\",\n  \"searches\": %d,\n"
+				"  \"zipf_theta\": %.2f,\n  \"results\": [\n",
+				hash_names[hash_fn], MICRO_OPS, MICRO_THETA);
+	else
+		fprintf(fptr, "keys\tbuckets\tdist\top\tops\tns_per_op\tcycles_per_op\t"
+				"cache_misses_per_op\tbranch_misses_per_op\n");
 
-		if ( head_ptr != NULL)
-			fprintf(output_fptr, "\nAt address [%d]: ", i);
+	for (n = HASHSIZE; n <= max_keys; ) {
+		/** Bring zeta(n) up to date for the Zipfian ranks...
+		 **/
+		for (i = zeta_n + 1; i <= n; i++)
+			zetan += 1.0 / pow((double) i, MICRO_THETA);
+		zeta_n = n;
+		initZipf(&zipf, n, MICRO_THETA, zetan);
 
-		while ( head_ptr != NULL) {	
-			fprintf(output_fptr, "%s ", head_ptr->line_text);
-			first_while_string_count++;
-			head_ptr = head_ptr->next_ptr;
-		}
-	
-	} /* End For */
-	
-	/* print trailer infomation */
+		/** The first table is measured twice, the first time for
+		 ** nothing, so its rows don't pay for warming up...
+		 **/
+		if (first)
+			microTable(n, hash_fn, &zipf, queries, &counters, rows);
+		microTable(n, hash_fn, &zipf, queries, &counters, rows);
+		for (r = 0; r < MICRO_ROWS; r++, first = FALSE)
+			printMicroRow(fptr, json, first, &rows[r]);
 
-	fprintf(output_fptr, "\n<p>Total words \t= %10d\nHASHSIZE\t= %10d", 
-		first_while_string_count, HASHSIZE);
-	fprintf(output_fptr, "\n<p>----------------Program Done--------------\n\n");
+		/** On to the next power of ten...
+		 **/
+		for (i = 1; i <= n; i *= 10)
+			;
+		if (i > max_keys && n < max_keys)
+			i = max_keys;
+		n = i;
+	}
 
-	fclose(output_fptr);
-	
-} /* End printHashEntries */
+	if (json)
+		fprintf(fptr, "\n  ]\n}\n");
+	fclose(fptr);
+	closePerfCounters(&counters);
+	free(queries);
+} /* End runMicroBenchmark. */
 
-/* This function:
-/* -Prompts the user for search criteria
-/* -Searches for the specified string.
-/* -Prints the results to the screen.
-/* 
-/* It expects the caller to pass it the address of the hash table.
-/* 
-/* It returns nothing.
-/* 
-/* It has no side effects.
+/*********************************************************
+ **                                                     **
+ **                 Token Normalization                 **
+ **                                                     **
+ *********************************************************/
+
+/* This function copies len bytes from from to to, which may be the
+/* same place, folding the ASCII letters to lower case sixteen bytes at
+/* a time when SSE2 is available.  Every other byte, including those of
+/* UTF-8 sequences, is copied as it is.
 */
 void
-queryHashTable(HASH_TAB hash_tab)
+foldCase(char *to, const char *from, size_t len)
 {
-	char search_item[MAXARRAY]; 
-	int i = 0;
-	
-	/** Prompt user for seach item...
-	 **/
-	printf("Enter a search item:\n");
-		scanf("%s", search_item);
-		printf("\n");
+	size_t i = 0;
+#if defined(__SSE2__)
+	__m128i c, upper;
 
-	/** Seach for item in table...
+	/** Capitals are shifted down to zero, so one unsigned range test
+	 ** finds them, as identMask16() finds letters...
 	 **/
-	i = findHashEntry(hash_tab, search_item);
+	for (; len - i >= 16; i += 16) {
+		c = _mm_loadu_si128((const __m128i *) (from + i));
+		upper = _mm_sub_epi8(c, _mm_set1_epi8('A'));
+		upper = _mm_cmpeq_epi8(_mm_min_epu8(upper, _mm_set1_epi8(25)), upper);
+		_mm_storeu_si128((__m128i *) (to + i),
+						 _mm_or_si128(c, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+	}
+#endif
+	for (; i < len; i++)
+		to[i] = (from[i] >= 'A' && from[i] <= 'Z') ? from[i] + ('a' - 'A') : from[i];
+}
 
-	/** Print results...
+/* This function checks that len bytes are well-formed UTF-8: no stray
+/* continuation bytes, no sequence cut short, and none of the overlong
+/* forms, surrogates or code points past U+10FFFF that RFC 3629 rules
+/* out.  A string shorter than sixteen bytes that is all ASCII, as most
+/* identifiers are, is passed after two loads.  Otherwise runs of sixteen
+/* ASCII bytes are stepped over with one test when SSE2 is available, so
+/* only the bytes of multibyte sequences are looked at one by one, and a
+/* whole source file of plain ASCII is checked at about the speed memory
+/* can be read.
+/* It returns 1 if the bytes are UTF-8, 0 otherwise.
+*/
+int
+validUtf8(const char *text, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) text;
+	const unsigned char *end = p + len;
+	uint64_t word, bits = 0;
+	uint32_t half;
+	unsigned char lo, hi;
+	int n, k;
+
+	/** Identifiers are short, and mostly ASCII: OR their bytes together
+	 ** a word at a time, the last load overlapping the others rather
+	 ** than taking the odd bytes one by one...
 	 **/
-	printf("Found %d occurance(s) of %s.\n\n", i, search_item);
-}
\ No newline at end of file
+	if (len < 16) {
+		if (len >= 8) {
+			memcpy(&word, text, 8);
+			bits = word;
+			memcpy(&word, text + len - 8, 8);
+			bits |= word;
+		} else if (len >= 4) {
+			memcpy(&half, text, 4);
+			bits = half;
+			memcpy(&half, text + len - 4, 4);
+			bits |= half;
+		} else if (len > 0)
+			bits = p[0] | p[len / 2] | p[len - 1];
+		if ((bits & 0x8080808080808080ULL) == 0)
+			return 1;
+	}
+
+	while (p < end) {
+#if defined(__SSE2__)
+		while (end - p >= 16 &&
+			   _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) p)) == 0)
+			p += 16;
+		if (p == end)
+			break;
+#endif
+		if (*p < 0x80) {
+			p++;
+			continue;
+		}
+
+		/** The lead byte gives the length of the sequence, and limits
+		 ** the second byte to rule out the forms that aren't allowed...
+		 **/
+		lo = 0x80;
+		hi = 0xBF;
+		if (*p >= 0xC2 && *p <= 0xDF)
+			n = 2;
+		else if (*p >= 0xE0 && *p <= 0xEF) {
+			n = 3;
+			if (*p == 0xE0)
+				lo = 0xA0;		/* Overlong */
+			else if (*p == 0xED)
+				hi = 0x9F;		/* Surrogates */
+		} else if (*p >= 0xF0 && *p <= 0xF4) {
+			n = 4;
+			if (*p == 0xF0)
+				lo = 0x90;		/* Overlong */
+			else if (*p == 0xF4)
+				hi = 0x8F;		/* Past U+10FFFF */
+		} else
+			return 0;
+
+		if (end - p < n || p[1] < lo || p[1] > hi)
+			return 0;
+		for (k = 2; k < n; k++)
+			if ((p[k] & 0xC0) != 0x80)
+				return 0;
+		p += n;
+	}
+	return 1;
+}
+
+/* This function copies a key to search a table for, or to add to it,
+/* and null terminates it: folded if the table ignores case, as it is.
+/* to must have room for len + 1 bytes.
+*/
+void
+copyKey(HASH_TAB *hash_tab, char *to, const char *from, size_t len)
+{
+	if (hash_tab->fold_case)
+		foldCase(to, from, len);
+	else
+		memcpy(to, from, len);
+	to[len] = '\0';
+}
+
+/* This function lets the lexer take identifiers in UTF-8: every byte
+/* with the top bit set joins the letters, digits and underscore, so a
+/* sequence is never split, and the visitors check what they are handed
+/* with validUtf8().  It must be called after initCharClasses().
+*/
+void
+allowUtf8Identifiers(void)
+{
+	int c;
+
+	for (c = 0x80; c < 256; c++)
+		char_class[c] = CC_IDENT;
+	ident_high = (char) 0x80;
+}
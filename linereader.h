@@ -0,0 +1,397 @@
+/************************************************************************/
+/*                                                                      */
+/*  linereader.h                                                        */
+/*                                                                      */
+/*  General description:                                                */
+/*  --------------------                                                */
+/* - The line reader TokenExtractor and tailx share.  An input is held  */
+/*   in an INPUT_MAP: a regular file is mapped whole, anything else     */
+/*   (a pipe, standard input) is read with read() in big blocks.        */
+/* - nextLine() hands out each line as a pointer and a length into the  */
+/*   input, without copying it, finding newlines sixteen bytes at a     */
+/*   time when SSE2 is available.  Lines may be of any length; a <CR>   */
+/*   before the <NL> and a missing final <NL> are both fine.            */
+/* - runReadBenchmark() times the reader against the getc() and fgets() */
+/*   loops the two programs used before.                                */
+/*                                                                      */
+/*  Everything here is static, so each program is still built from its */
+/*  one .c file.                                                        */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Defines the size of the blocks an input that can't be mapped is read
+ * in.  A line longer than the buffer doubles it.
+ */
+#define LINE_BLOCKSIZE  (1024 * 1024)
+
+/* Defines the number of times runReadBenchmark() reads the file with
+ * each reader; the fastest is reported.
+ */
+#define LINE_BENCHRUNS  3
+
+/* An input file in memory: mapped if it can be, read in otherwise.  A
+ * stream opened by openInputStream() is read a block at a time, as
+ * nextLine() needs it, and only holds the lines not yet handed out.
+ */
+typedef struct input_map {
+	char   *base;
+	size_t  size;
+	int     mapped;				/* TRUE if base must be unmapped */
+	int     fd;					/* Still to be read from, or -1 */
+	size_t  capacity;			/* Of base, while reading */
+	size_t  next;				/* Where nextLine() starts */
+	int     failed;				/* TRUE if a read failed */
+} INPUT_MAP;
+
+/* This function sets up an INPUT_MAP to read from fd: mapped whole if
+/* mappable is set and fd is a regular file that can be mapped, or with
+/* an empty buffer to read into otherwise.  A mapped file is closed, as
+/* the map keeps what it needs.
+/* It returns 1 on success, 0 if memory runs out.
+*/
+static inline int
+startInputMap(int fd, INPUT_MAP *input, int mappable)
+{
+	struct stat info;
+	void *map;
+
+	input->base = NULL;
+	input->size = 0;
+	input->mapped = 0;
+	input->fd = fd;
+	input->capacity = 0;
+	input->next = 0;
+	input->failed = 0;
+
+	if (mappable && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+		map = (info.st_size > 0) ?
+			mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+		if (map != MAP_FAILED) {
+			if (map != NULL) {
+				madvise(map, info.st_size, MADV_SEQUENTIAL);
+				input->base = (char *) map;
+				input->size = info.st_size;
+				input->mapped = 1;
+			}
+			if (fd != STDIN_FILENO)
+				close(fd);
+			input->fd = -1;
+			return 1;
+		}
+	}
+
+	input->capacity = LINE_BLOCKSIZE;
+	return (input->base = (char *) malloc(input->capacity)) != NULL;
+}
+
+/* This function reads the next block of a stream in after the bytes
+/* still held, moving them to the front of the buffer first and growing
+/* it if they fill it.  At the end of the stream, or if a read fails,
+/* the file is closed.
+/* It returns 1 if more was read, 0 if there is no more.
+*/
+static inline int
+fillInputMap(INPUT_MAP *input)
+{
+	ssize_t got;
+	char *grown;
+
+	if (input->fd < 0)
+		return 0;
+
+	if (input->next > 0) {
+		memmove(input->base, input->base + input->next, input->size - input->next);
+		input->size -= input->next;
+		input->next = 0;
+	}
+	if (input->size == input->capacity) {
+		if ((grown = (char *) realloc(input->base, 2 * input->capacity)) != NULL) {
+			input->base = grown;
+			input->capacity *= 2;
+		}
+	}
+
+	if (input->size < input->capacity) {
+		do
+			got = read(input->fd, input->base + input->size, input->capacity - input->size);
+		while (got < 0 && errno == EINTR);
+		if (got > 0) {
+			input->size += got;
+			return 1;
+		}
+	} else
+		got = -1;	/* Out of memory for a longer line */
+
+	if (got < 0)
+		input->failed = 1;
+	if (input->fd != STDIN_FILENO)
+		close(input->fd);
+	input->fd = -1;
+	return 0;
+}
+
+/* This function maps an input file read-only, or, if it can't be
+/* mapped (a pipe, say), reads it into memory whole instead.
+/* It expects a file name and the address of an INPUT_MAP to fill in.
+/* It returns 1 on success, 0 if the file can't be read.
+*/
+static inline int
+openInputMap(char *filename, INPUT_MAP *input)
+{
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return 0;
+	if (!startInputMap(fd, input, 1)) {
+		close(fd);
+		return 0;
+	}
+
+	while (fillInputMap(input))
+		;
+	if (input->failed) {
+		free(input->base);
+		input->base = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+/* This function opens an input file to be read a line at a time with
+/* nextLine(): mapped whole if it can be, read a block at a time if not.
+/* A file name of "-" or NULL reads standard input.
+/* It returns 1 on success, 0 if the file can't be opened.
+*/
+static inline int
+openInputStream(char *filename, INPUT_MAP *input)
+{
+	int fd = STDIN_FILENO;
+
+	if (filename != NULL && strcmp(filename, "-") != 0 &&
+		(fd = open(filename, O_RDONLY)) < 0)
+		return 0;
+	if (!startInputMap(fd, input, 1)) {
+		if (fd != STDIN_FILENO)
+			close(fd);
+		return 0;
+	}
+	return 1;
+}
+
+/* This function releases an input file opened by openInputMap() or
+/* openInputStream().
+*/
+static inline void
+closeInputMap(INPUT_MAP *input)
+{
+	if (input->mapped)
+		munmap(input->base, input->size);
+	else
+		free(input->base);
+	input->base = NULL;
+
+	if (input->fd >= 0 && input->fd != STDIN_FILENO)
+		close(input->fd);
+	input->fd = -1;
+}
+
+#if defined(__SSE2__)
+/* This function builds a sixteen bit mask with one bit set for every
+/* newline in the sixteen bytes at p.
+*/
+static inline int
+newlineMask16(const char *p)
+{
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p),
+											_mm_set1_epi8('\n')));
+}
+#endif
+
+/* This function counts the newlines from p up to end, sixteen bytes at
+/* a time when SSE2 is available.
+*/
+static inline unsigned long
+countLines(const char *p, const char *end)
+{
+	unsigned long n = 0;
+
+#if defined(__SSE2__)
+	for (; end - p >= 16; p += 16)
+		n += __builtin_popcount(newlineMask16(p));
+#endif
+	for (; p < end; p++)
+		n += (*p == '\n');
+
+	return n;
+}
+
+/* This function finds the newline that ends the line starting at p,
+/* sixteen bytes at a time when SSE2 is available.
+/* It returns the newline's address, or end if the last line has none.
+*/
+static inline const char *
+lineEnd(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+	int mask;
+
+	for (; end - p >= 16; p += 16)
+		if ((mask = newlineMask16(p)) != 0)
+			return p + __builtin_ctz(mask);
+#endif
+	while (p < end && *p != '\n')
+		p++;
+
+	return p;
+}
+
+/* This function hands out the next line of an input, without its
+/* terminating <CR><NL> or <NL>, reading more of a stream when the line
+/* runs past what is held.  The line stays put as long as the input is
+/* open if the input is mapped or was read whole, but only until the
+/* next call otherwise.
+/* It returns 1 with *line and *length set, or 0 at the end of input.
+*/
+static inline int
+nextLine(INPUT_MAP *input, const char **line, size_t *length)
+{
+	const char *eol;
+	size_t scanned = 0;	/* Bytes of the line known to hold no newline */
+
+	for (;;) {
+		eol = lineEnd(input->base + input->next + scanned, input->base + input->size);
+		if (eol < input->base + input->size || input->fd < 0)
+			break;
+		scanned = input->size - input->next;
+		if (!fillInputMap(input)) {
+			/** The held bytes may have moved; the last line runs to
+			 ** their end...
+			 **/
+			eol = input->base + input->size;
+			break;
+		}
+	}
+
+	if (input->next == input->size)
+		return 0;
+
+	*line = input->base + input->next;
+	*length = eol - *line;
+	if (*length > 0 && (*line)[*length - 1] == '\r')
+		(*length)--;
+	input->next = (eol < input->base + input->size) ? (size_t) (eol + 1 - input->base) : input->size;
+	return 1;
+}
+
+/* This function reads the clock for runReadBenchmark().
+*/
+static inline double
+lineSeconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* This function times reading a file a line at a time four ways: the
+/* getc() loop tailx used, into 128-byte words; the fgets() loop
+/* TokenExtractor used, into 80-byte lines; nextLine() on a stream read
+/* a block at a time; and nextLine() on the file mapped whole.  Each is
+/* run LINE_BENCHRUNS times and the fastest is reported.  The two old
+/* loops split long lines, so they may count more lines.
+/* If the file can't be read it prints an appropriate message and
+/* returns.
+*/
+static inline void
+runReadBenchmark(char *filename)
+{
+	static const char *names[] = {
+		"getc, 128-byte words", "fgets, 80-byte lines",
+		"nextLine, read()", "nextLine, mmap()"
+	};
+	char word[128], line[80];
+	const char *text;
+	struct stat info;
+	size_t length;
+	unsigned long lines, seen;
+	double start, best;
+	INPUT_MAP input;
+	FILE *fptr;
+	int method, run, ch, j, fd;
+
+	if (stat(filename, &info) != 0) {
+		printf("Can't open input file: %s\n", filename);
+		return;
+	}
+
+	printf("Reader                  \t     Lines\t   Seconds\t      MB/s\n");
+	for (method = 0; method < 4; method++) {
+		best = 0.0;
+		lines = 0;
+		for (run = 0; run < LINE_BENCHRUNS; run++) {
+			seen = 0;
+			start = lineSeconds();
+
+			if (method < 2) {
+				if ((fptr = fopen(filename, "r")) == NULL) {
+					printf("Can't open input file: %s\n", filename);
+					return;
+				}
+				if (method == 0) {
+					do {
+						for (j = 0; j < (int) sizeof(word) - 1; j++)
+							if ((ch = getc(fptr)) == EOF || ch == '\n')
+								break;
+							else
+								word[j] = (char) ch;
+						word[j] = '\0';
+						seen++;
+					} while (ch != EOF);
+				} else
+					while (fgets(line, sizeof(line), fptr) != NULL)
+						seen++;
+				fclose(fptr);
+			} else {
+				/** The second time the file is read as a stream even
+				 ** though it could be mapped, to time the block reads...
+				 **/
+				if ((fd = open(filename, O_RDONLY)) < 0 ||
+					!startInputMap(fd, &input, method == 3)) {
+					printf("Can't open input file: %s\n", filename);
+					return;
+				}
+				while (nextLine(&input, &text, &length))
+					seen++;
+				closeInputMap(&input);
+			}
+
+			start = lineSeconds() - start;
+			if (run == 0 || start < best)
+				best = start;
+			lines = seen;
+		}
+
+		printf("%-24s\t%10lu\t%10.4f\t%10.1f\n", names[method], lines, best,
+			   (best > 0.0) ? info.st_size / best / 1e6 : 0.0);
+	}
+}
+
+#endif /* LINEREADER_H */
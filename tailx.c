@@ -2,12 +2,24 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "linereader.h"
+
 /*
 * Default values
 */
 #define DEFAULT_LINESTOSHOW 10
 #define DEFAULT_INPUTFILE	"data.txt"
 #define DEFAULT_OUTPUTFILE	"output.txt"
+#define DEFAULT_MAXMEMORY	0	/* No budget: every kept line in a link */
+
+/*
+* Sizes for --max-memory: a spill segment is closed for appending once
+* it holds SPILL_SEGMENTSIZE bytes, and segments are read back
+* SPILL_BLOCKSIZE bytes at a time, which is also the window buffer's
+* first size.
+*/
+#define SPILL_SEGMENTSIZE	(64L * 1024 * 1024)
+#define SPILL_BLOCKSIZE		(1024 * 1024)
 
 /*
 * Macros to use for boolean values
@@ -15,21 +27,57 @@
 #define TRUE	1
 #define FALSE	0
 
-#define MAXSTRSIZE 128 /** This string-size limit causes the outer 
-** parsing loop to terminate a word after the 128th 'char' is detected.
-**/
-
-/** This is a list element...
+/** This is a list element.  The line is kept whole, however long, 
+ ** in the space allocated after the element...
  **/
  struct listWord{
-	char word_str[MAXSTRSIZE];
 	struct listWord *nextPtr;
 	struct listWord *previousPtr;
+	size_t word_len;
+	char word_str[];
 };
 
 typedef struct listWord LISTWORD;
 typedef LISTWORD *LISTWORDPTR;
 
+/** A spill segment is an unlinked temporary file the oldest kept lines
+ ** are appended to, each ended by a <NL>.  Lines that fall out of the
+ ** window afterwards are only counted, from the front of the first
+ ** segment, which is closed once all its lines are gone...
+ **/
+struct spillSegment{
+	struct spillSegment *nextPtr;
+	struct spillSegment *previousPtr;
+	int   fd;
+	long  bytes;		/* written to the file */
+	int   lines;		/* written to the file */
+	int   dropped;		/* of those, fallen out of the window */
+};
+
+typedef struct spillSegment SPILLSEGMENT;
+typedef SPILLSEGMENT *SPILLSEGMENTPTR;
+
+/** With --max-memory the window is kept in one buffer instead of in
+ ** links: the newest lines, each ended by a <NL>, between start and
+ ** end.  The buffer doubles up to the budget; when a line still won't
+ ** fit, everything in it is appended to the last segment in one write,
+ ** so the segments always hold the older lines...
+ **/
+struct spillWindow{
+	char  *text;
+	size_t size;
+	size_t limit;		/* the --max-memory budget */
+	size_t start;
+	size_t end;
+	int    lines;		/* kept in text */
+	int    spilled;		/* kept in the segments */
+	SPILLSEGMENTPTR firstPtr;
+	SPILLSEGMENTPTR lastPtr;
+};
+
+typedef struct spillWindow SPILLWINDOW;
+typedef SPILLWINDOW *SPILLWINDOWPTR;
+
 static int queued_elements = 0;
 
 /** Function prototypes...
@@ -40,17 +88,39 @@ int getDisplayLimit( char * );
 
 int getReverseLinesValue( char * );
 
-struct listWord *createLink( void );
+struct listWord *createLink( size_t );
 
-void queueInit( char *, LISTWORDPTR *, LISTWORDPTR *);
+void queueInit( const char *, size_t, LISTWORDPTR *, LISTWORDPTR *);
 
 int  queueLength( void );
 
-void enqueueItem( char *, LISTWORDPTR *, LISTWORDPTR * );
+void enqueueItem( const char *, size_t, LISTWORDPTR *, LISTWORDPTR * );
 
 void rmQueueItem( LISTWORDPTR *, LISTWORDPTR * );
 
-void printListElementsToFile( LISTWORDPTR, LISTWORDPTR , int, char * );
+void printListElementsToFile( LISTWORDPTR, LISTWORDPTR , SPILLWINDOWPTR, int, char * );
+
+size_t getMaxMemory( char * );
+
+void windowInit( SPILLWINDOWPTR, size_t );
+
+void windowAdd( SPILLWINDOWPTR, const char *, size_t );
+
+void windowDrop( SPILLWINDOWPTR );
+
+void growWindow( SPILLWINDOWPTR, size_t );
+
+void spillWindow( SPILLWINDOWPTR );
+
+SPILLSEGMENTPTR lastSegment( SPILLWINDOWPTR );
+
+void writeSegment( SPILLSEGMENTPTR, const char *, size_t );
+
+int  printSegment( SPILLSEGMENTPTR, int, FILE * );
+
+size_t readSegment( SPILLSEGMENTPTR, char *, size_t, long );
+
+int  printLinesBackward( const char *, size_t, int, FILE * );
 
 /****************************************************************
  **                                                 
@@ -75,44 +145,73 @@ char *argv[];
 {
 	char *input_filename	=  NULL;
 	char *output_filename	=  NULL;
+	char *program_name		=  argv[0];
 	int   display_limit = 0;
 	int   reverse_lines = FALSE;
+	size_t max_memory = DEFAULT_MAXMEMORY;
 
 	LISTWORDPTR head_Ptr, tail_Ptr, current_Ptr;
-	char in_word[MAXSTRSIZE];
-	int ch_code, j, done, display_line_count;
-	FILE *input_fPtr;
+	const char *in_line;
+	size_t in_len;
+	int display_line_count;
+	INPUT_MAP input;
+	SPILLWINDOW window;
 
 	/** List is intially empty... 
  	 **/
 	head_Ptr	= NULL;
 	current_Ptr = NULL;
 	tail_Ptr	= NULL;
-	done = 0;
 	display_line_count = 0;
-	in_word[0] = '\0';
 
 /*
 * Takes arguments from the command line, reads from an input file, and writes the last 'n' 
 * lines of the file in either standard or reverse order to the output file.
 *
-* Arguments: argv[1] - name of the input file to read the lines from
+* Arguments: --max-memory bytes - optional, first: keep at most that many
+*			           bytes of lines in memory, and the older ones in
+*			           temporary files
+*			 argv[1] - name of the input file to read the lines from,
+*			           or - for standard input
 *			 argv[2] - number of lines to displayed 
 *			 argv[3] - name of the output file to write to 
 *		     argv[4] - flag (-r) for reverse order
 * Returns:	 nothing
 */
+	/*
+	* "--max-memory" comes before the other arguments.
+	*/
+	if ((argv[1] != NULL) && (strcmp(argv[1], "--max-memory") == 0))
+	{
+		max_memory = getMaxMemory(argv[2]);
+		argv += (argv[2] != NULL) ? 2 : 1;
+	}
+
 	/*
 	* "?" displays command line usage.
 	*/
 	if ((argv[1] == NULL) || (strcmp(argv[1], "?") == 0))
 	{
 		printf("Usage:\n");
-		printf("%s <inputFile> <numLines> <outputFile> [-r]\n\n", argv[0]);
-		printf("   inputFile  - name of file to read in	    (default is \"%s\")\n", DEFAULT_INPUTFILE);
+		printf("%s [--max-memory bytes] <inputFile> <numLines> <outputFile> [-r]\n", program_name);
+		printf("%s -bench [inputFile]\n\n", program_name);
+		printf("   --max-memory - keep at most bytes (k, m or g) of lines in memory and\n");
+		printf("                  the older ones in temporary files (default is no limit)\n");
+		printf("   inputFile  - name of file to read in, or - for standard input\n");
+		printf("                                          (default is \"%s\")\n", DEFAULT_INPUTFILE);
 		printf("   numLines   - number of lines to display	(default is %d)\n", DEFAULT_LINESTOSHOW);
 		printf("   outputFile - name of file to output to	(default is \"%s\")\n", DEFAULT_OUTPUTFILE);
-		printf("   -r         - display lines in reverse order  (default is standard order)\n\n");
+		printf("   -r         - display lines in reverse order  (default is standard order)\n");
+		printf("   -bench     - time reading inputFile with getc(), fgets() and the line reader\n\n");
+		exit(0);
+	}
+
+	/*
+	* "-bench" times the ways of reading the input file instead.
+	*/
+	if (strcmp(argv[1], "-bench") == 0)
+	{
+		runReadBenchmark(getFileName(argv[2], DEFAULT_INPUTFILE));
 		exit(0);
 	}
 
@@ -130,60 +229,46 @@ char *argv[];
 
 	/** try to open file, otherwise print error message...
  	 **/
-	if ((input_fPtr = fopen(input_filename, "r")) == NULL) {
+	if (!openInputStream(input_filename, &input)) {
 		printf("Can't open input file\n");
 		exit(-1);
 	}
 
-	/** Look for word tokens until end of file... 
+	windowInit(&window, max_memory);
+
+	/** Take the file a line at a time, however long, until end of
+	 ** file.  A line comes without its <NL> (or <CR><NL>), and the
+	 ** last line may have none...
  	 **/
-	while (done == 0) {
-		in_word[0] = '\0';
-
-		/** Parse a single word token... 
- 	 	 **/
-		for (j = 0; j < (MAXSTRSIZE - 1); j++){
-			if ( (ch_code = getc(input_fPtr)) != EOF) {
-					
-				if (ch_code == '\n') {
-					in_word[j] = '\0';      /*  */
-					break;				   /*  */
-					
-				} else {
-					in_word[j] = (char)ch_code;     /*  */	
-				}
+	while (nextLine(&input, &in_line, &in_len)) {
 
-			} else {                  /* EOF found */
-				in_word[j] = '\0';	  /* Terminate char array w/ NULL byte  */
-				done = 1;             /* If we were in the process of       */
-				break;                /* building word token EOF was found  */
-			}                         /* consider EOF as a word delimiter   */
-		}   /* for loop */
-	
-	/** Add a word token to the list if unique; otherwise, visit the 
-     ** record and increment the counter to show the match... 
+	/** Keep the line, dropping the oldest once display_limit are 
+	 ** kept: in the list, or in the window when there is a budget... 
 	 **/
-		if (queueLength() == display_limit) {
-			rmQueueItem(&head_Ptr, &tail_Ptr);
-			enqueueItem(in_word, &head_Ptr, &tail_Ptr);
-		
+		if (max_memory > 0) {
+			if (window.lines + window.spilled == display_limit)
+				windowDrop(&window);
+			windowAdd(&window, in_line, in_len);
 		} else {
-			enqueueItem(in_word, &head_Ptr, &tail_Ptr);
+			if (queueLength() == display_limit)
+				rmQueueItem(&head_Ptr, &tail_Ptr);
+			enqueueItem(in_line, in_len, &head_Ptr, &tail_Ptr);
 		}
 
-	} /* end search for words while not end of file */
+	} /* end read lines while not end of file */
 
 	    /** The input file has been parsed and the words have been stored, so
          ** close the input file...
          **/
 	
-	fclose (input_fPtr);
+	closeInputMap(&input);
 
 	/** Print a formatted list, unique count, and total count of elements...
 	 **/
 	
 	printListElementsToFile( head_Ptr, 
 							 tail_Ptr, 
+							 &window,
 							 reverse_lines, 
 							 output_filename );
 
@@ -269,25 +354,31 @@ int  queueLength(void)
  **                                                 
  ** NAME:		createLink              
  **                                               
- ** ARGUMENTS:	None
+ ** ARGUMENTS:	size_t word_len (the length of the line it will hold)
  **/
 
-struct listWord *createLink(void)
+struct listWord *createLink(size_t word_len)
 {
 	return ((struct listWord *)
-			malloc(sizeof(struct listWord)));
+			malloc(sizeof(struct listWord) + word_len + 1));
 }
 
-void queueInit(char some_word[], 
+void queueInit(const char some_word[], 
+						  size_t word_len,
 						  LISTWORDPTR *hPtr, 
 						  LISTWORDPTR *tailPtr)
 {
 	LISTWORDPTR newPtr;
-	struct listWord *createLink(void);
 
-	*hPtr = *tailPtr = newPtr = createLink(); /* only one link exists   */
+	*hPtr = *tailPtr = newPtr = createLink(word_len); /* only one link exists   */
+	if (newPtr == NULL) {
+		printf("queueInit: No memory available.\n");
+		exit(1);
+	}
 	newPtr->previousPtr = newPtr->nextPtr = NULL; /* no next or prev links  */
-	strcpy(newPtr->word_str, some_word);    /* insert item into link  */
+	memcpy(newPtr->word_str, some_word, word_len);    /* insert item into link  */
+	newPtr->word_str[word_len] = '\0';
+	newPtr->word_len = word_len;
 	queued_elements = 1;	/* initialize counter for queued elements */
 }
 /**********************************************************
@@ -314,25 +405,27 @@ void queueInit(char some_word[],
  ** list that works, and that I can reuse/refine in later assignments.
  **/
 
-void enqueueItem(char some_word[], LISTWORDPTR *hPtr, LISTWORDPTR *tailPtr)
+void enqueueItem(const char some_word[], size_t word_len, LISTWORDPTR *hPtr,
+				 LISTWORDPTR *tailPtr)
 {	
 	LISTWORDPTR newPtr;
-	struct listWord *createLink(void);
 	FILE *output_fPtr;
 	
 	/* If the list is empty, initialize it... */
 
 	if (queueLength() == 0) {
-		queueInit(some_word, hPtr, tailPtr);
+		queueInit(some_word, word_len, hPtr, tailPtr);
 		return;
 	}
 				
 	/* Otherwise, enqueue the new link... */
 		
-	newPtr = createLink();
+	newPtr = createLink(word_len);
 		
 	if (newPtr != NULL) {
-		strcpy(newPtr->word_str, some_word);
+		memcpy(newPtr->word_str, some_word, word_len);
+		newPtr->word_str[word_len] = '\0';
+		newPtr->word_len = word_len;
 		queued_elements++;
 
 		newPtr->nextPtr		= NULL;  /* end of q, make next NULL */
@@ -366,7 +459,10 @@ void rmQueueItem(LISTWORDPTR *hPtr, LISTWORDPTR *tailPtr)
 
 	tempPtr = *hPtr;
 	*hPtr = (*hPtr)->nextPtr;
-	(*hPtr)->previousPtr = NULL;
+	if (*hPtr != NULL)
+		(*hPtr)->previousPtr = NULL;
+	else
+		*tailPtr = NULL;    /* the last link is gone */
 
 	free(tempPtr);
 	queued_elements--;
@@ -376,7 +472,8 @@ void rmQueueItem(LISTWORDPTR *hPtr, LISTWORDPTR *tailPtr)
  **                                                 
  ** NAME:	printListElementsToFile             
  **                                               
- ** ARGUMENTS:	LISTWORDPTR headPtr, tailPtr, reverse_lines
+ ** ARGUMENTS:	LISTWORDPTR headPtr, tailPtr, SPILLWINDOWPTR winPtr,
+ **				reverse_lines
  **				 
  ** RETURNS	void
  **                                        
@@ -391,22 +488,27 @@ void rmQueueItem(LISTWORDPTR *hPtr, LISTWORDPTR *tailPtr)
  ** It requires that the output file pointed to by output_fPtr
  ** is not currently in use by another routine.
  **
+ ** Lines kept in winPtr under --max-memory are older than any in
+ ** the list: the segments' first, then the buffer's.
+ **
  ** It expects to be called when there is something in the list.
  **/
 
 void 
 printListElementsToFile( LISTWORDPTR head_Ptr,
 						 LISTWORDPTR tail_Ptr,
+						 SPILLWINDOWPTR winPtr,
 						 int reverse_lines, 
 						 char output_filename[])
 {
 
 	FILE *output_fPtr;
+	SPILLSEGMENTPTR segPtr;
 	int string_count;
 	
 	string_count = 0;
 
-	if (head_Ptr == NULL) {
+	if (head_Ptr == NULL && winPtr->lines + winPtr->spilled == 0) {
 		printf("printListElementsToFile: Nothing to print.\n"); 
 		exit(1);
 	}
@@ -417,8 +519,17 @@ printListElementsToFile( LISTWORDPTR head_Ptr,
 	}
 	
 	if (!reverse_lines) {
+		for (segPtr = winPtr->firstPtr; segPtr != NULL; segPtr = segPtr->nextPtr)
+			string_count += printSegment(segPtr, FALSE, output_fPtr);
+		if (winPtr->lines > 0) {
+			fwrite(winPtr->text + winPtr->start, 1, winPtr->end - winPtr->start,
+				   output_fPtr);
+			string_count += winPtr->lines;
+		}
+
 		while (head_Ptr != NULL) {
-			fprintf(output_fPtr, "%s\n", head_Ptr->word_str);
+			fwrite(head_Ptr->word_str, 1, head_Ptr->word_len, output_fPtr);
+			putc('\n', output_fPtr);
 			string_count++;
 			head_Ptr = head_Ptr->nextPtr;
 	
@@ -426,10 +537,18 @@ printListElementsToFile( LISTWORDPTR head_Ptr,
 
 	} else {
 		while (tail_Ptr != NULL) {
-			fprintf(output_fPtr, "%s\n", tail_Ptr->word_str);
+			fwrite(tail_Ptr->word_str, 1, tail_Ptr->word_len, output_fPtr);
+			putc('\n', output_fPtr);
 			string_count++;
 			tail_Ptr = tail_Ptr->previousPtr;
 		}
+
+		if (winPtr->lines > 0)
+			string_count += printLinesBackward(winPtr->text + winPtr->start,
+											   winPtr->end - winPtr->start,
+											   winPtr->lines, output_fPtr);
+		for (segPtr = winPtr->lastPtr; segPtr != NULL; segPtr = segPtr->previousPtr)
+			string_count += printSegment(segPtr, TRUE, output_fPtr);
 	}
 	
 	/* print trailer infomation */
@@ -439,4 +558,433 @@ printListElementsToFile( LISTWORDPTR head_Ptr,
 
 	fclose(output_fPtr);
 
-}
\ No newline at end of file
+}
+
+/*********************************************************
+ **                                                     **
+ **                   Spill Functions                   **
+ **                                                     **
+ *********************************************************/
+/*
+* Returns the --max-memory budget in bytes, which may end in k, m or g.
+*
+* Arguments: max_memory - the requested budget
+* Returns: the budget, if it's a valid size; otherwise, the default of
+*			keeping every line in memory.
+*/
+size_t getMaxMemory(char *max_memory)
+{
+	unsigned long value;
+	char *unit;
+
+	if ((max_memory == NULL) || (*max_memory < '0') || (*max_memory > '9')) {
+		printf("Invalid value for --max-memory; keeping every line in memory !\n");
+		return DEFAULT_MAXMEMORY;
+	}
+
+	value = strtoul(max_memory, &unit, 10);
+	switch (*unit) {
+		case 'k': case 'K':	value <<= 10; unit++; break;
+		case 'm': case 'M':	value <<= 20; unit++; break;
+		case 'g': case 'G':	value <<= 30; unit++; break;
+	}
+	if ((*unit != '\0') || (value == 0)) {
+		printf("Invalid value for --max-memory; keeping every line in memory !\n");
+		return DEFAULT_MAXMEMORY;
+	}
+
+	return value;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		windowInit              
+ **                                               
+ ** ARGUMENTS:	SPILLWINDOWPTR winPtr, size_t limit (the budget, or 0)
+ **
+ ** The buffer is allocated by the first windowAdd.
+ **/
+
+void windowInit(SPILLWINDOWPTR winPtr, size_t limit)
+{
+	winPtr->text = NULL;
+	winPtr->size = 0;
+	winPtr->limit = limit;
+	winPtr->start = winPtr->end = 0;
+	winPtr->lines = winPtr->spilled = 0;
+	winPtr->firstPtr = winPtr->lastPtr = NULL;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		windowAdd              
+ **                                               
+ ** ARGUMENTS:	SPILLWINDOWPTR winPtr, const char line[], size_t len
+ **				 
+ ** RETURNS		void
+ **                                        
+ ** DESCRIPITON:
+ ** 
+ ** Keeps the newest line at the end of the buffer.  When it won't
+ ** fit, the kept lines are first moved to the front of the buffer,
+ ** or the buffer grown, as long as that leaves it a quarter free;
+ ** otherwise they are all spilled.  A line longer than the whole
+ ** budget goes straight to the last segment.
+ **/
+
+void windowAdd(SPILLWINDOWPTR winPtr, const char line[], size_t len)
+{
+	SPILLSEGMENTPTR segPtr;
+	size_t live, needed;
+
+	needed = len + 1;
+	if (winPtr->end + needed > winPtr->size) {
+		live = winPtr->end - winPtr->start;
+		if (live + needed > winPtr->size / 4 * 3)
+			growWindow(winPtr, live + needed);
+		if ((live + needed > winPtr->size / 4 * 3) && (live > 0))
+			spillWindow(winPtr);
+
+		if (winPtr->start > 0) {
+			memmove(winPtr->text, winPtr->text + winPtr->start,
+					winPtr->end - winPtr->start);
+			winPtr->end -= winPtr->start;
+			winPtr->start = 0;
+		}
+	}
+
+	/* Anything still kept has fit, so the buffer is empty here */
+	if (winPtr->end + needed > winPtr->size) {
+		segPtr = lastSegment(winPtr);
+		writeSegment(segPtr, line, len);
+		writeSegment(segPtr, "\n", 1);
+		segPtr->lines++;
+		winPtr->spilled++;
+		return;
+	}
+
+	memcpy(winPtr->text + winPtr->end, line, len);
+	winPtr->text[winPtr->end + len] = '\n';
+	winPtr->end += needed;
+	winPtr->lines++;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		windowDrop              
+ **                                               
+ ** ARGUMENTS:	SPILLWINDOWPTR winPtr
+ **
+ ** Drops the oldest kept line: from the segments while they hold
+ ** any, closing those left with none, else from the buffer.
+ **/
+
+void windowDrop(SPILLWINDOWPTR winPtr)
+{
+	SPILLSEGMENTPTR segPtr;
+
+	if (winPtr->spilled > 0) {
+		segPtr = winPtr->firstPtr;
+		while (segPtr->dropped == segPtr->lines) {
+			winPtr->firstPtr = segPtr->nextPtr;
+			winPtr->firstPtr->previousPtr = NULL;
+			close(segPtr->fd);
+			free(segPtr);
+			segPtr = winPtr->firstPtr;
+		}
+		segPtr->dropped++;
+		winPtr->spilled--;
+	} else {
+		winPtr->start = lineEnd(winPtr->text + winPtr->start,
+								winPtr->text + winPtr->end) + 1 - winPtr->text;
+		winPtr->lines--;
+	}
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		growWindow              
+ **                                               
+ ** ARGUMENTS:	SPILLWINDOWPTR winPtr, size_t wanted (bytes to keep)
+ **
+ ** Doubles the buffer, from SPILL_BLOCKSIZE, until wanted is at most
+ ** half of it or it reaches the budget.  If memory runs out first,
+ ** the buffer stays as it is and the budget comes down to it.
+ **/
+
+void growWindow(SPILLWINDOWPTR winPtr, size_t wanted)
+{
+	size_t size;
+	char *text;
+
+	size = (winPtr->size > 0) ? winPtr->size : SPILL_BLOCKSIZE;
+	while ((size < 2 * wanted) && (size < winPtr->limit))
+		size *= 2;
+	if (size > winPtr->limit)
+		size = winPtr->limit;
+	if (size <= winPtr->size)
+		return;
+
+	if (winPtr->start > 0) {
+		memmove(winPtr->text, winPtr->text + winPtr->start,
+				winPtr->end - winPtr->start);
+		winPtr->end -= winPtr->start;
+		winPtr->start = 0;
+	}
+	if ((text = (char *) realloc(winPtr->text, size)) == NULL) {
+		winPtr->limit = winPtr->size;
+		return;
+	}
+	winPtr->text = text;
+	winPtr->size = size;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		spillWindow              
+ **                                               
+ ** ARGUMENTS:	SPILLWINDOWPTR winPtr
+ **
+ ** Appends every line in the buffer to the last segment, in one
+ ** write, and empties the buffer.
+ **/
+
+void spillWindow(SPILLWINDOWPTR winPtr)
+{
+	SPILLSEGMENTPTR segPtr;
+
+	segPtr = lastSegment(winPtr);
+	writeSegment(segPtr, winPtr->text + winPtr->start, winPtr->end - winPtr->start);
+	segPtr->lines += winPtr->lines;
+	winPtr->spilled += winPtr->lines;
+
+	winPtr->start = winPtr->end = 0;
+	winPtr->lines = 0;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		lastSegment              
+ **                                               
+ ** ARGUMENTS:	SPILLWINDOWPTR winPtr
+ **				 
+ ** RETURNS		the segment to append to
+ **                                        
+ ** DESCRIPITON:
+ ** 
+ ** Starts a new segment once the last holds SPILL_SEGMENTSIZE bytes,
+ ** so that whole segments can be closed as the window moves on.  The
+ ** file is made in $TMPDIR, or /tmp, and unlinked at once: it goes
+ ** away when tailx exits, however it exits.
+ **/
+
+SPILLSEGMENTPTR lastSegment(SPILLWINDOWPTR winPtr)
+{
+	SPILLSEGMENTPTR segPtr;
+	char file_name[4096];
+	char *directory;
+
+	if ((winPtr->lastPtr != NULL) && (winPtr->lastPtr->bytes < SPILL_SEGMENTSIZE))
+		return winPtr->lastPtr;
+
+	if ((directory = getenv("TMPDIR")) == NULL)
+		directory = "/tmp";
+	snprintf(file_name, sizeof(file_name), "%s/tailxXXXXXX", directory);
+
+	if ((segPtr = (SPILLSEGMENTPTR) malloc(sizeof(SPILLSEGMENT))) == NULL) {
+		printf("lastSegment: No memory available.\n");
+		exit(1);
+	}
+	if ((segPtr->fd = mkstemp(file_name)) < 0) {
+		printf("Can't create spill file in %s\n", directory);
+		exit(1);
+	}
+	unlink(file_name);
+
+	segPtr->bytes = 0;
+	segPtr->lines = segPtr->dropped = 0;
+	segPtr->nextPtr = NULL;
+	segPtr->previousPtr = winPtr->lastPtr;
+	if (winPtr->lastPtr != NULL)
+		winPtr->lastPtr->nextPtr = segPtr;
+	else
+		winPtr->firstPtr = segPtr;
+	winPtr->lastPtr = segPtr;
+
+	return segPtr;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		writeSegment              
+ **                                               
+ ** ARGUMENTS:	SPILLSEGMENTPTR segPtr, const char text[], size_t len
+ **/
+
+void writeSegment(SPILLSEGMENTPTR segPtr, const char text[], size_t len)
+{
+	ssize_t put;
+
+	while (len > 0) {
+		if ((put = write(segPtr->fd, text, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			printf("Can't write spill file\n");
+			exit(1);
+		}
+		text += put;
+		len -= put;
+		segPtr->bytes += put;
+	}
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		readSegment              
+ **                                               
+ ** ARGUMENTS:	SPILLSEGMENTPTR segPtr, char block[], size_t len,
+ **				long position
+ **
+ ** RETURNS:	the bytes read, up to len, from position on
+ **/
+
+size_t readSegment(SPILLSEGMENTPTR segPtr, char block[], size_t len, long position)
+{
+	ssize_t got;
+	size_t total = 0;
+
+	if ((long) len > segPtr->bytes - position)
+		len = segPtr->bytes - position;
+
+	while (total < len) {
+		if ((got = pread(segPtr->fd, block + total, len - total, position + total)) <= 0) {
+			if ((got < 0) && (errno == EINTR))
+				continue;
+			printf("Can't read spill file\n");
+			exit(1);
+		}
+		total += got;
+	}
+
+	return total;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		printSegment              
+ **                                               
+ ** ARGUMENTS:	SPILLSEGMENTPTR segPtr, int reverse_lines,
+ **				FILE *output_fPtr
+ **				 
+ ** RETURNS		the number of lines printed
+ **                                        
+ ** DESCRIPITON:
+ ** 
+ ** Prints the lines of a segment still in the window, a block at a
+ ** time.  In order, the dropped lines at the front are skipped.  In
+ ** reverse, blocks are read from the end back, each put in front of
+ ** the part of a line the one after began with, and the lines after
+ ** the block's first <NL> are printed last to first.  A line longer
+ ** than a block grows the buffer.
+ **/
+
+int printSegment(SPILLSEGMENTPTR segPtr, int reverse_lines, FILE *output_fPtr)
+{
+	char *block, *grown;
+	const char *next;
+	size_t capacity, held, got, first;
+	long position;
+	int kept, skip, printed;
+
+	if ((kept = segPtr->lines - segPtr->dropped) == 0)
+		return 0;
+
+	capacity = SPILL_BLOCKSIZE;
+	if ((block = (char *) malloc(capacity)) == NULL) {
+		printf("printSegment: No memory available.\n");
+		exit(1);
+	}
+
+	if (!reverse_lines) {
+		skip = segPtr->dropped;
+		for (position = 0; position < segPtr->bytes; position += got) {
+			got = readSegment(segPtr, block, capacity, position);
+			next = block;
+			while ((skip > 0) && (next < block + got)) {
+				next = lineEnd(next, block + got);
+				if (next < block + got) {
+					next++;
+					skip--;
+				}
+			}
+			fwrite(next, 1, block + got - next, output_fPtr);
+		}
+		printed = kept;
+
+	} else {
+		held = 0;
+		printed = 0;
+		position = segPtr->bytes;
+		while ((printed < kept) && (position > 0)) {
+			got = (position < SPILL_BLOCKSIZE) ? position : SPILL_BLOCKSIZE;
+			if (held + got > capacity) {
+				if ((grown = (char *) realloc(block, 2 * capacity)) == NULL) {
+					printf("printSegment: No memory available.\n");
+					exit(1);
+				}
+				block = grown;
+				capacity *= 2;
+			}
+			memmove(block + got, block, held);
+			position -= got;
+			readSegment(segPtr, block, got, position);
+			held += got;
+
+			if (position == 0) {
+				printed += printLinesBackward(block, held, kept - printed, output_fPtr);
+				break;
+			}
+
+			/** The bytes up to the first <NL> may be the end of a line
+			 ** that began in an earlier block...
+			 **/
+			if ((next = lineEnd(block, block + got)) < block + got) {
+				first = next + 1 - block;
+				printed += printLinesBackward(block + first, held - first,
+											  kept - printed, output_fPtr);
+				held = first;
+			}
+		}
+	}
+
+	free(block);
+	return printed;
+}
+
+/**********************************************************
+ **                                                 
+ ** NAME:		printLinesBackward              
+ **                                               
+ ** ARGUMENTS:	const char text[] (whole lines, each ended by a <NL>),
+ **				size_t len, int limit, FILE *output_fPtr
+ **
+ ** RETURNS:	the number of lines printed, last to first, up to limit
+ **/
+
+int printLinesBackward(const char text[], size_t len, int limit, FILE *output_fPtr)
+{
+	const char *end, *line;
+	int printed = 0;
+
+	end = text + len;
+	while ((printed < limit) && (end > text)) {
+		line = end - 1;
+		while ((line > text) && (line[-1] != '\n'))
+			line--;
+		fwrite(line, 1, end - line, output_fPtr);
+		end = line;
+		printed++;
+	}
+
+	return printed;
+}